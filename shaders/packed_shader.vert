@@ -0,0 +1,47 @@
+#version 450
+
+// CModel::PackedVertex, unpacked by the vertex input formats except for the octahedral normal
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 color;
+layout(location = 2) in vec2 normal;
+layout(location = 3) in vec2 uv;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragPosWorld;
+layout(location = 2) out vec3 fragNormalWorld;
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+  mat4 projection;
+  mat4 view;
+  mat4 invView;
+  vec4 ambientLightColor; // w is intensity
+  uint lightingModel; // LightingModel, read when LIGHTING_MODEL is not specialized
+} ubo;
+
+// modelMatrix includes the mesh dequantization transform
+struct ObjectData {
+  mat4 modelMatrix;
+  mat4 normalMatrix;
+  vec4 color;
+};
+
+layout(set = 0, binding = 1) readonly buffer ObjectBuffer {
+  ObjectData objects[];
+} objectBuffer;
+
+vec3 octahedralDecode(vec2 encoded) {
+  vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+  float t = max(-n.z, 0.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.y += n.y >= 0.0 ? -t : t;
+  return normalize(n);
+}
+
+void main() {
+  ObjectData object = objectBuffer.objects[gl_InstanceIndex];
+  vec4 positionWorld = object.modelMatrix * vec4(position, 1.0);
+  gl_Position = ubo.projection * ubo.view * positionWorld;
+  fragNormalWorld = normalize(mat3(object.normalMatrix) * octahedralDecode(normal));
+  fragPosWorld = positionWorld.xyz;
+  fragColor = color * object.color.rgb;
+}
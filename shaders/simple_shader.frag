@@ -6,18 +6,21 @@ layout (location = 2) in vec3 fragNormalWorld;
 
 layout (location = 0) out vec4 outColor;
 
+// LightingModel, specialized by the render systems so the unused lighting is compiled out, the unspecialized
+// fallback takes it from the ubo instead
+layout (constant_id = 0) const uint LIGHTING_MODEL = 0xffffffffu;
+const uint LIGHTING_MODEL_AMBIENT = 0u;
+const uint LIGHTING_MODEL_HEADLIGHT = 1u;
+const uint LIGHTING_MODEL_DYNAMIC = 0xffffffffu;
+
 layout(set = 0, binding = 0) uniform GlobalUbo {
   mat4 projection;
   mat4 view;
   mat4 invView;
   vec4 ambientLightColor; // w is intensity
+  uint lightingModel; // LightingModel, read when LIGHTING_MODEL is not specialized
 } ubo;
 
-layout(push_constant) uniform Push {
-  mat4 modelMatrix;
-  mat4 normalMatrix;
-} push;
-
 void main() {
   vec3 diffuseLight = ubo.ambientLightColor.xyz * ubo.ambientLightColor.w;
   vec3 specularLight = vec3(0.0);
@@ -26,5 +29,13 @@ void main() {
   vec3 cameraPosWorld = ubo.invView[3].xyz;
   vec3 viewDirection = normalize(cameraPosWorld - fragPosWorld);
 
+  uint lightingModel = LIGHTING_MODEL == LIGHTING_MODEL_DYNAMIC ? ubo.lightingModel : LIGHTING_MODEL;
+  if (lightingModel == LIGHTING_MODEL_HEADLIGHT) {
+    // the light sits at the camera, so the light direction is the view direction
+    float cosAngIncidence = max(dot(surfaceNormal, viewDirection), 0.0);
+    diffuseLight += vec3(0.8) * cosAngIncidence;
+    specularLight += vec3(0.3) * pow(cosAngIncidence, 32.0);
+  }
+
   outColor = vec4(diffuseLight * fragColor + specularLight * fragColor, 1.0);
 }
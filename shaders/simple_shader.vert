@@ -14,17 +14,24 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
   mat4 view;
   mat4 invView;
   vec4 ambientLightColor; // w is intensity
+  uint lightingModel; // LightingModel, read when LIGHTING_MODEL is not specialized
 } ubo;
 
-layout(push_constant) uniform Push {
+struct ObjectData {
   mat4 modelMatrix;
   mat4 normalMatrix;
-} push;
+  vec4 color;
+};
+
+layout(set = 0, binding = 1) readonly buffer ObjectBuffer {
+  ObjectData objects[];
+} objectBuffer;
 
 void main() {
-  vec4 positionWorld = push.modelMatrix * vec4(position, 1.0);
+  ObjectData object = objectBuffer.objects[gl_InstanceIndex];
+  vec4 positionWorld = object.modelMatrix * vec4(position, 1.0);
   gl_Position = ubo.projection * ubo.view * positionWorld;
-  fragNormalWorld = normalize(mat3(push.normalMatrix) * normal);
+  fragNormalWorld = normalize(mat3(object.normalMatrix) * normal);
   fragPosWorld = positionWorld.xyz;
-  fragColor = color;
+  fragColor = color * object.color.rgb;
 }
@@ -12,34 +12,37 @@ VkDeviceSize CBuffer::getAlignment (VkDeviceSize instanceSize, VkDeviceSize minO
 	return instanceSize;
 }
 
-CBuffer::CBuffer (CDevice &device, VkDeviceSize instanceSize, uint32_t instanceCount, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize minOffsetAlignment)
+CBuffer::CBuffer (CDevice &device, VkDeviceSize instanceSize, uint32_t instanceCount, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize minOffsetAlignment, bool sharedWithTransfer)
 		: Device {device}, instanceSize {instanceSize}, instanceCount {instanceCount}, usageFlags {usageFlags}, memoryPropertyFlags {memoryPropertyFlags}
 {
 	alignmentSize = getAlignment(instanceSize, minOffsetAlignment);
 	bufferSize = alignmentSize * instanceCount;
-	device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, memory);
+	device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, memory, sharedWithTransfer);
 }
 
 CBuffer::~CBuffer ()
 {
 	unmap();
 	vkDestroyBuffer(Device.GetDevice(), buffer, nullptr);
-	vkFreeMemory(Device.GetDevice(), memory, nullptr);
+	Device.freeMemory(memory);
 }
 
 VkResult CBuffer::map (VkDeviceSize size, VkDeviceSize offset)
 {
-	assert(buffer && memory && "Called map on buffer before create");
-	return vkMapMemory(Device.GetDevice(), memory, offset, size, 0, &mapped);
+	assert(buffer && memory.memory && "Called map on buffer before create");
+	if (memory.mapped == nullptr)
+	{
+		return VK_ERROR_MEMORY_MAP_FAILED;
+	}
+
+	// the memory stays mapped by the allocator, other resources may share it
+	mapped = static_cast<char *>(memory.mapped) + offset;
+	return VK_SUCCESS;
 }
 
 void CBuffer::unmap ()
 {
-	if (mapped)
-	{
-		vkUnmapMemory(Device.GetDevice(), memory);
-		mapped = nullptr;
-	}
+	mapped = nullptr;
 }
 
 void CBuffer::writeToBuffer (void *data, VkDeviceSize size, VkDeviceSize offset)
@@ -60,22 +63,12 @@ void CBuffer::writeToBuffer (void *data, VkDeviceSize size, VkDeviceSize offset)
 
 VkResult CBuffer::flush (VkDeviceSize size, VkDeviceSize offset)
 {
-	VkMappedMemoryRange mappedRange = {};
-	mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-	mappedRange.memory = memory;
-	mappedRange.offset = offset;
-	mappedRange.size = size;
-	return vkFlushMappedMemoryRanges(Device.GetDevice(), 1, &mappedRange);
+	return Device.getMemoryAllocator().flush(memory, size, offset);
 }
 
 VkResult CBuffer::invalidate (VkDeviceSize size, VkDeviceSize offset)
 {
-	VkMappedMemoryRange mappedRange = {};
-	mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-	mappedRange.memory = memory;
-	mappedRange.offset = offset;
-	mappedRange.size = size;
-	return vkInvalidateMappedMemoryRanges(Device.GetDevice(), 1, &mappedRange);
+	return Device.getMemoryAllocator().invalidate(memory, size, offset);
 }
 
 VkDescriptorBufferInfo CBuffer::descriptorInfo (VkDeviceSize size, VkDeviceSize offset)
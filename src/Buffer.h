@@ -6,7 +6,8 @@
 class CBuffer
 {
 public:
-	CBuffer (CDevice& device, VkDeviceSize instanceSize, uint32_t instanceCount, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize minOffsetAlignment = 1);
+	// sharedWithTransfer makes the buffer concurrent across the graphics and transfer families, see CDevice::createBuffer
+	CBuffer (CDevice& device, VkDeviceSize instanceSize, uint32_t instanceCount, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize minOffsetAlignment = 1, bool sharedWithTransfer = false);
 	~CBuffer ();
 
 	VkResult map (VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
@@ -75,7 +76,7 @@ private:
 	CDevice& Device;
 	void *mapped = nullptr;
 	VkBuffer buffer = VK_NULL_HANDLE;
-	VkDeviceMemory memory = VK_NULL_HANDLE;
+	CMemoryAllocator::Allocation memory {};
 
 	VkDeviceSize bufferSize;
 	uint32_t instanceCount;
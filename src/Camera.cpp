@@ -109,3 +109,32 @@ void CCamera::setViewYXZ (glm::vec3 position, glm::vec3 rotation)
 }
 
 
+
+void CCamera::getFrustumPlanes (glm::vec4 planes[6]) const
+{
+	// Gribb and Hartmann plane extraction, clip space depth runs from 0 to 1
+	const glm::mat4 viewProjection = glm::transpose(projectionMatrix * viewMatrix);
+	planes[0] = viewProjection[3] + viewProjection[0];
+	planes[1] = viewProjection[3] - viewProjection[0];
+	planes[2] = viewProjection[3] + viewProjection[1];
+	planes[3] = viewProjection[3] - viewProjection[1];
+	planes[4] = viewProjection[2];
+	planes[5] = viewProjection[3] - viewProjection[2];
+
+	for (int i = 0; i < 6; ++i)
+	{
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+bool CCamera::isSphereVisible (const glm::vec4 planes[6], const glm::vec3 &center, float radius)
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
@@ -40,6 +40,12 @@ public:
 		return glm::vec3(inverseViewMatrix[3]);
 	}
 
+	// world space planes (xyz normal pointing inside, w distance) in left, right, bottom, top, near, far order
+	void getFrustumPlanes (glm::vec4 planes[6]) const;
+
+	// true when the sphere is at least partially inside all frustum planes
+	static bool isSphereVisible (const glm::vec4 planes[6], const glm::vec3 &center, float radius);
+
 private:
 	glm::mat4 projectionMatrix {1.f};
 	glm::mat4 viewMatrix {1.f};
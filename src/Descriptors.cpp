@@ -1,7 +1,9 @@
 #include "Descriptors.h"
 
 // std
+#include <algorithm>
 #include <cassert>
+#include <functional>
 #include <stdexcept>
 
 
@@ -20,24 +22,35 @@ CDescriptorSetLayout::CBuilder &CDescriptorSetLayout::CBuilder::addBinding (uint
 	return *this;
 }
 
-std::unique_ptr<CDescriptorSetLayout> CDescriptorSetLayout::CBuilder::build () const
+CDescriptorSetLayout::CBuilder &CDescriptorSetLayout::CBuilder::setFlags (VkDescriptorSetLayoutCreateFlags flags)
 {
-	return std::make_unique<CDescriptorSetLayout>(Device, bindings);
+	this->flags = flags;
+	return *this;
+}
+
+std::shared_ptr<CDescriptorSetLayout> CDescriptorSetLayout::CBuilder::build () const
+{
+	return Device.getDescriptorLayoutCache().getLayout(bindings, flags);
 }
 
 // *************** Descriptor Set Layout *********************
 
-CDescriptorSetLayout::CDescriptorSetLayout (CDevice &device, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings)
-		: Device {device}, bindings {bindings}
+CDescriptorSetLayout::CDescriptorSetLayout (CDevice &device, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings, VkDescriptorSetLayoutCreateFlags flags)
+		: Device {device}, bindings {bindings}, flags {flags}
 {
 	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings {};
 	for (auto kv: bindings)
 	{
 		setLayoutBindings.push_back(kv.second);
 	}
+	std::sort(setLayoutBindings.begin(), setLayoutBindings.end(), [] (const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b)
+	{
+		return a.binding < b.binding;
+	});
 
 	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo {};
 	descriptorSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptorSetLayoutInfo.flags = flags;
 	descriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
 	descriptorSetLayoutInfo.pBindings = setLayoutBindings.data();
 
@@ -45,13 +58,186 @@ CDescriptorSetLayout::CDescriptorSetLayout (CDevice &device, std::unordered_map<
 	{
 		throw std::runtime_error("failed to create descriptor set layout!");
 	}
+
+	for (const VkDescriptorSetLayoutBinding &binding: setLayoutBindings)
+	{
+		size_t infoSize = sizeof(VkDescriptorBufferInfo);
+		if (binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER || binding.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER)
+		{
+			infoSize = sizeof(VkBufferView);
+		}
+		else if (binding.descriptorType == VK_DESCRIPTOR_TYPE_SAMPLER || binding.descriptorType == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER || binding.descriptorType == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE || binding.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE || binding.descriptorType == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT)
+		{
+			infoSize = sizeof(VkDescriptorImageInfo);
+		}
+
+		VkDescriptorUpdateTemplateEntry entry {};
+		entry.dstBinding = binding.binding;
+		entry.descriptorCount = binding.descriptorCount;
+		entry.descriptorType = binding.descriptorType;
+		entry.offset = descriptorDataSize;
+		entry.stride = infoSize;
+		templateEntries.push_back(entry);
+		descriptorDataSize += infoSize * binding.descriptorCount;
+	}
+
+	// push descriptor layouts get their templates from CPushDescriptorTemplate, which also needs the pipeline layout
+	if (Device.createDescriptorUpdateTemplate != nullptr && (flags & VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR) == 0 && !templateEntries.empty())
+	{
+		VkDescriptorUpdateTemplateCreateInfo templateInfo {};
+		templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+		templateInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(templateEntries.size());
+		templateInfo.pDescriptorUpdateEntries = templateEntries.data();
+		templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+		templateInfo.descriptorSetLayout = descriptorSetLayout;
+		if (Device.createDescriptorUpdateTemplate(Device.GetDevice(), &templateInfo, nullptr, &updateTemplate) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create descriptor update template!");
+		}
+	}
 }
 
 CDescriptorSetLayout::~CDescriptorSetLayout ()
 {
+	if (updateTemplate != VK_NULL_HANDLE)
+	{
+		Device.destroyDescriptorUpdateTemplate(Device.GetDevice(), updateTemplate, nullptr);
+	}
 	vkDestroyDescriptorSetLayout(Device.GetDevice(), descriptorSetLayout, nullptr);
 }
 
+void CDescriptorSetLayout::update (VkDescriptorSet set, const void *descriptorData) const
+{
+	if (updateTemplate != VK_NULL_HANDLE)
+	{
+		Device.updateDescriptorSetWithTemplate(Device.GetDevice(), set, updateTemplate, descriptorData);
+		return;
+	}
+
+	// without templates the entries become writes, in batches so the common layouts need no allocation
+	constexpr size_t BATCH_SIZE = 16;
+	VkWriteDescriptorSet writes[BATCH_SIZE];
+	for (size_t first = 0; first < templateEntries.size(); first += BATCH_SIZE)
+	{
+		const size_t count = std::min(BATCH_SIZE, templateEntries.size() - first);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const VkDescriptorUpdateTemplateEntry &entry = templateEntries[first + i];
+			const char *info = static_cast<const char *>(descriptorData) + entry.offset;
+
+			VkWriteDescriptorSet &write = writes[i];
+			write = {};
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = set;
+			write.dstBinding = entry.dstBinding;
+			write.descriptorCount = entry.descriptorCount;
+			write.descriptorType = entry.descriptorType;
+			if (entry.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER || entry.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER)
+			{
+				write.pTexelBufferView = reinterpret_cast<const VkBufferView *>(info);
+			}
+			else if (entry.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || entry.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER || entry.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC || entry.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC)
+			{
+				write.pBufferInfo = reinterpret_cast<const VkDescriptorBufferInfo *>(info);
+			}
+			else
+			{
+				write.pImageInfo = reinterpret_cast<const VkDescriptorImageInfo *>(info);
+			}
+		}
+		vkUpdateDescriptorSets(Device.GetDevice(), static_cast<uint32_t>(count), writes, 0, nullptr);
+	}
+}
+
+// *************** Push Descriptor Template *********************
+
+CPushDescriptorTemplate::CPushDescriptorTemplate (CDevice &device, const CDescriptorSetLayout &setLayout, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, uint32_t set)
+		: Device {device}, pipelineLayout {pipelineLayout}, set {set}
+{
+	assert((setLayout.flags & VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR) != 0 && "Layout was not built for push descriptors");
+
+	VkDescriptorUpdateTemplateCreateInfo templateInfo {};
+	templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+	templateInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(setLayout.templateEntries.size());
+	templateInfo.pDescriptorUpdateEntries = setLayout.templateEntries.data();
+	templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR;
+	templateInfo.descriptorSetLayout = setLayout.getDescriptorSetLayout();
+	templateInfo.pipelineBindPoint = bindPoint;
+	templateInfo.pipelineLayout = pipelineLayout;
+	templateInfo.set = set;
+	if (Device.createDescriptorUpdateTemplate(Device.GetDevice(), &templateInfo, nullptr, &updateTemplate) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create push descriptor template!");
+	}
+}
+
+CPushDescriptorTemplate::~CPushDescriptorTemplate ()
+{
+	Device.destroyDescriptorUpdateTemplate(Device.GetDevice(), updateTemplate, nullptr);
+}
+
+void CPushDescriptorTemplate::push (VkCommandBuffer commandBuffer, const void *descriptorData) const
+{
+	Device.cmdPushDescriptorSetWithTemplate(commandBuffer, updateTemplate, pipelineLayout, set, descriptorData);
+}
+
+// *************** Descriptor Layout Cache *********************
+
+bool CDescriptorLayoutCache::LayoutKey::operator== (const LayoutKey &other) const
+{
+	return flags == other.flags && std::equal(bindings.begin(), bindings.end(), other.bindings.begin(), other.bindings.end(), [] (const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b)
+	{
+		return a.binding == b.binding && a.descriptorType == b.descriptorType && a.descriptorCount == b.descriptorCount && a.stageFlags == b.stageFlags;
+	});
+}
+
+size_t CDescriptorLayoutCache::LayoutKeyHash::operator() (const LayoutKey &key) const
+{
+	size_t result = std::hash<size_t>()(key.bindings.size()) ^ std::hash<uint32_t>()(key.flags);
+	for (const VkDescriptorSetLayoutBinding &binding: key.bindings)
+	{
+		const uint64_t packed = static_cast<uint64_t>(binding.binding) | static_cast<uint64_t>(binding.descriptorType) << 16 | static_cast<uint64_t>(binding.descriptorCount) << 32;
+		result ^= std::hash<uint64_t>()(packed) + 0x9e3779b9 + (result << 6) + (result >> 2);
+		result ^= std::hash<uint32_t>()(binding.stageFlags) + 0x9e3779b9 + (result << 6) + (result >> 2);
+	}
+	return result;
+}
+
+std::shared_ptr<CDescriptorSetLayout> CDescriptorLayoutCache::getLayout (const std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> &bindings, VkDescriptorSetLayoutCreateFlags flags)
+{
+	LayoutKey key {};
+	key.flags = flags;
+	for (auto &kv: bindings)
+	{
+		assert(kv.second.pImmutableSamplers == nullptr && "Immutable samplers are not part of the layout key");
+		key.bindings.push_back(kv.second);
+	}
+	std::sort(key.bindings.begin(), key.bindings.end(), [] (const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b)
+	{
+		return a.binding < b.binding;
+	});
+
+	std::lock_guard<std::mutex> lock {mutex};
+	auto &layout = layouts[key];
+	if (layout == nullptr)
+	{
+		layout = std::make_shared<CDescriptorSetLayout>(Device, bindings, flags);
+	}
+	return layout;
+}
+
+size_t CDescriptorLayoutCache::getLayoutCount () const
+{
+	std::lock_guard<std::mutex> lock {mutex};
+	return layouts.size();
+}
+
+void CDescriptorLayoutCache::clear ()
+{
+	std::lock_guard<std::mutex> lock {mutex};
+	layouts.clear();
+}
+
 // *************** Descriptor Pool CBuilder *********************
 
 CDescriptorPool::CBuilder &CDescriptorPool::CBuilder::addPoolSize (VkDescriptorType descriptorType, uint32_t count)
@@ -108,8 +294,7 @@ bool CDescriptorPool::allocateDescriptor (const VkDescriptorSetLayout descriptor
 	allocInfo.pSetLayouts = &descriptorSetLayout;
 	allocInfo.descriptorSetCount = 1;
 
-	// Might want to create a "DescriptorPoolManager" class that handles this case, and builds
-	// a new pool whenever an old pool fills up. But this is beyond our current scope
+	// a full pool fails here, CDescriptorAllocator chains a new pool for that case
 	if (vkAllocateDescriptorSets(Device.GetDevice(), &allocInfo, &descriptor) != VK_SUCCESS)
 	{
 		return false;
@@ -127,10 +312,78 @@ void CDescriptorPool::resetPool ()
 	vkResetDescriptorPool(Device.GetDevice(), descriptorPool, 0);
 }
 
+// *************** Descriptor Allocator *********************
+
+CDescriptorAllocator::CDescriptorAllocator (CDevice &device, std::vector<PoolSizeRatio> poolSizeRatios)
+		: Device {device}, poolSizeRatios {std::move(poolSizeRatios)}
+{
+}
+
+std::vector<CDescriptorAllocator::PoolSizeRatio> CDescriptorAllocator::getDefaultPoolSizeRatios ()
+{
+	return {
+		{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.f},
+		{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.f},
+		{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.f},
+		{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.f},
+		{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.f},
+		{VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1.f},
+		{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.f},
+		{VK_DESCRIPTOR_TYPE_SAMPLER, 1.f}
+	};
+}
+
+std::unique_ptr<CDescriptorPool> CDescriptorAllocator::createPool (uint32_t setCount) const
+{
+	CDescriptorPool::CBuilder builder {Device};
+	builder.setMaxSets(setCount);
+	for (const PoolSizeRatio &poolSizeRatio: poolSizeRatios)
+	{
+		builder.addPoolSize(poolSizeRatio.type, std::max(1u, static_cast<uint32_t>(poolSizeRatio.ratio * setCount)));
+	}
+	return builder.build();
+}
+
+bool CDescriptorAllocator::allocateDescriptor (const VkDescriptorSetLayout descriptorSetLayout, VkDescriptorSet &descriptor)
+{
+	if (!usedPools.empty() && usedPools.back()->allocateDescriptor(descriptorSetLayout, descriptor))
+	{
+		return true;
+	}
+
+	// the current pool is full, recycled pools are used before growing
+	if (!freePools.empty())
+	{
+		usedPools.push_back(std::move(freePools.back()));
+		freePools.pop_back();
+	}
+	else
+	{
+		usedPools.push_back(createPool(setsPerPool));
+		setsPerPool = std::min(setsPerPool * 2, MAX_SETS_PER_POOL);
+	}
+	return usedPools.back()->allocateDescriptor(descriptorSetLayout, descriptor);
+}
+
+void CDescriptorAllocator::resetPools ()
+{
+	for (auto &pool: usedPools)
+	{
+		pool->resetPool();
+		freePools.push_back(std::move(pool));
+	}
+	usedPools.clear();
+}
+
 // *************** Descriptor Writer *********************
 
 CDescriptorWriter::CDescriptorWriter (CDescriptorSetLayout &setLayout, CDescriptorPool &pool)
-		: setLayout {setLayout}, pool {pool}
+		: setLayout {setLayout}, pool {&pool}
+{
+}
+
+CDescriptorWriter::CDescriptorWriter (CDescriptorSetLayout &setLayout, CDescriptorAllocator &allocator)
+		: setLayout {setLayout}, allocator {&allocator}
 {
 }
 
@@ -174,7 +427,7 @@ CDescriptorWriter &CDescriptorWriter::writeImage (uint32_t binding, VkDescriptor
 
 bool CDescriptorWriter::build (VkDescriptorSet &set)
 {
-	bool success = pool.allocateDescriptor(setLayout.getDescriptorSetLayout(), set);
+	bool success = pool != nullptr ? pool->allocateDescriptor(setLayout.getDescriptorSetLayout(), set) : allocator->allocateDescriptor(setLayout.getDescriptorSetLayout(), set);
 	if (!success)
 	{
 		return false;
@@ -189,7 +442,7 @@ void CDescriptorWriter::overwrite (VkDescriptorSet &set)
 	{
 		write.dstSet = set;
 	}
-	vkUpdateDescriptorSets(pool.Device.GetDevice(), writes.size(), writes.data(), 0, nullptr);
+	vkUpdateDescriptorSets(setLayout.Device.GetDevice(), writes.size(), writes.data(), 0, nullptr);
 }
 
 
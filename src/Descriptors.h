@@ -4,6 +4,7 @@
 
 
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -21,27 +22,123 @@ public:
 
 		CBuilder &addBinding (uint32_t binding, VkDescriptorType descriptorType, VkShaderStageFlags stageFlags, uint32_t count = 1);
 
-		std::unique_ptr<CDescriptorSetLayout> build () const;
+		// VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR makes a layout for CPushDescriptorTemplate
+		CBuilder &setFlags (VkDescriptorSetLayoutCreateFlags flags);
+
+		// layouts come from the device's layout cache, identical bindings share one layout
+		std::shared_ptr<CDescriptorSetLayout> build () const;
 
 	private:
 		CDevice& Device;
 		std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings {};
+		VkDescriptorSetLayoutCreateFlags flags = 0;
 	};
 
-	CDescriptorSetLayout (CDevice& Device, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings);
+	CDescriptorSetLayout (CDevice& Device, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings, VkDescriptorSetLayoutCreateFlags flags = 0);
 	~CDescriptorSetLayout ();
 
+	CDescriptorSetLayout (const CDescriptorSetLayout &) = delete;
+
+	CDescriptorSetLayout &operator= (const CDescriptorSetLayout &) = delete;
+
 	VkDescriptorSetLayout getDescriptorSetLayout () const
 	{
 		return descriptorSetLayout;
 	}
 
+	// size of the descriptor data that update takes: the infos of every binding in binding order, tightly
+	// packed, VkDescriptorBufferInfo for buffers, VkDescriptorImageInfo for images and VkBufferView for texel buffers
+	size_t getDescriptorDataSize () const
+	{
+		return descriptorDataSize;
+	}
+
+	// writes every binding of set from the packed descriptor data, with the layout's update template when the
+	// device supports them
+	void update (VkDescriptorSet set, const void *descriptorData) const;
+
 private:
 	CDevice& Device;
 	VkDescriptorSetLayout descriptorSetLayout;
 	std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings;
+	VkDescriptorSetLayoutCreateFlags flags;
+
+	// one entry per binding, offsets into the packed descriptor data
+	std::vector<VkDescriptorUpdateTemplateEntry> templateEntries;
+	size_t descriptorDataSize = 0;
+	VkDescriptorUpdateTemplate updateTemplate = VK_NULL_HANDLE;
 
 	friend class CDescriptorWriter;
+	friend class CPushDescriptorTemplate;
+};
+
+// Records the bindings of a push descriptor layout straight into a command buffer from packed descriptor data,
+// so descriptors that change per dispatch or draw need no sets. Needs VK_KHR_push_descriptor.
+class CPushDescriptorTemplate
+{
+public:
+	CPushDescriptorTemplate (CDevice &device, const CDescriptorSetLayout &setLayout, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, uint32_t set);
+
+	~CPushDescriptorTemplate ();
+
+	CPushDescriptorTemplate (const CPushDescriptorTemplate &) = delete;
+
+	CPushDescriptorTemplate &operator= (const CPushDescriptorTemplate &) = delete;
+
+	static bool isSupported (CDevice &device)
+	{
+		return device.cmdPushDescriptorSetWithTemplate != nullptr;
+	}
+
+	// descriptorData is packed like for CDescriptorSetLayout::update
+	void push (VkCommandBuffer commandBuffer, const void *descriptorData) const;
+
+private:
+	CDevice &Device;
+	VkPipelineLayout pipelineLayout;
+	uint32_t set;
+	VkDescriptorUpdateTemplate updateTemplate = VK_NULL_HANDLE;
+};
+
+// Keeps one layout per distinct set of bindings, so systems that declare the same bindings share a layout and
+// pipelines built against either are compatible.
+class CDescriptorLayoutCache
+{
+public:
+	explicit CDescriptorLayoutCache (CDevice &device)
+			: Device {device}
+	{
+	}
+
+	CDescriptorLayoutCache (const CDescriptorLayoutCache &) = delete;
+
+	CDescriptorLayoutCache &operator= (const CDescriptorLayoutCache &) = delete;
+
+	std::shared_ptr<CDescriptorSetLayout> getLayout (const std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> &bindings, VkDescriptorSetLayoutCreateFlags flags);
+
+	size_t getLayoutCount () const;
+
+	// destroys the layouts that are not used outside of the cache
+	void clear ();
+
+private:
+	// bindings sorted by binding number, immutable samplers are not supported
+	struct LayoutKey
+	{
+		std::vector<VkDescriptorSetLayoutBinding> bindings;
+		VkDescriptorSetLayoutCreateFlags flags;
+
+		bool operator== (const LayoutKey &other) const;
+	};
+
+	struct LayoutKeyHash
+	{
+		size_t operator() (const LayoutKey &key) const;
+	};
+
+	CDevice &Device;
+	std::unordered_map<LayoutKey, std::shared_ptr<CDescriptorSetLayout>, LayoutKeyHash> layouts;
+	mutable std::mutex mutex;
 };
 
 class CDescriptorPool
@@ -86,11 +183,61 @@ private:
 	friend class CDescriptorWriter;
 };
 
+// Allocates sets from a chain of pools, a new pool is added whenever the current one runs out and each is
+// larger than the last. Pools are only reset all at once, which returns them to a free list they are taken
+// from before new ones are created. Used with one allocator per frame in flight, reset once the frame's
+// fence has signaled, for sets that only live for a frame.
+class CDescriptorAllocator
+{
+public:
+	static constexpr uint32_t INITIAL_SETS_PER_POOL = 64;
+	static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+	// descriptors of a type per set in a pool
+	struct PoolSizeRatio
+	{
+		VkDescriptorType type;
+		float ratio;
+	};
+
+	explicit CDescriptorAllocator (CDevice &device, std::vector<PoolSizeRatio> poolSizeRatios = getDefaultPoolSizeRatios());
+
+	CDescriptorAllocator (const CDescriptorAllocator &) = delete;
+
+	CDescriptorAllocator &operator= (const CDescriptorAllocator &) = delete;
+
+	// only fails when a new pool cannot fit the set either
+	bool allocateDescriptor (const VkDescriptorSetLayout descriptorSetLayout, VkDescriptorSet &descriptor);
+
+	// frees every set allocated since the last reset, none of them may still be used by pending commands
+	void resetPools ();
+
+	uint32_t getPoolCount () const
+	{
+		return static_cast<uint32_t>(usedPools.size() + freePools.size());
+	}
+
+	static std::vector<PoolSizeRatio> getDefaultPoolSizeRatios ();
+
+private:
+	std::unique_ptr<CDescriptorPool> createPool (uint32_t setCount) const;
+
+	CDevice &Device;
+	std::vector<PoolSizeRatio> poolSizeRatios;
+	uint32_t setsPerPool = INITIAL_SETS_PER_POOL;
+
+	// the last used pool is the one allocated from
+	std::vector<std::unique_ptr<CDescriptorPool>> usedPools;
+	std::vector<std::unique_ptr<CDescriptorPool>> freePools;
+};
+
 class CDescriptorWriter
 {
 public:
 	CDescriptorWriter (CDescriptorSetLayout &setLayout, CDescriptorPool &pool);
 
+	CDescriptorWriter (CDescriptorSetLayout &setLayout, CDescriptorAllocator &allocator);
+
 	CDescriptorWriter &writeBuffer (uint32_t binding, VkDescriptorBufferInfo *bufferInfo);
 
 	CDescriptorWriter &writeImage (uint32_t binding, VkDescriptorImageInfo *imageInfo);
@@ -101,7 +248,9 @@ public:
 
 private:
 	CDescriptorSetLayout &setLayout;
-	CDescriptorPool &pool;
+	// sets are allocated from one of the two
+	CDescriptorPool *pool = nullptr;
+	CDescriptorAllocator *allocator = nullptr;
 	std::vector<VkWriteDescriptorSet> writes;
 };
 
@@ -1,11 +1,17 @@
 #include "Device.h"
 
+#include "Descriptors.h"
+
 // std headers
 #include <cstring>
 #include <iostream>
 #include <set>
 #include <unordered_set>
 
+#ifndef ENGINE_DIR
+#define ENGINE_DIR "../"
+#endif
+
 
 // local callback functions
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback (VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData, void *pUserData)
@@ -46,12 +52,18 @@ CDevice::CDevice (CWindow &window)
 	createSurface();
 	pickPhysicalDevice();
 	createLogicalDevice();
+	memoryAllocator = std::make_unique<CMemoryAllocator>(device_, physicalDevice);
+	descriptorLayoutCache = std::make_unique<CDescriptorLayoutCache>(*this);
+	pipelineCache = std::make_unique<CPipelineCache>(device_, properties, ENGINE_DIR "pipeline.cache");
 	createCommandPool();
 }
 
 CDevice::~CDevice ()
 {
 	vkDestroyCommandPool(device_, commandPool, nullptr);
+	descriptorLayoutCache.reset();
+	pipelineCache.reset();
+	memoryAllocator.reset();
 	vkDestroyDevice(device_, nullptr);
 
 	if (enableValidationLayers)
@@ -83,6 +95,19 @@ void CDevice::createInstance ()
 	createInfo.pApplicationInfo = &appInfo;
 
 	auto extensions = getRequiredExtensions();
+	// optional, VK_KHR_push_descriptor depends on it
+	uint32_t availableCount = 0;
+	vkEnumerateInstanceExtensionProperties(nullptr, &availableCount, nullptr);
+	std::vector<VkExtensionProperties> availableExtensions(availableCount);
+	vkEnumerateInstanceExtensionProperties(nullptr, &availableCount, availableExtensions.data());
+	for (const auto &extension: availableExtensions)
+	{
+		if (strcmp(extension.extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0)
+		{
+			extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+			physicalDeviceProperties2Enabled = true;
+		}
+	}
 	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
 	createInfo.ppEnabledExtensionNames = extensions.data();
 
@@ -145,6 +170,10 @@ void CDevice::createLogicalDevice ()
 
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 	std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+	if (indices.transferFamilyHasValue)
+	{
+		uniqueQueueFamilies.insert(indices.transferFamily);
+	}
 
 	float queuePriority = 1.0f;
 	for (uint32_t queueFamily: uniqueQueueFamilies)
@@ -157,8 +186,14 @@ void CDevice::createLogicalDevice ()
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+	enabledFeatures = deviceFeatures;
 
 	VkDeviceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -166,9 +201,30 @@ void CDevice::createLogicalDevice ()
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
+	std::vector<const char *> enabledExtensions = deviceExtensions;
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+	auto enableExtension = [&] (const char *name)
+	{
+		for (const auto &extension: availableExtensions)
+		{
+			if (strcmp(extension.extensionName, name) == 0)
+			{
+				enabledExtensions.push_back(name);
+				return true;
+			}
+		}
+		return false;
+	};
+	const bool drawIndirectCount = enableExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	const bool descriptorUpdateTemplate = enableExtension(VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME);
+	const bool pushDescriptor = physicalDeviceProperties2Enabled && descriptorUpdateTemplate && enableExtension(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+
 	createInfo.pEnabledFeatures = &deviceFeatures;
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+	createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 	// might not really be necessary anymore because device specific validation layers
 	// have been deprecated
@@ -187,8 +243,29 @@ void CDevice::createLogicalDevice ()
 		throw std::runtime_error("failed to create logical device!");
 	}
 
+	if (drawIndirectCount)
+	{
+		cmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(device_, "vkCmdDrawIndexedIndirectCountKHR"));
+	}
+	if (descriptorUpdateTemplate)
+	{
+		createDescriptorUpdateTemplate = reinterpret_cast<PFN_vkCreateDescriptorUpdateTemplateKHR>(vkGetDeviceProcAddr(device_, "vkCreateDescriptorUpdateTemplateKHR"));
+		destroyDescriptorUpdateTemplate = reinterpret_cast<PFN_vkDestroyDescriptorUpdateTemplateKHR>(vkGetDeviceProcAddr(device_, "vkDestroyDescriptorUpdateTemplateKHR"));
+		updateDescriptorSetWithTemplate = reinterpret_cast<PFN_vkUpdateDescriptorSetWithTemplateKHR>(vkGetDeviceProcAddr(device_, "vkUpdateDescriptorSetWithTemplateKHR"));
+	}
+	if (pushDescriptor)
+	{
+		cmdPushDescriptorSetWithTemplate = reinterpret_cast<PFN_vkCmdPushDescriptorSetWithTemplateKHR>(vkGetDeviceProcAddr(device_, "vkCmdPushDescriptorSetWithTemplateKHR"));
+	}
+
 	vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
 	vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+	transferQueue_ = graphicsQueue_;
+	if (indices.transferFamilyHasValue)
+	{
+		vkGetDeviceQueue(device_, indices.transferFamily, 0, &transferQueue_);
+		std::cout << "transfer queue family: " << indices.transferFamily << std::endl;
+	}
 }
 
 void CDevice::createCommandPool ()
@@ -378,6 +455,20 @@ QueueFamilyIndices CDevice::findQueueFamilies (VkPhysicalDevice device)
 		i++;
 	}
 
+	// a transfer only family is usually a separate copy engine, an async compute family is the next best choice
+	for (VkQueueFlags excludedFlags: {VkQueueFlags(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT), VkQueueFlags(VK_QUEUE_GRAPHICS_BIT)})
+	{
+		for (uint32_t family = 0; family < queueFamilies.size() && !indices.transferFamilyHasValue; ++family)
+		{
+			const VkQueueFlags flags = queueFamilies[family].queueFlags;
+			if (queueFamilies[family].queueCount > 0 && (flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT)) && !(flags & excludedFlags))
+			{
+				indices.transferFamily = family;
+				indices.transferFamilyHasValue = true;
+			}
+		}
+	}
+
 	return indices;
 }
 
@@ -440,7 +531,7 @@ uint32_t CDevice::findMemoryType (uint32_t typeFilter, VkMemoryPropertyFlags pro
 	throw std::runtime_error("failed to find suitable memory type!");
 }
 
-void CDevice::createBuffer (VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &bufferMemory)
+void CDevice::createBuffer (VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, CMemoryAllocator::Allocation &bufferMemory, bool sharedWithTransfer)
 {
 	VkBufferCreateInfo bufferInfo {};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -448,6 +539,17 @@ void CDevice::createBuffer (VkDeviceSize size, VkBufferUsageFlags usage, VkMemor
 	bufferInfo.usage = usage;
 	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+	uint32_t queueFamilyIndices[2] {};
+	if (sharedWithTransfer && hasDedicatedTransferQueue())
+	{
+		QueueFamilyIndices indices = findPhysicalQueueFamilies();
+		queueFamilyIndices[0] = indices.graphicsFamily;
+		queueFamilyIndices[1] = indices.transferFamily;
+		bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferInfo.queueFamilyIndexCount = 2;
+		bufferInfo.pQueueFamilyIndices = queueFamilyIndices;
+	}
+
 	if (vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create vertex buffer!");
@@ -456,17 +558,8 @@ void CDevice::createBuffer (VkDeviceSize size, VkBufferUsageFlags usage, VkMemor
 	VkMemoryRequirements memRequirements;
 	vkGetBufferMemoryRequirements(device_, buffer, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to allocate vertex buffer memory!");
-	}
-
-	vkBindBufferMemory(device_, buffer, bufferMemory, 0);
+	bufferMemory = memoryAllocator->allocate(memRequirements, findMemoryType(memRequirements.memoryTypeBits, properties), true);
+	vkBindBufferMemory(device_, buffer, bufferMemory.memory, bufferMemory.offset);
 }
 
 VkCommandBuffer CDevice::beginSingleTimeCommands ()
@@ -497,47 +590,20 @@ void CDevice::endSingleTimeCommands (VkCommandBuffer commandBuffer)
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &commandBuffer;
 
-	vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(graphicsQueue_);
-
-	vkFreeCommandBuffers(device_, commandPool, 1, &commandBuffer);
-}
-
-void CDevice::copyBuffer (VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
-{
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+	// waits for this submission only instead of the whole queue
+	VkFenceCreateInfo fenceInfo {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	VkFence fence;
+	vkCreateFence(device_, &fenceInfo, nullptr, &fence);
 
-	VkBufferCopy copyRegion {};
-	copyRegion.srcOffset = 0;  // Optional
-	copyRegion.dstOffset = 0;  // Optional
-	copyRegion.size = size;
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+	vkQueueSubmit(graphicsQueue_, 1, &submitInfo, fence);
+	vkWaitForFences(device_, 1, &fence, VK_TRUE, UINT64_MAX);
 
-	endSingleTimeCommands(commandBuffer);
-}
-
-void CDevice::copyBufferToImage (VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount)
-{
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-	VkBufferImageCopy region {};
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = layerCount;
-
-	region.imageOffset = {0, 0, 0};
-	region.imageExtent = {width, height, 1};
-
-	vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-	endSingleTimeCommands(commandBuffer);
+	vkDestroyFence(device_, fence, nullptr);
+	vkFreeCommandBuffers(device_, commandPool, 1, &commandBuffer);
 }
 
-void CDevice::createImageWithInfo (const VkImageCreateInfo &imageInfo, VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &imageMemory)
+void CDevice::createImageWithInfo (const VkImageCreateInfo &imageInfo, VkMemoryPropertyFlags properties, VkImage &image, CMemoryAllocator::Allocation &imageMemory)
 {
 	if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS)
 	{
@@ -547,19 +613,15 @@ void CDevice::createImageWithInfo (const VkImageCreateInfo &imageInfo, VkMemoryP
 	VkMemoryRequirements memRequirements;
 	vkGetImageMemoryRequirements(device_, image, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to allocate image memory!");
-	}
-
-	if (vkBindImageMemory(device_, image, imageMemory, 0) != VK_SUCCESS)
+	imageMemory = memoryAllocator->allocate(memRequirements, findMemoryType(memRequirements.memoryTypeBits, properties), imageInfo.tiling == VK_IMAGE_TILING_LINEAR);
+	if (vkBindImageMemory(device_, image, imageMemory.memory, imageMemory.offset) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to bind image memory!");
 	}
 }
 
+void CDevice::freeMemory (const CMemoryAllocator::Allocation &memory)
+{
+	memoryAllocator->free(memory);
+}
+
@@ -1,7 +1,10 @@
 #pragma once
 
+#include "MemoryAllocator.h"
+#include "PipelineCache.h"
 #include "Window.h"
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -17,8 +20,11 @@ struct QueueFamilyIndices
 {
 	uint32_t graphicsFamily;
 	uint32_t presentFamily;
+	// only set when the device has a transfer capable family without graphics
+	uint32_t transferFamily;
 	bool graphicsFamilyHasValue = false;
 	bool presentFamilyHasValue = false;
+	bool transferFamilyHasValue = false;
 
 	bool isComplete ()
 	{
@@ -26,6 +32,8 @@ struct QueueFamilyIndices
 	}
 };
 
+class CDescriptorLayoutCache;
+
 class CDevice
 {
 public:
@@ -67,6 +75,17 @@ public:
 		return presentQueue_;
 	}
 
+	// the graphics queue when the device has no separate transfer family
+	VkQueue transferQueue ()
+	{
+		return transferQueue_;
+	}
+
+	bool hasDedicatedTransferQueue ()
+	{
+		return transferQueue_ != graphicsQueue_;
+	}
+
 	SwapChainSupportDetails getSwapChainSupport ()
 	{
 		return querySwapChainSupport(physicalDevice);
@@ -81,20 +100,46 @@ public:
 
 	VkFormat findSupportedFormat (const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
+	CMemoryAllocator &getMemoryAllocator ()
+	{
+		return *memoryAllocator;
+	}
+
+	CDescriptorLayoutCache &getDescriptorLayoutCache ()
+	{
+		return *descriptorLayoutCache;
+	}
+
+	// shared by every pipeline creation, loaded from and saved to disk
+	CPipelineCache &getPipelineCache ()
+	{
+		return *pipelineCache;
+	}
+
 	// Buffer Helper Functions
-	void createBuffer (VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &bufferMemory);
+	// a buffer shared with the transfer family can be written by uploads on the transfer queue while the graphics
+	// queue reads other ranges of it, without an ownership transfer
+	void createBuffer (VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, CMemoryAllocator::Allocation &bufferMemory, bool sharedWithTransfer = false);
 
 	VkCommandBuffer beginSingleTimeCommands ();
 
 	void endSingleTimeCommands (VkCommandBuffer commandBuffer);
 
-	void copyBuffer (VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-
-	void copyBufferToImage (VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
+	void createImageWithInfo (const VkImageCreateInfo &imageInfo, VkMemoryPropertyFlags properties, VkImage &image, CMemoryAllocator::Allocation &imageMemory);
 
-	void createImageWithInfo (const VkImageCreateInfo &imageInfo, VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &imageMemory);
+	void freeMemory (const CMemoryAllocator::Allocation &memory);
 
 	VkPhysicalDeviceProperties properties;
+	// the optional features that were enabled on the logical device
+	VkPhysicalDeviceFeatures enabledFeatures {};
+	// from VK_KHR_draw_indirect_count, null when the extension is not available
+	PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr;
+	// from VK_KHR_descriptor_update_template, null when the extension is not available
+	PFN_vkCreateDescriptorUpdateTemplateKHR createDescriptorUpdateTemplate = nullptr;
+	PFN_vkDestroyDescriptorUpdateTemplateKHR destroyDescriptorUpdateTemplate = nullptr;
+	PFN_vkUpdateDescriptorSetWithTemplateKHR updateDescriptorSetWithTemplate = nullptr;
+	// from VK_KHR_push_descriptor, null when the extension is not available
+	PFN_vkCmdPushDescriptorSetWithTemplateKHR cmdPushDescriptorSetWithTemplate = nullptr;
 
 private:
 	void createInstance ();
@@ -136,6 +181,11 @@ private:
 	VkSurfaceKHR surface_;
 	VkQueue graphicsQueue_;
 	VkQueue presentQueue_;
+	VkQueue transferQueue_;
+	std::unique_ptr<CMemoryAllocator> memoryAllocator;
+	std::unique_ptr<CDescriptorLayoutCache> descriptorLayoutCache;
+	std::unique_ptr<CPipelineCache> pipelineCache;
+	bool physicalDeviceProperties2Enabled = false;
 
 	const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
 	const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
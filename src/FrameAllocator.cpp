@@ -0,0 +1,52 @@
+#include "FrameAllocator.h"
+
+// std
+#include <algorithm>
+#include <stdexcept>
+
+
+CFrameAllocator::CFrameAllocator (CDevice &device, uint32_t frameCount, VkDeviceSize maxBindingRange, VkDeviceSize capacity)
+	: Device {device}
+{
+	const VkPhysicalDeviceLimits &limits = Device.properties.limits;
+	alignment = std::max(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment);
+	this->capacity = (capacity + alignment - 1) / alignment * alignment;
+
+	// every instance is one alignment unit, an allocation covers a run of them
+	const VkDeviceSize instanceCount = (this->capacity + maxBindingRange + alignment - 1) / alignment;
+	for (uint32_t i = 0; i < frameCount; ++i)
+	{
+		buffers.push_back(std::make_unique<CBuffer>(Device, alignment, static_cast<uint32_t>(instanceCount), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, alignment));
+		buffers.back()->map();
+	}
+}
+
+void CFrameAllocator::beginFrame (int frameIndex)
+{
+	this->frameIndex = frameIndex;
+	head = 0;
+}
+
+CFrameAllocator::Allocation CFrameAllocator::allocate (VkDeviceSize size)
+{
+	if (head + size > capacity)
+	{
+		throw std::runtime_error("frame allocator is out of memory!");
+	}
+
+	Allocation allocation {};
+	allocation.data = static_cast<char *>(buffers[frameIndex]->getMappedMemory()) + head;
+	allocation.offset = static_cast<uint32_t>(head);
+	allocation.size = size;
+
+	head = (head + size + alignment - 1) / alignment * alignment;
+	return allocation;
+}
+
+void CFrameAllocator::flush ()
+{
+	if (head > 0)
+	{
+		buffers[frameIndex]->flush(head, 0);
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Buffer.h"
+#include "Device.h"
+
+// std
+#include <memory>
+#include <vector>
+
+
+// Linear allocator for data that lives for one frame, with one persistently mapped buffer per frame in
+// flight. Allocations are aligned for dynamic uniform and storage buffer offsets, so systems bind them
+// with the offset of their allocation instead of owning buffers.
+class CFrameAllocator
+{
+public:
+	static constexpr VkDeviceSize DEFAULT_CAPACITY = 16 * 1024 * 1024;
+
+	struct Allocation
+	{
+		void *data = nullptr;
+		// dynamic offset of the allocation inside the buffer of the frame
+		uint32_t offset = 0;
+		VkDeviceSize size = 0;
+	};
+
+	// descriptors bound with a dynamic offset may cover up to maxBindingRange bytes past it, the buffers are
+	// padded by that much so any allocation can be bound with that range
+	CFrameAllocator (CDevice &device, uint32_t frameCount, VkDeviceSize maxBindingRange, VkDeviceSize capacity = DEFAULT_CAPACITY);
+
+	CFrameAllocator (const CFrameAllocator &) = delete;
+
+	CFrameAllocator &operator= (const CFrameAllocator &) = delete;
+
+	// frees everything allocated the last time this frame index was used, whose commands must have completed
+	void beginFrame (int frameIndex);
+
+	// throws when the frame runs out of space
+	Allocation allocate (VkDeviceSize size);
+
+	// flushes what this frame has written, called before its commands are submitted
+	void flush ();
+
+	// the buffer of the current frame, for commands that read allocations directly such as indirect draws
+	VkBuffer getBuffer () const
+	{
+		return buffers[frameIndex]->getBuffer();
+	}
+
+	VkDescriptorBufferInfo descriptorInfo (int frameIndex, VkDeviceSize range) const
+	{
+		return buffers[frameIndex]->descriptorInfo(range, 0);
+	}
+
+	VkDeviceSize getUsedSize () const
+	{
+		return head;
+	}
+
+private:
+	CDevice &Device;
+
+	std::vector<std::unique_ptr<CBuffer>> buffers;
+	VkDeviceSize capacity;
+	VkDeviceSize alignment;
+
+	int frameIndex = 0;
+	VkDeviceSize head = 0;
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+
+// Hands frames from a producer thread to a consumer thread in lockstep through two slots, so the producer fills
+// frame n + 1 while the consumer still reads frame n. Frames count from 1. Ownership of a slot passes through the
+// frame counters alone, the mutex is only taken to park a thread that ran out of spins.
+template<typename T>
+class CFrameExchange
+{
+public:
+	// the slot of frame once the consumer has released frame - 2, which used it before, null after stop
+	T *beginWrite (uint64_t frame)
+	{
+		return waitFor(readFrame, frame - std::min<uint64_t>(frame, 2)) ? &slots[frame % 2] : nullptr;
+	}
+
+	void endWrite (uint64_t frame)
+	{
+		publish(writtenFrame, frame);
+	}
+
+	// the slot of frame once the producer has written it, null after stop
+	T *beginRead (uint64_t frame)
+	{
+		return waitFor(writtenFrame, frame) ? &slots[frame % 2] : nullptr;
+	}
+
+	void endRead (uint64_t frame)
+	{
+		publish(readFrame, frame);
+	}
+
+	// fails every wait until reset, so either thread can leave its loop
+	void stop ()
+	{
+		stopped.store(true);
+		std::lock_guard<std::mutex> lock {mutex};
+		ready.notify_all();
+	}
+
+	// starts over at frame 1, only while neither thread uses the exchange
+	void reset ()
+	{
+		writtenFrame.store(0);
+		readFrame.store(0);
+		stopped.store(false);
+	}
+
+private:
+	// the other thread is usually almost done when a wait starts
+	static constexpr int SPIN_COUNT = 64;
+
+	bool waitFor (const std::atomic<uint64_t> &counter, uint64_t frame)
+	{
+		for (int i = 0; i < SPIN_COUNT; ++i)
+		{
+			if (stopped.load())
+			{
+				return false;
+			}
+			if (counter.load() >= frame)
+			{
+				return true;
+			}
+			std::this_thread::yield();
+		}
+
+		// publish stores the counter before it checks for waiters, and a waiter counts itself before checking the counter
+		std::unique_lock<std::mutex> lock {mutex};
+		waiting.fetch_add(1);
+		ready.wait(lock, [&] () { return stopped.load() || counter.load() >= frame; });
+		waiting.fetch_sub(1);
+		return !stopped.load();
+	}
+
+	void publish (std::atomic<uint64_t> &counter, uint64_t frame)
+	{
+		counter.store(frame);
+		if (waiting.load() > 0)
+		{
+			std::lock_guard<std::mutex> lock {mutex};
+			ready.notify_all();
+		}
+	}
+
+	T slots[2] {};
+	// last frame the producer has written and the consumer has released
+	std::atomic<uint64_t> writtenFrame {0};
+	std::atomic<uint64_t> readFrame {0};
+	std::atomic<bool> stopped {false};
+
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::atomic<uint32_t> waiting {0};
+};
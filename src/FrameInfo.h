@@ -2,16 +2,49 @@
 
 #include <vulkan/vulkan.h>
 #include "Camera.h"
+#include "Descriptors.h"
+#include "FrameAllocator.h"
 #include "GameObject.h"
 
+// lighting of simple_shader.frag, selected by its specialization constant LIGHTING_MODEL_CONSTANT_ID
+enum class LightingModel : uint32_t
+{
+	// ambient light only
+	Ambient = 0,
+	// ambient plus a diffuse and specular light at the camera
+	Headlight = 1,
+	// the shader's default, the unspecialized fallback reads the model from GlobalUbo::lightingModel so it lights
+	// like the variant that replaces it
+	Dynamic = 0xffffffff
+};
+
+static constexpr uint32_t LIGHTING_MODEL_CONSTANT_ID = 0;
+
+// lighting the render systems specialize their pipelines with unless the app picks another model, ambient only
+// like the shading before lighting models existed
+static constexpr LightingModel SCENE_LIGHTING_MODEL = LightingModel::Ambient;
+
 struct GlobalUbo
 {
 	glm::mat4 projection {1.f};
 	glm::mat4 view {1.f};
 	glm::mat4 inverseView {1.f};
 	glm::vec4 ambientLightColor {1.f, 1.f, 1.f, .2f};  // w is intensity
+	uint32_t lightingModel {static_cast<uint32_t>(SCENE_LIGHTING_MODEL)};
 };
 
+// per object shader data, an array of it per frame is indexed with the instance index
+struct ObjectData
+{
+	glm::mat4 modelMatrix {1.f};
+	glm::mat4 normalMatrix {1.f};
+	// rgb tints the vertex color, w is unused
+	glm::vec4 color {1.f};
+};
+
+// default range of the object data binding in objects
+static constexpr uint32_t MAX_FRAME_OBJECTS = 65536;
+
 struct FrameInfo
 {
 	int frameIndex;
@@ -20,4 +53,11 @@ struct FrameInfo
 	CCamera &camera;
 	VkDescriptorSet globalDescriptorSet;
 	CGameObject::Map &gameObjects;
+	CFrameAllocator &frameAllocator;
+	// reset at the start of the frame, for sets that are only used by its commands
+	CDescriptorAllocator &descriptorAllocator;
+	// dynamic offset of the GlobalUbo in the frame allocator
+	uint32_t globalUboOffset;
+	// range of the object data binding, the most objects a frame can draw
+	uint32_t maxObjects;
 };
@@ -3,6 +3,11 @@
 #include "KeyboardInput.h"
 #include "Buffer.h"
 #include "Camera.h"
+#include "ParallelCommandRecorder.h"
+#include "Utils.h"
+#include "VertexWelder.h"
+#include "systems/GpuCullingSystem.h"
+#include "systems/IndirectSystem.h"
 #include "systems/SimpleSystem.h"
 
 // libs
@@ -12,47 +17,128 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 
+#define GLM_ENABLE_EXPERIMENTAL
+
+#include <glm/gtx/hash.hpp>
+
 // std
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
 #include <stdexcept>
+#include <thread>
+#include <unordered_map>
 
+#ifndef ENGINE_DIR
+#define ENGINE_DIR "../"
+#endif
 
-CFirstApp::CFirstApp ()
+
+namespace
 {
-	globalPool = CDescriptorPool::CBuilder(Device).setMaxSets(CSwapChain::MAX_FRAMES_IN_FLIGHT).addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, CSwapChain::MAX_FRAMES_IN_FLIGHT).build();
+	// the vertex hash of the map CVertexWelder replaced, benchmarkVertexWelding compares against it
+	struct MapVertexHash
+	{
+		size_t operator() (const CModel::Vertex &vertex) const
+		{
+			size_t seed = 0;
+			hashCombine(seed, vertex.position, vertex.color, vertex.normal, vertex.uv);
+			return seed;
+		}
+	};
+}  // namespace
+
+CFirstApp::CFirstApp (uint32_t benchmarkObjectCount, LightingModel lightingModel)
+	: benchmarkObjectCount {benchmarkObjectCount}, lightingModel {lightingModel}
+{
+	const uint32_t bindableObjects = static_cast<uint32_t>(Device.properties.limits.maxStorageBufferRange / sizeof(ObjectData));
+	maxFrameObjects = std::min(std::max(MAX_FRAME_OBJECTS, benchmarkObjectCount + 1), bindableObjects);
+	viewerObject.transform.translation.z = -2.5f;
+
 	loadGameObjects();
+	loadBenchmarkObjects();
 }
 
 CFirstApp::~CFirstApp ()
 {
+	// the simulation thread uses the members
+	stopFramePipeline();
 }
 
 void CFirstApp::run ()
 {
-	std::vector<std::unique_ptr<CBuffer>> uboBuffers(CSwapChain::MAX_FRAMES_IN_FLIGHT);
-	for (int i = 0; i < uboBuffers.size(); i++)
+	// per frame data is bump allocated and bound with dynamic offsets into the buffer of the frame
+	const VkDeviceSize objectRange = sizeof(ObjectData) * maxFrameObjects;
+	// room for the object data and culling input of every object, the rest is for the ubo and the indirect commands
+	const VkDeviceSize drawDataRange = sizeof(CGpuCullingRenderSystem::DrawData) * maxFrameObjects;
+	CFrameAllocator frameAllocator {Device, CSwapChain::MAX_FRAMES_IN_FLIGHT, std::max(objectRange, drawDataRange), std::max(CFrameAllocator::DEFAULT_CAPACITY, objectRange + drawDataRange + 4 * 1024 * 1024)};
+
+	auto globalSetLayout = CDescriptorSetLayout::CBuilder(Device)
+		.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_ALL_GRAPHICS)
+		.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT)
+		.build();
+
+	// sets allocated during a frame are freed together once the frame index comes around again
+	std::vector<std::unique_ptr<CDescriptorAllocator>> frameDescriptorAllocators {};
+	for (int i = 0; i < CSwapChain::MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		uboBuffers[i] = std::make_unique<CBuffer>(Device, sizeof(GlobalUbo), 1, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-		uboBuffers[i]->map();
+		frameDescriptorAllocators.push_back(std::make_unique<CDescriptorAllocator>(Device));
 	}
 
-	auto globalSetLayout = CDescriptorSetLayout::CBuilder(Device).addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS).build();
+	CParallelCommandRecorder parallelRecorder {Device, WorkerPool, CSwapChain::MAX_FRAMES_IN_FLIGHT};
 
 	std::vector<VkDescriptorSet> globalDescriptorSets(CSwapChain::MAX_FRAMES_IN_FLIGHT);
 	for (int i = 0; i < globalDescriptorSets.size(); i++)
 	{
-		auto bufferInfo = uboBuffers[i]->descriptorInfo();
-		CDescriptorWriter(*globalSetLayout, *globalPool).writeBuffer(0, &bufferInfo).build(globalDescriptorSets[i]);
+		auto uboInfo = frameAllocator.descriptorInfo(i, sizeof(GlobalUbo));
+		auto objectInfo = frameAllocator.descriptorInfo(i, objectRange);
+		CDescriptorWriter(*globalSetLayout, GlobalDescriptorAllocator).writeBuffer(0, &uboInfo).writeBuffer(1, &objectInfo).build(globalDescriptorSets[i]);
 	}
 
-	CSimpleRenderSystem simpleRenderSystem {Device, Renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout()};
-	CCamera camera {};
+	// the render systems request their pipelines, which are created together once all systems exist
+	auto pipelineStart = std::chrono::high_resolution_clock::now();
+	CSimpleRenderSystem simpleRenderSystem {Device, GeometryPool, PipelineRegistry, Renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout(), lightingModel};
+	std::unique_ptr<CIndirectRenderSystem> indirectRenderSystem {};
+	if (CIndirectRenderSystem::isSupported(Device))
+	{
+		indirectRenderSystem = std::make_unique<CIndirectRenderSystem>(Device, GeometryPool, WorkerPool, PipelineRegistry, Renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout(), lightingModel);
+	}
+	std::unique_ptr<CGpuCullingRenderSystem> gpuCullingRenderSystem {};
+	if (CGpuCullingRenderSystem::isSupported(Device))
+	{
+		gpuCullingRenderSystem = std::make_unique<CGpuCullingRenderSystem>(Device, GeometryPool, WorkerPool, PipelineRegistry, frameAllocator, maxFrameObjects, Renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout(), lightingModel);
+	}
+	PipelineRegistry.compile();
+	const float pipelineTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - pipelineStart).count();
+	const CPipelineRegistry::Stats &pipelineStats = PipelineRegistry.getStats();
+	std::cout << "pipelines: " << pipelineStats.pipelineCount << " created for " << pipelineStats.requestCount << " requests in " << pipelineStats.batchCount << " batches, " << pipelineStats.shaderModuleCount << " shader modules, " << pipelineStats.pipelineLayoutCount << " layouts, " << pipelineStats.variantCount - pipelineStats.specializedCount << " variants compiling in the background, " << pipelineTime << " ms (" << pipelineStats.compileTime << " ms compiling) with a " << (Device.getPipelineCache().isWarm() ? "warm" : "cold") << " pipeline cache" << std::endl;
+	RenderMode renderMode = RenderMode::Direct;
+	bool renderModeKeyDown = false;
+	bool framePipelined = false;
+	bool framePipelineKeyDown = false;
+	// the frame rendered next while the frame pipeline runs
+	uint64_t pipelineFrame = 0;
 
-	auto viewerObject = CGameObject::createGameObject();
-	viewerObject.transform.translation.z = -2.5f;
-	CKeyboardMovementController cameraController {};
+	// per frame render stats, averaged and printed once a second
+	float statsTime = 0.f;
+	uint32_t statsFrames = 0;
+	float simulationTime = 0.f;
+	float renderTime = 0.f;
+	float recordTime = 0.f;
+	uint64_t drawCalls = 0;
+	uint64_t instances = 0;
+	uint64_t objectsDropped = 0;
+	uint64_t clustersTested = 0;
+	uint64_t clustersCulled = 0;
+	uint64_t gpuVisible = 0;
+	uint64_t gpuFrustumCulled = 0;
+	uint64_t gpuOcclusionCulled = 0;
 
 	auto currentTime = std::chrono::high_resolution_clock::now();
 	while (!Window.shouldClose())
@@ -63,47 +149,682 @@ void CFirstApp::run ()
 		float frameTime = std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
 		currentTime = newTime;
 
-		cameraController.moveInPlaneXZ(Window.getGLFWwindow(), frameTime, viewerObject);
-		camera.setViewYXZ(viewerObject.transform.translation, viewerObject.transform.rotation);
+		// the cpu side of the frame as a task graph, input stays on this thread as GLFW requires, streaming runs
+		// alongside it on a worker
+		FrameInput input {};
+		auto inputTask = WorkerPool.schedule([&] ()
+		{
+			const bool renderModeKeyPressed = glfwGetKey(Window.getGLFWwindow(), RENDER_MODE_KEY) == GLFW_PRESS;
+			if (renderModeKeyPressed && !renderModeKeyDown)
+			{
+				if (renderMode == RenderMode::Direct)
+				{
+					renderMode = RenderMode::ParallelDirect;
+				}
+				else if (renderMode == RenderMode::ParallelDirect && indirectRenderSystem != nullptr)
+				{
+					renderMode = RenderMode::Indirect;
+				}
+				else if (renderMode == RenderMode::Indirect && gpuCullingRenderSystem != nullptr)
+				{
+					renderMode = RenderMode::GpuCulling;
+				}
+				else
+				{
+					if (indirectRenderSystem == nullptr)
+					{
+						std::cout << "indirect rendering needs drawIndirectFirstInstance, skipping it" << std::endl;
+					}
+					renderMode = RenderMode::Direct;
+				}
+				const char *renderModeNames[] = {"direct", "parallel direct", "indirect", "gpu culling"};
+				std::cout << "render mode: " << renderModeNames[static_cast<int>(renderMode)] << std::endl;
+			}
+			renderModeKeyDown = renderModeKeyPressed;
+
+			input.movement = cameraController.sampleInput(Window.getGLFWwindow());
+			input.frameTime = frameTime;
+			input.aspectRatio = Renderer.getAspectRatio();
+		}, {}, CWorkerPool::Affinity::MainThread);
 
-		float aspect = Renderer.getAspectRatio();
-		camera.setPerspectiveProjection(glm::radians(50.f), aspect, 0.1f, 100.f);
+		// uploads are submitted ahead of the frame, which is then ordered after them on the queue
+		auto streamingTask = WorkerPool.schedule([&] ()
+		{
+			ModelLoader.uploadReady();
+			UploadManager.submit();
+			// specialized pipelines replace their fallbacks between frames
+			PipelineRegistry.update();
+		});
+
+		// the simulation uses this frame's input right away, or on the simulation thread for the next frame
+		FrameSnapshot *snapshot = nullptr;
+		if (framePipelined)
+		{
+			WorkerPool.wait({inputTask, streamingTask});
+			*inputExchange.beginWrite(pipelineFrame + 1) = input;
+			inputExchange.endWrite(pipelineFrame + 1);
 
+			snapshot = snapshotExchange.beginRead(pipelineFrame);
+			simulationTime += snapshot->simulationTime;
+		}
+		else
+		{
+			auto simulationTask = WorkerPool.schedule([&] ()
+			{
+				auto simulationStart = std::chrono::high_resolution_clock::now();
+				simulate(input);
+				simulationTime += std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - simulationStart).count();
+			}, {inputTask});
+			WorkerPool.wait({simulationTask, streamingTask});
+		}
+		CCamera &frameCamera = snapshot != nullptr ? snapshot->camera : camera;
+		CGameObject::Map &frameObjects = snapshot != nullptr ? snapshot->gameObjects : gameObjects;
+
+		auto renderStart = std::chrono::high_resolution_clock::now();
 		if (auto commandBuffer = Renderer.beginFrame())
 		{
 			int frameIndex = Renderer.getFrameIndex();
-			FrameInfo frameInfo {frameIndex, frameTime, commandBuffer, camera, globalDescriptorSets[frameIndex], gameObjects};
+			frameAllocator.beginFrame(frameIndex);
+			parallelRecorder.beginFrame(frameIndex);
+			GeometryPool.beginFrame();
+			frameDescriptorAllocators[frameIndex]->resetPools();
 
 			// update
 			GlobalUbo ubo {};
-			ubo.projection = camera.getProjection();
-			ubo.view = camera.getView();
-			ubo.inverseView = camera.getInverseView();
-			uboBuffers[frameIndex]->writeToBuffer(&ubo);
-			uboBuffers[frameIndex]->flush();
+			ubo.projection = frameCamera.getProjection();
+			ubo.view = frameCamera.getView();
+			ubo.inverseView = frameCamera.getInverseView();
+			ubo.lightingModel = static_cast<uint32_t>(lightingModel);
+			CFrameAllocator::Allocation uboAllocation = frameAllocator.allocate(sizeof(GlobalUbo));
+			memcpy(uboAllocation.data, &ubo, sizeof(GlobalUbo));
+
+			FrameInfo frameInfo {frameIndex, frameTime, commandBuffer, frameCamera, globalDescriptorSets[frameIndex], frameObjects, frameAllocator, *frameDescriptorAllocators[frameIndex], uboAllocation.offset, maxFrameObjects};
 
 			// render
-			Renderer.beginSwapChainRenderPass(commandBuffer);
+			auto recordStart = std::chrono::high_resolution_clock::now();
+			if (renderMode == RenderMode::GpuCulling)
+			{
+				gpuCullingRenderSystem->cull(frameInfo, Renderer.getSwapChainExtent());
+			}
+			Renderer.beginSwapChainRenderPass(commandBuffer, renderMode == RenderMode::ParallelDirect ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
 
 			// order here matters
-			simpleRenderSystem.renderGameObjects(frameInfo);
+			if (renderMode == RenderMode::ParallelDirect)
+			{
+				const CParallelCommandRecorder::Inheritance inheritance {Renderer.getSwapChainRenderPass(), 0, Renderer.getCurrentFrameBuffer(), Renderer.getSwapChainExtent()};
+				simpleRenderSystem.renderGameObjects(frameInfo, parallelRecorder, inheritance);
+			}
+			else if (renderMode == RenderMode::GpuCulling)
+			{
+				gpuCullingRenderSystem->render(frameInfo);
+			}
+			else if (renderMode == RenderMode::Indirect)
+			{
+				indirectRenderSystem->renderGameObjects(frameInfo);
+			}
+			else
+			{
+				simpleRenderSystem.renderGameObjects(frameInfo);
+			}
 
 			Renderer.endSwapChainRenderPass(commandBuffer);
+			if (renderMode == RenderMode::GpuCulling)
+			{
+				gpuCullingRenderSystem->buildDepthPyramid(frameInfo, Renderer.getCurrentDepthImage(), Renderer.getCurrentDepthImageView(), Renderer.getDepthFormat());
+			}
+			recordTime += std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - recordStart).count();
+			frameAllocator.flush();
 			Renderer.endFrame();
+
+			if (renderMode == RenderMode::GpuCulling)
+			{
+				const CGpuCullingRenderSystem::CullStats &cullStats = gpuCullingRenderSystem->getCullStats();
+				drawCalls += gpuCullingRenderSystem->getRenderStats().drawCalls;
+				objectsDropped += gpuCullingRenderSystem->getRenderStats().objectsDropped;
+				instances += cullStats.visible;
+				gpuVisible += cullStats.visible;
+				gpuFrustumCulled += cullStats.frustumCulled;
+				gpuOcclusionCulled += cullStats.occlusionCulled;
+			}
+			else if (renderMode == RenderMode::Indirect)
+			{
+				const CIndirectRenderSystem::RenderStats &renderStats = indirectRenderSystem->getRenderStats();
+				drawCalls += renderStats.drawCalls;
+				instances += renderStats.instances;
+				objectsDropped += renderStats.objectsDropped;
+			}
+			else
+			{
+				const CSimpleRenderSystem::RenderStats &renderStats = simpleRenderSystem.getRenderStats();
+				drawCalls += renderStats.drawCalls;
+				instances += renderStats.instances;
+				objectsDropped += renderStats.objectsDropped;
+				clustersTested += renderStats.clustersTested;
+				clustersCulled += renderStats.clustersCulled;
+			}
+			++statsFrames;
+		}
+		renderTime += std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - renderStart).count();
+		if (snapshot != nullptr)
+		{
+			snapshotExchange.endRead(pipelineFrame);
+			++pipelineFrame;
+		}
+
+		// switched between frames, while no snapshot is in use
+		const bool framePipelineKeyPressed = glfwGetKey(Window.getGLFWwindow(), FRAME_PIPELINE_KEY) == GLFW_PRESS;
+		if (framePipelineKeyPressed && !framePipelineKeyDown)
+		{
+			framePipelined = !framePipelined;
+			if (framePipelined)
+			{
+				startFramePipeline(input);
+				pipelineFrame = 1;
+			}
+			else
+			{
+				stopFramePipeline();
+			}
+			std::cout << "frame pipelining: " << (framePipelined ? "on" : "off") << std::endl;
+		}
+		framePipelineKeyDown = framePipelineKeyPressed;
+
+		statsTime += frameTime;
+		if (statsTime >= 1.f && statsFrames > 0)
+		{
+			// pipelined frames take about the longer of simulation and render, serial ones about their sum
+			std::cout << "frame stats: " << (framePipelined ? "pipelined" : "serial") << " frame " << statsTime * 1000.f / statsFrames << " ms, simulation " << simulationTime / statsFrames << " ms, render " << renderTime / statsFrames << " ms, record " << recordTime / statsFrames << " ms, draw calls " << drawCalls / statsFrames << ", instances " << instances / statsFrames << ", dropped " << objectsDropped / statsFrames << ", clusters tested " << clustersTested / statsFrames << ", culled " << clustersCulled / statsFrames << std::endl;
+			if (renderMode == RenderMode::GpuCulling)
+			{
+				std::cout << "gpu culling: visible " << gpuVisible / statsFrames << ", frustum culled " << gpuFrustumCulled / statsFrames << ", occlusion culled " << gpuOcclusionCulled / statsFrames << std::endl;
+			}
+			statsTime = 0.f;
+			statsFrames = 0;
+			simulationTime = 0.f;
+			renderTime = 0.f;
+			recordTime = 0.f;
+			drawCalls = 0;
+			instances = 0;
+			objectsDropped = 0;
+			clustersTested = 0;
+			clustersCulled = 0;
+			gpuVisible = 0;
+			gpuFrustumCulled = 0;
+			gpuOcclusionCulled = 0;
+		}
+	}
+
+	stopFramePipeline();
+	vkDeviceWaitIdle(Device.GetDevice());
+	Device.getMemoryAllocator().printStats();
+}
+
+void CFirstApp::benchmarkDescriptorUpdates (uint32_t updateCount)
+{
+	auto setLayout = CDescriptorSetLayout::CBuilder(Device)
+		.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS)
+		.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+		.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+		.addBinding(3, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+		.build();
+
+	const VkDeviceSize alignment = std::max(Device.properties.limits.minUniformBufferOffsetAlignment, Device.properties.limits.minStorageBufferOffsetAlignment);
+	CBuffer buffer {Device, 256, 4, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, alignment};
+	VkDescriptorBufferInfo descriptors[4];
+	for (int i = 0; i < 4; i++)
+	{
+		descriptors[i] = buffer.descriptorInfoForIndex(i);
+	}
+
+	// updates rotate through a few sets, none of which is used by the queue
+	CDescriptorAllocator allocator {Device};
+	std::array<VkDescriptorSet, 64> sets {};
+	for (auto &set: sets)
+	{
+		if (!allocator.allocateDescriptor(setLayout->getDescriptorSetLayout(), set))
+		{
+			throw std::runtime_error("failed to allocate benchmark descriptor set!");
 		}
 	}
 
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < updateCount; i++)
+	{
+		CDescriptorWriter(*setLayout, allocator).writeBuffer(0, &descriptors[0]).writeBuffer(1, &descriptors[1]).writeBuffer(2, &descriptors[2]).writeBuffer(3, &descriptors[3]).overwrite(sets[i % sets.size()]);
+	}
+	const float writerTime = std::chrono::duration<float, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+	start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 0; i < updateCount; i++)
+	{
+		setLayout->update(sets[i % sets.size()], descriptors);
+	}
+	const float templateTime = std::chrono::duration<float, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+	std::cout << "descriptor updates: writer " << updateCount / writerTime << "/s, template " << updateCount / templateTime << "/s" << (Device.updateDescriptorSetWithTemplate == nullptr ? " (no update templates, packed writes)" : "") << std::endl;
+}
+
+void CFirstApp::benchmarkRecording ()
+{
+	const uint32_t objectCounts[] = {10000, 100000, 1000000};
+	const uint32_t bindableObjects = static_cast<uint32_t>(Device.properties.limits.maxStorageBufferRange / sizeof(ObjectData));
+	const uint32_t maxObjects = std::min(objectCounts[2], bindableObjects);
+	const VkDeviceSize objectRange = sizeof(ObjectData) * maxObjects;
+	CFrameAllocator frameAllocator {Device, CSwapChain::MAX_FRAMES_IN_FLIGHT, objectRange, objectRange + CFrameAllocator::DEFAULT_CAPACITY};
+
+	auto globalSetLayout = CDescriptorSetLayout::CBuilder(Device)
+		.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_ALL_GRAPHICS)
+		.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT)
+		.build();
+
+	std::vector<std::unique_ptr<CDescriptorAllocator>> frameDescriptorAllocators {};
+	std::vector<VkDescriptorSet> globalDescriptorSets(CSwapChain::MAX_FRAMES_IN_FLIGHT);
+	for (int i = 0; i < globalDescriptorSets.size(); i++)
+	{
+		frameDescriptorAllocators.push_back(std::make_unique<CDescriptorAllocator>(Device));
+		auto uboInfo = frameAllocator.descriptorInfo(i, sizeof(GlobalUbo));
+		auto objectInfo = frameAllocator.descriptorInfo(i, objectRange);
+		CDescriptorWriter(*globalSetLayout, GlobalDescriptorAllocator).writeBuffer(0, &uboInfo).writeBuffer(1, &objectInfo).build(globalDescriptorSets[i]);
+	}
+
+	CSimpleRenderSystem simpleRenderSystem {Device, GeometryPool, PipelineRegistry, Renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout()};
+	std::unique_ptr<CIndirectRenderSystem> indirectRenderSystem {};
+	if (CIndirectRenderSystem::isSupported(Device))
+	{
+		indirectRenderSystem = std::make_unique<CIndirectRenderSystem>(Device, GeometryPool, WorkerPool, PipelineRegistry, Renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout());
+	}
+	PipelineRegistry.compile();
+
+	// every grid shares the quad, which has to be resident before anything is recorded
+	CModelLoader::ModelFuture modelFuture = ModelLoader.loadAsync("models/quad.obj", CModel::VertexLayout::Packed);
+	do
+	{
+		ModelLoader.uploadReady();
+	}
+	while (modelFuture.wait_for(std::chrono::milliseconds {1}) != std::future_status::ready);
+	UploadManager.submit();
+	std::shared_ptr<CModel> model = modelFuture.get();
+
+	for (uint32_t objectCount: objectCounts)
+	{
+		CGameObject::Map objects {};
+		addTileGrid(objectCount, objects);
+		for (auto &kv: objects)
+		{
+			kv.second.model = model;
+		}
+
+		// looks straight down on the whole grid, so next to nothing is culled
+		const float extent = std::ceil(std::sqrt(static_cast<float>(objectCount))) * TILE_SPACING * 0.5f;
+		CCamera benchmarkCamera {};
+		benchmarkCamera.setViewTarget({0.f, -2.5f * extent, 0.f}, {0.f, 0.f, 0.f}, {0.f, 0.f, 1.f});
+		benchmarkCamera.setPerspectiveProjection(glm::radians(50.f), Renderer.getAspectRatio(), 0.1f, 5.f * extent);
+
+		// average time of the render call alone, frames the swap chain skips are not counted
+		auto timeRecording = [&] (const std::function<void (FrameInfo &)> &render)
+		{
+			float recordTime = 0.f;
+			int recordedFrames = 0;
+			while (recordedFrames < RECORD_BENCHMARK_FRAMES && !Window.shouldClose())
+			{
+				glfwPollEvents();
+				auto commandBuffer = Renderer.beginFrame();
+				if (commandBuffer == nullptr)
+				{
+					continue;
+				}
+
+				int frameIndex = Renderer.getFrameIndex();
+				frameAllocator.beginFrame(frameIndex);
+				GeometryPool.beginFrame();
+				frameDescriptorAllocators[frameIndex]->resetPools();
+
+				GlobalUbo ubo {};
+				ubo.projection = benchmarkCamera.getProjection();
+				ubo.view = benchmarkCamera.getView();
+				ubo.inverseView = benchmarkCamera.getInverseView();
+				CFrameAllocator::Allocation uboAllocation = frameAllocator.allocate(sizeof(GlobalUbo));
+				memcpy(uboAllocation.data, &ubo, sizeof(GlobalUbo));
+
+				FrameInfo frameInfo {frameIndex, 0.f, commandBuffer, benchmarkCamera, globalDescriptorSets[frameIndex], objects, frameAllocator, *frameDescriptorAllocators[frameIndex], uboAllocation.offset, maxObjects};
+				Renderer.beginSwapChainRenderPass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+				auto recordStart = std::chrono::high_resolution_clock::now();
+				render(frameInfo);
+				recordTime += std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - recordStart).count();
+				Renderer.endSwapChainRenderPass(commandBuffer);
+				frameAllocator.flush();
+				Renderer.endFrame();
+				++recordedFrames;
+			}
+			return recordedFrames > 0 ? recordTime / recordedFrames : 0.f;
+		};
+
+		const float simpleTime = timeRecording([&] (FrameInfo &frameInfo) { simpleRenderSystem.renderGameObjects(frameInfo); });
+		const CSimpleRenderSystem::RenderStats &simpleStats = simpleRenderSystem.getRenderStats();
+		std::cout << "record benchmark: " << objectCount << " objects";
+		std::cout << ", simple " << simpleTime << " ms (" << simpleStats.drawCalls << " draw calls, " << simpleStats.instances << " instances, " << simpleStats.objectsDropped << " dropped)";
+		if (indirectRenderSystem != nullptr)
+		{
+			const float indirectTime = timeRecording([&] (FrameInfo &frameInfo) { indirectRenderSystem->renderGameObjects(frameInfo); });
+			const CIndirectRenderSystem::RenderStats &indirectStats = indirectRenderSystem->getRenderStats();
+			std::cout << ", indirect " << indirectTime << " ms (" << indirectStats.drawCalls << " draw calls, " << indirectStats.instances << " instances, " << indirectStats.objectsDropped << " dropped), speedup " << simpleTime / indirectTime;
+		}
+		else
+		{
+			std::cout << ", indirect rendering needs drawIndirectFirstInstance, skipping it";
+		}
+		std::cout << std::endl;
+	}
+
 	vkDeviceWaitIdle(Device.GetDevice());
 }
 
+void CFirstApp::benchmarkWorkerPool (uint32_t taskCount)
+{
+	const uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<float> results(taskCount);
+	float baseTime = 0.f;
+
+	for (uint32_t threadCount = 1;; threadCount = std::min(threadCount * 2, maxThreads))
+	{
+		CWorkerPool pool {threadCount};
+		std::vector<CWorkerPool::Task> tasks(taskCount);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (auto &task: tasks)
+		{
+			task = pool.schedule([] () {});
+		}
+		pool.wait(tasks);
+		const float taskTime = std::chrono::duration<float, std::chrono::nanoseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+		// every task waits for the one before, so this is the latency of handing a dependency on
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < taskCount; i++)
+		{
+			tasks[i] = i == 0 ? pool.schedule([] () {}) : pool.schedule([] () {}, {tasks[i - 1]});
+		}
+		pool.wait(tasks.back());
+		const float chainTime = std::chrono::duration<float, std::chrono::nanoseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+		// items of a few microseconds, about what transforming and culling a handful of objects costs
+		start = std::chrono::high_resolution_clock::now();
+		pool.parallelFor(taskCount, 64, [&] (size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				float value = static_cast<float>(i);
+				for (int j = 0; j < 1000; j++)
+				{
+					value = std::sin(value) + 1.f;
+				}
+				results[i] = value;
+			}
+		});
+		const float forTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+		if (threadCount == 1)
+		{
+			baseTime = forTime;
+		}
+
+		std::cout << "worker pool " << threadCount << " threads: task " << taskTime / taskCount << " ns, dependency " << chainTime / taskCount << " ns, parallel for " << forTime << " ms, speedup " << baseTime / forTime << std::endl;
+		if (threadCount == maxThreads)
+		{
+			break;
+		}
+	}
+}
+
+void CFirstApp::benchmarkVertexWelding (uint32_t cornerCount)
+{
+	// a wavy grid in the corner order of an obj import, six corners per quad, so every inner vertex is shared by six
+	const uint32_t side = std::max(1u, static_cast<uint32_t>(std::sqrt(cornerCount / 6.f)));
+	auto gridVertex = [side] (uint32_t x, uint32_t z)
+	{
+		const float u = static_cast<float>(x) / side;
+		const float v = static_cast<float>(z) / side;
+		CModel::Vertex vertex {};
+		vertex.position = {u, 0.1f * std::sin(u * 7.f) * std::cos(v * 5.f), v};
+		vertex.color = {1.f, 1.f, 1.f};
+		vertex.normal = glm::normalize(glm::vec3 {-0.7f * std::cos(u * 7.f) * std::cos(v * 5.f), 1.f, 0.5f * std::sin(u * 7.f) * std::sin(v * 5.f)});
+		vertex.uv = {u, v};
+		return vertex;
+	};
+
+	std::vector<CModel::Vertex> corners {};
+	corners.reserve(size_t(side) * side * 6);
+	for (uint32_t z = 0; z < side; ++z)
+	{
+		for (uint32_t x = 0; x < side; ++x)
+		{
+			corners.insert(corners.end(), {gridVertex(x, z), gridVertex(x + 1, z), gridVertex(x + 1, z + 1), gridVertex(x, z), gridVertex(x + 1, z + 1), gridVertex(x, z + 1)});
+		}
+	}
+
+	// a count and an operator[] lookup per corner, as the import did before
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<CModel::Vertex> mapVertices {};
+	std::vector<uint32_t> mapIndices {};
+	mapIndices.reserve(corners.size());
+	std::unordered_map<CModel::Vertex, uint32_t, MapVertexHash> uniqueVertices {};
+	for (const CModel::Vertex &vertex: corners)
+	{
+		if (uniqueVertices.count(vertex) == 0)
+		{
+			uniqueVertices[vertex] = static_cast<uint32_t>(mapVertices.size());
+			mapVertices.push_back(vertex);
+		}
+		mapIndices.push_back(uniqueVertices[vertex]);
+	}
+	const float mapTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+	// the weld grid step is well below the mesh spacing, so it welds the same vertices as an exact match
+	bool identical = true;
+	float welderTimes[2] {};
+	const float gridSteps[2] = {0.f, 1e-5f};
+	for (int mode = 0; mode < 2; ++mode)
+	{
+		start = std::chrono::high_resolution_clock::now();
+		std::vector<CModel::Vertex> vertices {};
+		std::vector<uint32_t> indices {};
+		indices.reserve(corners.size());
+		CVertexWelder welder {vertices, corners.size(), gridSteps[mode]};
+		for (const CModel::Vertex &vertex: corners)
+		{
+			indices.push_back(welder.weld(vertex));
+		}
+		welderTimes[mode] = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+		identical = identical && vertices == mapVertices && indices == mapIndices;
+	}
+
+	std::cout << "vertex welding: " << corners.size() << " corners, " << mapVertices.size() << " vertices, map " << mapTime << " ms, welder " << welderTimes[0] << " ms (speedup " << mapTime / welderTimes[0] << "), grid welder " << welderTimes[1] << " ms (speedup " << mapTime / welderTimes[1] << "), output " << (identical ? "identical" : "differs") << std::endl;
+}
+
+void CFirstApp::benchmarkMeshCache (const std::string &filepath)
+{
+	CWorkerPool workerPool {};
+	std::remove((ENGINE_DIR + filepath + ".meshcache").c_str());
+
+	CModel::ImportSettings gridSettings {};
+	gridSettings.weldGridStep = 1e-4f;
+	CModelLoader::importMesh(filepath, workerPool, gridSettings);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::unique_ptr<CImportedMesh> coldMesh = CModelLoader::importMesh(filepath, workerPool);
+	const float coldTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+	const uint32_t indexCount = coldMesh->getMeshData().indexCount;
+	if (coldMesh->isFromCache())
+	{
+		std::cerr << "mesh cache: " << filepath << " was loaded from a cache written with other import settings" << std::endl;
+	}
+	coldMesh.reset();
+
+	start = std::chrono::high_resolution_clock::now();
+	std::unique_ptr<CImportedMesh> warmMesh = CModelLoader::importMesh(filepath, workerPool);
+	const float warmTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (!warmMesh->isFromCache() || warmMesh->getMeshData().indexCount != indexCount)
+	{
+		std::cerr << "mesh cache: " << filepath << " was not loaded back from the cache" << std::endl;
+	}
+	std::cout << "mesh cache: " << filepath << ", " << indexCount << " indices, cold " << coldTime << " ms, warm " << warmTime << " ms, speedup " << coldTime / warmTime << std::endl;
+}
+
+bool CFirstApp::compareObjLoaders (const std::string &filepath)
+{
+	CWorkerPool workerPool {};
+
+	auto start = std::chrono::high_resolution_clock::now();
+	CModel::Builder parallel {};
+	parallel.loadModel(ENGINE_DIR + filepath, workerPool);
+	const float parallelTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+	start = std::chrono::high_resolution_clock::now();
+	CModel::Builder serial {};
+	serial.loadModelSerial(ENGINE_DIR + filepath);
+	const float serialTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+	std::cout << "obj loaders: " << filepath << ", parallel " << parallel.vertices.size() << " vertices, " << parallel.indices.size() << " indices in " << parallelTime << " ms, serial " << serial.vertices.size() << " vertices, " << serial.indices.size() << " indices in " << serialTime << " ms";
+
+	auto vertexMismatch = std::mismatch(parallel.vertices.begin(), parallel.vertices.end(), serial.vertices.begin(), serial.vertices.end());
+	auto indexMismatch = std::mismatch(parallel.indices.begin(), parallel.indices.end(), serial.indices.begin(), serial.indices.end());
+	const bool identical = vertexMismatch.first == parallel.vertices.end() && vertexMismatch.second == serial.vertices.end() && indexMismatch.first == parallel.indices.end() && indexMismatch.second == serial.indices.end();
+	if (identical)
+	{
+		std::cout << ", output identical" << std::endl;
+		return true;
+	}
+
+	std::cout << ", output differs at vertex " << vertexMismatch.first - parallel.vertices.begin() << " and index " << indexMismatch.first - parallel.indices.begin() << std::endl;
+	return false;
+}
+
 void CFirstApp::loadGameObjects ()
 {
-	std::shared_ptr<CModel> Model = CModel::createModelFromFile(Device, "models/quad.obj");
 	auto floor = CGameObject::createGameObject();
-	floor.model = Model;
 	floor.transform.translation = {0.f, .5f, 0.f};
 	floor.transform.scale = {3.f, 1.f, 3.f};
+	pendingModels.push_back({ModelLoader.loadAsync("models/quad.obj", CModel::VertexLayout::Packed), {floor.getId()}});
 	gameObjects.emplace(floor.getId(), std::move(floor));
 }
 
+void CFirstApp::loadBenchmarkObjects ()
+{
+	if (benchmarkObjectCount == 0)
+	{
+		return;
+	}
+
+	// all sharing one model
+	std::vector<CGameObject::id_t> ids = addTileGrid(benchmarkObjectCount, gameObjects);
+	pendingModels.push_back({ModelLoader.loadAsync("models/quad.obj", CModel::VertexLayout::Packed), std::move(ids)});
+	std::cout << "benchmark scene: " << benchmarkObjectCount << " objects" << std::endl;
+}
+
+std::vector<CGameObject::id_t> CFirstApp::addTileGrid (uint32_t count, CGameObject::Map &objects)
+{
+	const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(count))));
+	std::vector<CGameObject::id_t> ids {};
+	ids.reserve(count);
+	objects.reserve(objects.size() + count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		auto tile = CGameObject::createGameObject();
+		tile.transform.translation = {(static_cast<float>(i % side) - side * 0.5f) * TILE_SPACING, 0.f, (static_cast<float>(i / side) - side * 0.5f) * TILE_SPACING};
+		tile.transform.scale = {TILE_SPACING * 0.4f, 1.f, TILE_SPACING * 0.4f};
+		tile.color = {static_cast<float>(i % 7) / 6.f, static_cast<float>(i % 5) / 4.f, 1.f};
+		ids.push_back(tile.getId());
+		objects.emplace(tile.getId(), std::move(tile));
+	}
+	return ids;
+}
+
+void CFirstApp::simulate (const FrameInput &input)
+{
+	resolvePendingModels();
+
+	cameraController.moveInPlaneXZ(input.movement, input.frameTime, viewerObject);
+	camera.setViewYXZ(viewerObject.transform.translation, viewerObject.transform.rotation);
+	camera.setPerspectiveProjection(glm::radians(50.f), input.aspectRatio, 0.1f, 100.f);
+}
+
+void CFirstApp::startFramePipeline (const FrameInput &input)
+{
+	inputExchange.reset();
+	snapshotExchange.reset();
+
+	// the first frame only takes a snapshot, the input of this frame has been simulated already
+	FrameInput firstInput = input;
+	firstInput.frameTime = 0.f;
+	*inputExchange.beginWrite(1) = firstInput;
+	inputExchange.endWrite(1);
+
+	simulationThread = std::thread {&CFirstApp::runSimulation, this};
+}
+
+void CFirstApp::stopFramePipeline ()
+{
+	if (!simulationThread.joinable())
+	{
+		return;
+	}
+
+	inputExchange.stop();
+	snapshotExchange.stop();
+	simulationThread.join();
+}
+
+void CFirstApp::runSimulation ()
+{
+	for (uint64_t frame = 1;; ++frame)
+	{
+		FrameInput *input = inputExchange.beginRead(frame);
+		if (input == nullptr)
+		{
+			return;
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		simulate(*input);
+		inputExchange.endRead(frame);
+
+		FrameSnapshot *snapshot = snapshotExchange.beginWrite(frame);
+		if (snapshot == nullptr)
+		{
+			return;
+		}
+		// assignment reuses the snapshot's nodes, the map keeps its size from frame to frame
+		snapshot->camera = camera;
+		snapshot->gameObjects = gameObjects;
+		snapshot->simulationTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+		snapshotExchange.endWrite(frame);
+	}
+}
+
+void CFirstApp::resolvePendingModels ()
+{
+	for (auto it = pendingModels.begin(); it != pendingModels.end();)
+	{
+		if (it->first.wait_for(std::chrono::seconds {0}) != std::future_status::ready)
+		{
+			++it;
+			continue;
+		}
+
+		try
+		{
+			std::shared_ptr<CModel> model = it->first.get();
+			for (CGameObject::id_t id: it->second)
+			{
+				gameObjects.at(id).model = model;
+			}
+		}
+		catch (const std::exception &exception)
+		{
+			std::cout << exception.what() << std::endl;
+		}
+		it = pendingModels.erase(it);
+	}
+}
+
 
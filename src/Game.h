@@ -1,13 +1,22 @@
 #pragma once
 
+#include "Camera.h"
 #include "Descriptors.h"
 #include "Device.h"
+#include "FrameExchange.h"
+#include "FrameInfo.h"
 #include "GameObject.h"
+#include "KeyboardInput.h"
+#include "ModelLoader.h"
+#include "PipelineRegistry.h"
 #include "Renderer.h"
 #include "Window.h"
+#include "WorkerPool.h"
 
 
 #include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 
 
@@ -17,21 +26,128 @@ public:
 	static constexpr int WIDTH = 800;
 	static constexpr int HEIGHT = 600;
 
-	CFirstApp ();
+	// benchmarkObjectCount adds a grid of that many objects sharing one model, for comparing the render modes,
+	// lightingModel is what the render systems specialize the scene's pipelines with
+	explicit CFirstApp (uint32_t benchmarkObjectCount = 0, LightingModel lightingModel = SCENE_LIGHTING_MODEL);
 
 	~CFirstApp ();
 
 	void run ();
 
+	// times updateCount rewrites of a four buffer set through CDescriptorWriter and through the layout's update
+	// template, and prints the updates per second of both
+	void benchmarkDescriptorUpdates (uint32_t updateCount);
+
+	// records grids of 10k, 100k and 1M objects sharing one model with the simple and the indirect render system,
+	// and prints the average cpu time each takes to record a frame, the instances it drew and the visible objects it
+	// dropped past what maxStorageBufferRange lets the object binding hold
+	void benchmarkRecording ();
+
+	// times taskCount empty tasks, a chain of taskCount dependent tasks and a parallelFor over taskCount items on
+	// pools of one up to one thread per hardware thread, and prints the scheduling overhead and the scaling
+	static void benchmarkWorkerPool (uint32_t taskCount);
+
+	// welds a generated grid mesh of about cornerCount corners with CVertexWelder in exact and grid mode and with
+	// the unordered_map it replaced, prints the times and checks that all three produce the same vertices and indices
+	static void benchmarkVertexWelding (uint32_t cornerCount);
+
+	// deletes the mesh cache of filepath, relative to the engine directory, and fills it with an import welded on a
+	// grid, which the default import must not use, then times a cold import that parses the source and writes the
+	// cache and a warm one that maps it, and prints both and the speedup
+	static void benchmarkMeshCache (const std::string &filepath);
+
+	// loads filepath, relative to the engine directory, with Builder::loadModel and Builder::loadModelSerial,
+	// prints both times and where their vertices and indices first differ, returns whether they match
+	static bool compareObjLoaders (const std::string &filepath);
+
 private:
+	enum class RenderMode
+	{
+		Direct,
+		// the direct draws recorded into secondary command buffers on the worker threads
+		ParallelDirect,
+		Indirect,
+		GpuCulling
+	};
+
+	// what the simulation of a frame needs from the main thread
+	struct FrameInput
+	{
+		CKeyboardMovementController::Input movement {};
+		float frameTime = 0.f;
+		float aspectRatio = 1.f;
+	};
+
+	// the game state a frame renders, copied from the simulation so it can advance while the copy is recorded
+	struct FrameSnapshot
+	{
+		CCamera camera {};
+		CGameObject::Map gameObjects;
+		// of the simulation step and the copy, in milliseconds
+		float simulationTime = 0.f;
+	};
+
+	// cycles through the supported render systems, held down it only switches once
+	static constexpr int RENDER_MODE_KEY = GLFW_KEY_TAB;
+	// switches between simulating and rendering each frame in turn and the pipelined loop
+	static constexpr int FRAME_PIPELINE_KEY = GLFW_KEY_P;
+	// distance between the tiles of the benchmark grids
+	static constexpr float TILE_SPACING = 0.25f;
+	// frames recorded per render system and grid by benchmarkRecording
+	static constexpr int RECORD_BENCHMARK_FRAMES = 16;
+
 	void loadGameObjects ();
 
+	void loadBenchmarkObjects ();
+
+	// adds a square grid of count small tiles above the floor and returns their ids
+	static std::vector<CGameObject::id_t> addTileGrid (uint32_t count, CGameObject::Map &objects);
+
+	// hands models that became resident to the objects waiting for them
+	void resolvePendingModels ();
+
+	// advances the game state by one frame
+	void simulate (const FrameInput &input);
+
+	// starts the simulation thread, which then simulates frame n + 1 while the main thread renders frame n
+	void startFramePipeline (const FrameInput &input);
+
+	void stopFramePipeline ();
+
+	// the simulation thread, simulates frames from the exchanged inputs until the exchanges stop
+	void runSimulation ();
+
 	CWindow Window {WIDTH, HEIGHT, "Vulkan Tutorial"};
 	CDevice Device{Window};
 	CRenderer Renderer {Window, Device};
+	CGeometryPool GeometryPool {Device};
+	CUploadManager UploadManager {Device};
+	// outlives the model loader, whose background imports parse on it
+	CWorkerPool WorkerPool {};
+	CModelLoader ModelLoader {Device, GeometryPool, UploadManager, WorkerPool};
+	CPipelineRegistry PipelineRegistry {Device, WorkerPool};
 
 	// note: order of declarations matters
-	std::unique_ptr<CDescriptorPool> globalPool {};
+	// sets that live as long as the app, frames allocate from their own allocators
+	CDescriptorAllocator GlobalDescriptorAllocator {Device};
 	CGameObject::Map gameObjects;
+	// objects waiting for the model of each future
+	std::vector<std::pair<CModelLoader::ModelFuture, std::vector<CGameObject::id_t>>> pendingModels;
+
+	// the rest of the simulated state, which like gameObjects only the simulation thread touches while the frame
+	// pipeline runs
+	CCamera camera {};
+	CGameObject viewerObject = CGameObject::createGameObject();
+	CKeyboardMovementController cameraController {};
+
+	// inputs go to the simulation thread and snapshots come back, both one frame ahead of the rendered frame
+	CFrameExchange<FrameInput> inputExchange;
+	CFrameExchange<FrameSnapshot> snapshotExchange;
+	std::thread simulationThread;
+
+	uint32_t benchmarkObjectCount;
+	LightingModel lightingModel;
+	// object data binding range, large enough for every object of the scene
+	uint32_t maxFrameObjects;
 };
 
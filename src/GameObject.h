@@ -41,7 +41,7 @@ public:
 		return id;
 	}
 
-	glm::vec3 color {};
+	glm::vec3 color {1.f, 1.f, 1.f};
 	TransformComponent transform {};
 
 	// Optional pointer components
@@ -0,0 +1,136 @@
+#include "GeometryPool.h"
+
+#include "SwapChain.h"
+
+// std
+#include <algorithm>
+#include <iostream>
+
+
+CGeometryPool::CGeometryPool (CDevice &device, VkDeviceSize vertexCapacity, VkDeviceSize indexCapacity)
+	: Device {device}
+{
+	vertexBlocks.capacity = vertexCapacity;
+	vertexBlocks.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	createBlock(vertexBlocks, 0, vertexCapacity);
+
+	for (BlockList &list: indexBlocks)
+	{
+		list.capacity = indexCapacity;
+		list.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		createBlock(list, 0, indexCapacity);
+	}
+}
+
+CGeometryPool::Range CGeometryPool::allocateVertices (VkDeviceSize stride, uint32_t count)
+{
+	std::lock_guard<std::mutex> lock {mutex};
+	return allocate(vertexBlocks, stride * count, stride);
+}
+
+CGeometryPool::Range CGeometryPool::allocateIndices (VkIndexType indexType, uint32_t count)
+{
+	std::lock_guard<std::mutex> lock {mutex};
+	return allocate(indexBlocks[indexPool(indexType)], indexSize(indexType) * count, indexSize(indexType));
+}
+
+CGeometryPool::Range CGeometryPool::allocate (BlockList &list, VkDeviceSize size, VkDeviceSize alignment)
+{
+	Range range {};
+	range.size = size;
+	for (uint32_t block = 0; block < list.blocks.size(); ++block)
+	{
+		if (list.blocks[block].ranges && list.blocks[block].ranges->allocate(size, alignment, range.offset))
+		{
+			range.block = block;
+			return range;
+		}
+	}
+
+	// no block has room, chain another one in the first released slot
+	auto slot = std::find_if(list.blocks.begin(), list.blocks.end(), [] (const Block &block) { return !block.ranges; });
+	range.block = static_cast<uint32_t>(slot - list.blocks.begin());
+
+	// a range that is larger than a block gets a dedicated buffer
+	const VkDeviceSize capacity = std::max(list.capacity, size);
+	std::cout << "geometry pool is full, chaining a " << capacity << " byte block\n";
+	createBlock(list, range.block, capacity);
+	list.blocks[range.block].ranges->allocate(size, alignment, range.offset);
+	return range;
+}
+
+void CGeometryPool::createBlock (BlockList &list, uint32_t block, VkDeviceSize capacity)
+{
+	if (list.blocks.size() <= block)
+	{
+		list.blocks.resize(block + 1);
+	}
+
+	// uploads on the transfer queue write new ranges while frames draw from the others
+	list.blocks[block].buffer = std::make_unique<CBuffer>(Device, capacity, 1, list.usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1, true);
+	list.blocks[block].ranges = std::make_unique<CRangeAllocator>(capacity);
+}
+
+void CGeometryPool::freeVertices (const Range &range)
+{
+	retire(vertexBlocks, range);
+}
+
+void CGeometryPool::freeIndices (VkIndexType indexType, const Range &range)
+{
+	retire(indexBlocks[indexPool(indexType)], range);
+}
+
+void CGeometryPool::beginFrame ()
+{
+	std::lock_guard<std::mutex> lock {mutex};
+	++frame;
+	// the frames that were recorded up to the free have completed once the frame index has come around
+	while (!retired.empty() && retired.front().frame + CSwapChain::MAX_FRAMES_IN_FLIGHT <= frame)
+	{
+		const RetiredRange &front = retired.front();
+		Block &block = front.list->blocks[front.range.block];
+		block.ranges->free(front.range.offset, front.range.size);
+
+		// no draw can reference an empty chained block any more, the first block is kept for the next meshes
+		if (front.range.block > 0 && block.ranges->getUsedSize() == 0)
+		{
+			block.buffer.reset();
+			block.ranges.reset();
+		}
+		retired.pop_front();
+	}
+}
+
+void CGeometryPool::retire (BlockList &list, const Range &range)
+{
+	if (range.size > 0)
+	{
+		std::lock_guard<std::mutex> lock {mutex};
+		retired.push_back({&list, range, frame});
+	}
+}
+
+VkBuffer CGeometryPool::getVertexBuffer (uint32_t block)
+{
+	std::lock_guard<std::mutex> lock {mutex};
+	return vertexBlocks.blocks[block].buffer->getBuffer();
+}
+
+VkBuffer CGeometryPool::getIndexBuffer (VkIndexType indexType, uint32_t block)
+{
+	std::lock_guard<std::mutex> lock {mutex};
+	return indexBlocks[indexPool(indexType)].blocks[block].buffer->getBuffer();
+}
+
+void CGeometryPool::bindVertexBuffer (VkCommandBuffer commandBuffer, uint32_t block)
+{
+	VkBuffer buffers[] = {getVertexBuffer(block)};
+	VkDeviceSize offsets[] = {0};
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+}
+
+void CGeometryPool::bindIndexBuffer (VkCommandBuffer commandBuffer, VkIndexType indexType, uint32_t block)
+{
+	vkCmdBindIndexBuffer(commandBuffer, getIndexBuffer(indexType, block), 0, indexType);
+}
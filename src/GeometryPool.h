@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Buffer.h"
+#include "Device.h"
+#include "RangeAllocator.h"
+
+// std
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+// Device local vertex buffers and index buffers per index type shared by all meshes. Models own ranges inside
+// them and draw with firstIndex / vertexOffset, so geometry is bound once per frame as long as it fits the first
+// block. When no block has room another one is chained, a range larger than a block gets a dedicated buffer of its
+// own size. Freed ranges are only handed out again once the frames in flight that could still read them have completed.
+class CGeometryPool
+{
+public:
+	static constexpr VkDeviceSize DEFAULT_VERTEX_CAPACITY = 64 * 1024 * 1024;
+	static constexpr VkDeviceSize DEFAULT_INDEX_CAPACITY = 32 * 1024 * 1024;
+
+	struct Range
+	{
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		// the buffer the range is in, 0 is the block every batched draw binds
+		uint32_t block = 0;
+	};
+
+	// the capacities are the size of each block
+	CGeometryPool (CDevice &device, VkDeviceSize vertexCapacity = DEFAULT_VERTEX_CAPACITY, VkDeviceSize indexCapacity = DEFAULT_INDEX_CAPACITY);
+
+	CGeometryPool (const CGeometryPool &) = delete;
+
+	CGeometryPool &operator= (const CGeometryPool &) = delete;
+
+	// the offset is a multiple of the stride so it converts to a vertexOffset
+	Range allocateVertices (VkDeviceSize stride, uint32_t count);
+
+	// the offset is a multiple of the index size so it converts to a firstIndex
+	Range allocateIndices (VkIndexType indexType, uint32_t count);
+
+	// the range is reused after the frames in flight have completed
+	void freeVertices (const Range &range);
+
+	void freeIndices (VkIndexType indexType, const Range &range);
+
+	// starts a frame whose previous use of the frame index has completed, which releases the ranges freed before it
+	// and the chained blocks they leave empty
+	void beginFrame ();
+
+	VkBuffer getVertexBuffer (uint32_t block = 0);
+
+	VkBuffer getIndexBuffer (VkIndexType indexType, uint32_t block = 0);
+
+	void bindVertexBuffer (VkCommandBuffer commandBuffer, uint32_t block = 0);
+
+	void bindIndexBuffer (VkCommandBuffer commandBuffer, VkIndexType indexType, uint32_t block = 0);
+
+private:
+	struct Block
+	{
+		std::unique_ptr<CBuffer> buffer;
+		std::unique_ptr<CRangeAllocator> ranges;
+	};
+
+	// released blocks stay as empty slots so the block index of the other ranges does not change
+	struct BlockList
+	{
+		std::vector<Block> blocks;
+		VkDeviceSize capacity;
+		VkBufferUsageFlags usage;
+	};
+
+	static size_t indexPool (VkIndexType indexType)
+	{
+		return indexType == VK_INDEX_TYPE_UINT16 ? 0 : 1;
+	}
+
+	struct RetiredRange
+	{
+		BlockList *list;
+		Range range;
+		// the frame it was freed in
+		uint64_t frame;
+	};
+
+	Range allocate (BlockList &list, VkDeviceSize size, VkDeviceSize alignment);
+
+	void createBlock (BlockList &list, uint32_t block, VkDeviceSize capacity);
+
+	void retire (BlockList &list, const Range &range);
+
+	static VkDeviceSize indexSize (VkIndexType indexType)
+	{
+		return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+	}
+
+	CDevice &Device;
+
+	BlockList vertexBlocks;
+	BlockList indexBlocks[2];
+
+	// models are created and destroyed off the render thread, and blocks are chained by them
+	std::mutex mutex;
+	std::deque<RetiredRange> retired;
+	uint64_t frame = 0;
+};
@@ -4,66 +4,75 @@
 #include <limits>
 
 
-void CKeyboardMovementController::moveInPlaneXZ (GLFWwindow *window, float dt, CGameObject &gameObject)
+CKeyboardMovementController::Input CKeyboardMovementController::sampleInput (GLFWwindow *window) const
 {
-	glm::vec3 rotate {0};
+	Input input {};
 	if (glfwGetKey(window, keys.lookRight) == GLFW_PRESS)
 	{
-		rotate.y += 1.f;
+		input.rotate.y += 1.f;
 	}
 	if (glfwGetKey(window, keys.lookLeft) == GLFW_PRESS)
 	{
-		rotate.y -= 1.f;
+		input.rotate.y -= 1.f;
 	}
 	if (glfwGetKey(window, keys.lookUp) == GLFW_PRESS)
 	{
-		rotate.x += 1.f;
+		input.rotate.x += 1.f;
 	}
 	if (glfwGetKey(window, keys.lookDown) == GLFW_PRESS)
 	{
-		rotate.x -= 1.f;
-	}
-
-	if (glm::dot(rotate, rotate) > std::numeric_limits<float>::epsilon())
-	{
-		gameObject.transform.rotation += lookSpeed * dt * glm::normalize(rotate);
+		input.rotate.x -= 1.f;
 	}
 
-	// limit pitch values between about +/- 85ish degrees
-	gameObject.transform.rotation.x = glm::clamp(gameObject.transform.rotation.x, -1.5f, 1.5f);
-	gameObject.transform.rotation.y = glm::mod(gameObject.transform.rotation.y, glm::two_pi<float>());
-
-	float yaw = gameObject.transform.rotation.y;
-	const glm::vec3 forwardDir {sin(yaw), 0.f, cos(yaw)};
-	const glm::vec3 rightDir {forwardDir.z, 0.f, -forwardDir.x};
-	const glm::vec3 upDir {0.f, -1.f, 0.f};
-
-	glm::vec3 moveDir {0.f};
 	if (glfwGetKey(window, keys.moveForward) == GLFW_PRESS)
 	{
-		moveDir += forwardDir;
+		input.move.z += 1.f;
 	}
 	if (glfwGetKey(window, keys.moveBackward) == GLFW_PRESS)
 	{
-		moveDir -= forwardDir;
+		input.move.z -= 1.f;
 	}
 	if (glfwGetKey(window, keys.moveRight) == GLFW_PRESS)
 	{
-		moveDir += rightDir;
+		input.move.x += 1.f;
 	}
 	if (glfwGetKey(window, keys.moveLeft) == GLFW_PRESS)
 	{
-		moveDir -= rightDir;
+		input.move.x -= 1.f;
 	}
 	if (glfwGetKey(window, keys.moveUp) == GLFW_PRESS)
 	{
-		moveDir += upDir;
+		input.move.y += 1.f;
 	}
 	if (glfwGetKey(window, keys.moveDown) == GLFW_PRESS)
 	{
-		moveDir -= upDir;
+		input.move.y -= 1.f;
 	}
+	return input;
+}
+
+void CKeyboardMovementController::moveInPlaneXZ (GLFWwindow *window, float dt, CGameObject &gameObject)
+{
+	moveInPlaneXZ(sampleInput(window), dt, gameObject);
+}
+
+void CKeyboardMovementController::moveInPlaneXZ (const Input &input, float dt, CGameObject &gameObject)
+{
+	if (glm::dot(input.rotate, input.rotate) > std::numeric_limits<float>::epsilon())
+	{
+		gameObject.transform.rotation += lookSpeed * dt * glm::normalize(input.rotate);
+	}
+
+	// limit pitch values between about +/- 85ish degrees
+	gameObject.transform.rotation.x = glm::clamp(gameObject.transform.rotation.x, -1.5f, 1.5f);
+	gameObject.transform.rotation.y = glm::mod(gameObject.transform.rotation.y, glm::two_pi<float>());
+
+	float yaw = gameObject.transform.rotation.y;
+	const glm::vec3 forwardDir {sin(yaw), 0.f, cos(yaw)};
+	const glm::vec3 rightDir {forwardDir.z, 0.f, -forwardDir.x};
+	const glm::vec3 upDir {0.f, -1.f, 0.f};
 
+	const glm::vec3 moveDir = input.move.x * rightDir + input.move.y * upDir + input.move.z * forwardDir;
 	if (glm::dot(moveDir, moveDir) > std::numeric_limits<float>::epsilon())
 	{
 		gameObject.transform.translation += moveSpeed * dt * glm::normalize(moveDir);
@@ -21,8 +21,21 @@ public:
 		int lookDown = GLFW_KEY_DOWN;
 	};
 
+	// the movement keys held down, sampled on the main thread for a simulation that may run on another
+	struct Input
+	{
+		// around the x and y axes
+		glm::vec3 rotate {0.f};
+		// along the right, up and forward directions of the object's yaw
+		glm::vec3 move {0.f};
+	};
+
+	Input sampleInput (GLFWwindow *window) const;
+
 	void moveInPlaneXZ (GLFWwindow *window, float dt, CGameObject &gameObject);
 
+	void moveInPlaneXZ (const Input &input, float dt, CGameObject &gameObject);
+
 	KeyMappings keys {};
 	float moveSpeed {3.f};
 	float lookSpeed {1.5f};
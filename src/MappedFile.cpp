@@ -0,0 +1,150 @@
+#include "MappedFile.h"
+
+// std
+#include <cstdio>
+#include <functional>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+CMappedFile::~CMappedFile ()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool CMappedFile::open (const std::string &filepath)
+{
+	close();
+
+	HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize {};
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	fileHandle = file;
+	mappingHandle = mapping;
+	data = static_cast<const uint8_t *>(view);
+	size = static_cast<size_t>(fileSize.QuadPart);
+	return true;
+}
+
+void CMappedFile::close ()
+{
+	if (data)
+	{
+		UnmapViewOfFile(data);
+		CloseHandle(mappingHandle);
+		CloseHandle(fileHandle);
+	}
+	data = nullptr;
+	size = 0;
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+}
+
+bool replaceFile (const std::string &tempPath, const std::string &filepath)
+{
+	return MoveFileExA(tempPath.c_str(), filepath.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+static unsigned long processId ()
+{
+	return GetCurrentProcessId();
+}
+
+#else
+
+bool CMappedFile::open (const std::string &filepath)
+{
+	close();
+
+	int fd = ::open(filepath.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat fileStat {};
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	void *view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	if (view == MAP_FAILED)
+	{
+		::close(fd);
+		return false;
+	}
+
+	fileDescriptor = fd;
+	data = static_cast<const uint8_t *>(view);
+	size = static_cast<size_t>(fileStat.st_size);
+	return true;
+}
+
+void CMappedFile::close ()
+{
+	if (data)
+	{
+		munmap(const_cast<uint8_t *>(data), size);
+		::close(fileDescriptor);
+	}
+	data = nullptr;
+	size = 0;
+	fileDescriptor = -1;
+}
+
+bool replaceFile (const std::string &tempPath, const std::string &filepath)
+{
+	return std::rename(tempPath.c_str(), filepath.c_str()) == 0;
+}
+
+static unsigned long processId ()
+{
+	return static_cast<unsigned long>(getpid());
+}
+
+#endif
+
+std::string makeTempPath (const std::string &filepath)
+{
+	const size_t threadId = std::hash<std::thread::id> {}(std::this_thread::get_id());
+	return filepath + "." + std::to_string(processId()) + "." + std::to_string(threadId) + ".tmp";
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+// Read-only memory mapping of a whole file. The view stays valid for the lifetime of the object.
+class CMappedFile
+{
+public:
+	CMappedFile () = default;
+	~CMappedFile ();
+
+	CMappedFile (const CMappedFile &) = delete;
+
+	CMappedFile &operator= (const CMappedFile &) = delete;
+
+	bool open (const std::string &filepath);
+
+	void close ();
+
+	bool isOpen () const
+	{
+		return data != nullptr;
+	}
+
+	const uint8_t *getData () const
+	{
+		return data;
+	}
+
+	size_t getSize () const
+	{
+		return size;
+	}
+
+private:
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+
+#ifdef _WIN32
+	void *fileHandle = nullptr;
+	void *mappingHandle = nullptr;
+#else
+	int fileDescriptor = -1;
+#endif
+};
+
+// replaces filepath with the temporary file in one step, readers see either the old or the new file, and
+// mappings of the old file stay valid
+bool replaceFile (const std::string &tempPath, const std::string &filepath);
+
+// a temporary file next to filepath that no other process or thread writes at the same time
+std::string makeTempPath (const std::string &filepath);
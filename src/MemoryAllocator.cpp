@@ -0,0 +1,232 @@
+#include "MemoryAllocator.h"
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+
+CMemoryAllocator::CMemoryAllocator (VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize preferredBlockSize)
+	: device {device}
+{
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	bufferImageGranularity = properties.limits.bufferImageGranularity;
+	nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+	maxMemoryAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+	pools.resize(memoryProperties.memoryTypeCount * 2);
+	for (uint32_t i = 0; i < pools.size(); ++i)
+	{
+		const uint32_t memoryTypeIndex = i / 2;
+		const VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+
+		// small heaps, like the host visible device local window, get blocks of an eighth of the heap
+		pools[i].blockSize = heapSize <= 1024ull * 1024 * 1024 ? std::min(preferredBlockSize, heapSize / 8) : preferredBlockSize;
+	}
+}
+
+CMemoryAllocator::~CMemoryAllocator ()
+{
+	for (auto &pool: pools)
+	{
+		for (auto &block: pool.blocks)
+		{
+			assert(block->ranges.isEmpty() && "Device memory block destroyed with live allocations");
+			freeDeviceMemory(block->memory, block->mapped);
+		}
+	}
+	assert(dedicatedCount == 0 && "Dedicated device memory leaked");
+}
+
+CMemoryAllocator::Allocation CMemoryAllocator::allocate (const VkMemoryRequirements &requirements, uint32_t memoryTypeIndex, bool linear)
+{
+	std::lock_guard<std::mutex> lock {mutex};
+
+	Allocation allocation {};
+	allocation.size = requirements.size;
+	allocation.pool = memoryTypeIndex * 2 + (linear || bufferImageGranularity <= 1 ? 0 : 1);
+	Pool &pool = pools[allocation.pool];
+
+	// huge resources would waste most of a block, so they get their own memory
+	if (requirements.size > pool.blockSize / 2)
+	{
+		allocation.memory = allocateDeviceMemory(requirements.size, memoryTypeIndex, &allocation.mapped);
+		++dedicatedCount;
+		dedicatedBytes += requirements.size;
+		return allocation;
+	}
+
+	for (auto &block: pool.blocks)
+	{
+		allocation.node = block->ranges.allocate(requirements.size, requirements.alignment, allocation.offset);
+		if (allocation.node != CTlsfAllocator::INVALID_NODE)
+		{
+			allocation.block = block.get();
+			break;
+		}
+	}
+
+	if (allocation.block == nullptr)
+	{
+		auto block = std::make_unique<Block>(pool.blockSize);
+		block->memory = allocateDeviceMemory(pool.blockSize, memoryTypeIndex, &block->mapped);
+		allocation.node = block->ranges.allocate(requirements.size, requirements.alignment, allocation.offset);
+		allocation.block = block.get();
+		pool.blocks.push_back(std::move(block));
+	}
+
+	allocation.memory = allocation.block->memory;
+	if (allocation.block->mapped != nullptr)
+	{
+		allocation.mapped = static_cast<char *>(allocation.block->mapped) + allocation.offset;
+	}
+	return allocation;
+}
+
+void CMemoryAllocator::free (const Allocation &allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock {mutex};
+
+	if (allocation.block == nullptr)
+	{
+		freeDeviceMemory(allocation.memory, allocation.mapped);
+		--dedicatedCount;
+		dedicatedBytes -= allocation.size;
+		return;
+	}
+
+	allocation.block->ranges.free(allocation.node);
+
+	// one empty block per pool is kept so a resource that is recreated every frame does not reallocate memory
+	Pool &pool = pools[allocation.pool];
+	if (allocation.block->ranges.isEmpty() && pool.blocks.size() > 1)
+	{
+		auto it = std::find_if(pool.blocks.begin(), pool.blocks.end(), [&allocation] (const std::unique_ptr<Block> &block) { return block.get() == allocation.block; });
+		freeDeviceMemory((*it)->memory, (*it)->mapped);
+		pool.blocks.erase(it);
+	}
+}
+
+VkResult CMemoryAllocator::flush (const Allocation &allocation, VkDeviceSize size, VkDeviceSize offset)
+{
+	VkMappedMemoryRange mappedRange = getMappedRange(allocation, size, offset);
+	return vkFlushMappedMemoryRanges(device, 1, &mappedRange);
+}
+
+VkResult CMemoryAllocator::invalidate (const Allocation &allocation, VkDeviceSize size, VkDeviceSize offset)
+{
+	VkMappedMemoryRange mappedRange = getMappedRange(allocation, size, offset);
+	return vkInvalidateMappedMemoryRanges(device, 1, &mappedRange);
+}
+
+VkMappedMemoryRange CMemoryAllocator::getMappedRange (const Allocation &allocation, VkDeviceSize size, VkDeviceSize offset) const
+{
+	if (size == VK_WHOLE_SIZE)
+	{
+		size = allocation.size - offset;
+	}
+
+	// the range must start and end on a multiple of nonCoherentAtomSize or at the end of the memory
+	const VkDeviceSize memorySize = allocation.block != nullptr ? allocation.block->ranges.getCapacity() : allocation.size;
+	const VkDeviceSize begin = (allocation.offset + offset) / nonCoherentAtomSize * nonCoherentAtomSize;
+	const VkDeviceSize end = (allocation.offset + offset + size + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize;
+
+	VkMappedMemoryRange mappedRange = {};
+	mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	mappedRange.memory = allocation.memory;
+	mappedRange.offset = begin;
+	mappedRange.size = end >= memorySize ? VK_WHOLE_SIZE : end - begin;
+	return mappedRange;
+}
+
+VkDeviceMemory CMemoryAllocator::allocateDeviceMemory (VkDeviceSize size, uint32_t memoryTypeIndex, void **mapped)
+{
+	if (deviceMemoryCount >= maxMemoryAllocationCount)
+	{
+		throw std::runtime_error("device memory allocation count limit reached!");
+	}
+
+	VkMemoryAllocateInfo allocInfo {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to allocate device memory!");
+	}
+	++deviceMemoryCount;
+
+	*mapped = nullptr;
+	if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS)
+		{
+			vkFreeMemory(device, memory, nullptr);
+			--deviceMemoryCount;
+			throw std::runtime_error("failed to map device memory!");
+		}
+	}
+	return memory;
+}
+
+void CMemoryAllocator::freeDeviceMemory (VkDeviceMemory memory, void *mapped)
+{
+	if (mapped != nullptr)
+	{
+		vkUnmapMemory(device, memory);
+	}
+	vkFreeMemory(device, memory, nullptr);
+	--deviceMemoryCount;
+}
+
+CMemoryAllocator::Stats CMemoryAllocator::getStats () const
+{
+	std::lock_guard<std::mutex> lock {mutex};
+
+	Stats stats {};
+	stats.deviceMemoryCount = deviceMemoryCount;
+	stats.dedicatedCount = dedicatedCount;
+	stats.dedicatedBytes = dedicatedBytes;
+	stats.allocationCount = dedicatedCount;
+	stats.usedBytes = dedicatedBytes;
+
+	VkDeviceSize freeBytes = 0;
+	VkDeviceSize largestFreeBytes = 0;
+	for (const auto &pool: pools)
+	{
+		for (const auto &block: pool.blocks)
+		{
+			++stats.blockCount;
+			stats.blockBytes += block->ranges.getCapacity();
+			stats.allocationCount += block->ranges.getAllocationCount();
+			stats.usedBytes += block->ranges.getUsedSize();
+			stats.freeRangeCount += block->ranges.getFreeRangeCount();
+			freeBytes += block->ranges.getCapacity() - block->ranges.getUsedSize();
+			largestFreeBytes += block->ranges.getLargestFreeRange();
+		}
+	}
+
+	stats.fragmentation = freeBytes > 0 ? 1.f - float(largestFreeBytes) / float(freeBytes) : 0.f;
+	return stats;
+}
+
+void CMemoryAllocator::printStats () const
+{
+	const Stats stats = getStats();
+	const float megabyte = 1024.f * 1024.f;
+	std::cout << "device memory: " << stats.allocationCount << " allocations, " << stats.usedBytes / megabyte << " MB used in "
+		<< stats.blockCount << " blocks (" << stats.blockBytes / megabyte << " MB) and " << stats.dedicatedCount << " dedicated ("
+		<< stats.dedicatedBytes / megabyte << " MB), " << stats.deviceMemoryCount << " of " << maxMemoryAllocationCount
+		<< " vkAllocateMemory, " << stats.freeRangeCount << " free ranges, fragmentation " << stats.fragmentation * 100.f << "%" << std::endl;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "TlsfAllocator.h"
+
+// libs
+#include <vulkan/vulkan.h>
+
+// std
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+// Sub-allocates device memory from large blocks per memory type, so resources do not each cost a
+// vkAllocateMemory. Host visible blocks stay mapped for their whole lifetime.
+class CMemoryAllocator
+{
+	struct Block;
+
+public:
+	static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+	struct Allocation
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		// points at offset inside the persistent mapping, null when the memory is not host visible
+		void *mapped = nullptr;
+		uint32_t pool = 0;
+		// null for dedicated allocations
+		Block *block = nullptr;
+		uint32_t node = CTlsfAllocator::INVALID_NODE;
+	};
+
+	struct Stats
+	{
+		uint32_t deviceMemoryCount = 0;
+		uint32_t blockCount = 0;
+		uint32_t dedicatedCount = 0;
+		uint32_t allocationCount = 0;
+		VkDeviceSize blockBytes = 0;
+		VkDeviceSize dedicatedBytes = 0;
+		VkDeviceSize usedBytes = 0;
+		uint32_t freeRangeCount = 0;
+		// share of the free block memory that is not part of the largest free range of its block
+		float fragmentation = 0.f;
+	};
+
+	CMemoryAllocator (VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize preferredBlockSize = DEFAULT_BLOCK_SIZE);
+
+	~CMemoryAllocator ();
+
+	CMemoryAllocator (const CMemoryAllocator &) = delete;
+
+	CMemoryAllocator &operator= (const CMemoryAllocator &) = delete;
+
+	// linear is false for optimally tiled images, which are kept apart from buffers by bufferImageGranularity
+	Allocation allocate (const VkMemoryRequirements &requirements, uint32_t memoryTypeIndex, bool linear);
+
+	void free (const Allocation &allocation);
+
+	// size and offset are relative to the allocation and widened to nonCoherentAtomSize
+	VkResult flush (const Allocation &allocation, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+
+	VkResult invalidate (const Allocation &allocation, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+
+	Stats getStats () const;
+
+	void printStats () const;
+
+private:
+	struct Block
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		void *mapped = nullptr;
+		CTlsfAllocator ranges;
+
+		explicit Block (VkDeviceSize size)
+			: ranges {size}
+		{
+		}
+	};
+
+	struct Pool
+	{
+		VkDeviceSize blockSize = 0;
+		std::vector<std::unique_ptr<Block>> blocks;
+	};
+
+	VkDeviceMemory allocateDeviceMemory (VkDeviceSize size, uint32_t memoryTypeIndex, void **mapped);
+
+	void freeDeviceMemory (VkDeviceMemory memory, void *mapped);
+
+	VkMappedMemoryRange getMappedRange (const Allocation &allocation, VkDeviceSize size, VkDeviceSize offset) const;
+
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	VkDeviceSize bufferImageGranularity;
+	VkDeviceSize nonCoherentAtomSize;
+	uint32_t maxMemoryAllocationCount;
+
+	// two pools per memory type, linear resources and optimal images, when bufferImageGranularity forces them apart
+	std::vector<Pool> pools;
+	uint32_t deviceMemoryCount = 0;
+	uint32_t dedicatedCount = 0;
+	VkDeviceSize dedicatedBytes = 0;
+	mutable std::mutex mutex;
+};
@@ -0,0 +1,131 @@
+#include "MeshCache.h"
+
+#include "Utils.h"
+
+// std
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+
+static constexpr char CACHE_MAGIC[4] = {'V', 'M', 'S', 'H'};
+
+CMeshCache::CMeshCache (const std::string &sourcePath, const CModel::ImportSettings &settings)
+		: sourcePath {sourcePath}, cachePath {sourcePath + ".meshcache"}, settingsHash {hashSettings(settings)}
+{
+}
+
+uint64_t CMeshCache::hashSettings (const CModel::ImportSettings &settings)
+{
+	// field by field, the padding of the struct is not initialized
+	uint64_t hash = hashBytes(&settings.weldGridStep, sizeof(settings.weldGridStep));
+	hash = hashBytes(&settings.reduceOverdraw, sizeof(settings.reduceOverdraw), hash);
+	hash = hashBytes(&settings.maxLodCount, sizeof(settings.maxLodCount), hash);
+	hash = hashBytes(&settings.lodReduction, sizeof(settings.lodReduction), hash);
+	hash = hashBytes(&settings.lodMaxError, sizeof(settings.lodMaxError), hash);
+	hash = hashBytes(&settings.meshletMaxVertices, sizeof(settings.meshletMaxVertices), hash);
+	return hashBytes(&settings.meshletMaxTriangles, sizeof(settings.meshletMaxTriangles), hash);
+}
+
+bool CMeshCache::hashSource ()
+{
+	if (hasSourceHash)
+	{
+		return true;
+	}
+
+	CMappedFile sourceFile {};
+	if (!sourceFile.open(sourcePath))
+	{
+		return false;
+	}
+
+	sourceHash = hashBytes(sourceFile.getData(), sourceFile.getSize());
+	hasSourceHash = true;
+	return true;
+}
+
+bool CMeshCache::load ()
+{
+	if (!hashSource() || !cacheFile.open(cachePath))
+	{
+		return false;
+	}
+
+	if (cacheFile.getSize() < sizeof(Header))
+	{
+		cacheFile.close();
+		return false;
+	}
+
+	Header header {};
+	memcpy(&header, cacheFile.getData(), sizeof(Header));
+
+	const size_t expectedSize = sizeof(Header) + size_t(header.vertexCount) * sizeof(CModel::Vertex) + size_t(header.indexCount) * sizeof(uint32_t) + size_t(header.lodCount) * sizeof(CModel::Lod) + size_t(header.meshletCount) * sizeof(CModel::Meshlet);
+	if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != VERSION || header.vertexSize != sizeof(CModel::Vertex) || header.sourceHash != sourceHash || header.settingsHash != settingsHash || cacheFile.getSize() != expectedSize)
+	{
+		cacheFile.close();
+		return false;
+	}
+
+	const uint8_t *payload = cacheFile.getData() + sizeof(Header);
+	meshData.vertices = reinterpret_cast<const CModel::Vertex *>(payload);
+	meshData.vertexCount = header.vertexCount;
+	payload += size_t(header.vertexCount) * sizeof(CModel::Vertex);
+	meshData.indices = reinterpret_cast<const uint32_t *>(payload);
+	meshData.indexCount = header.indexCount;
+	payload += size_t(header.indexCount) * sizeof(uint32_t);
+	meshData.lods = reinterpret_cast<const CModel::Lod *>(payload);
+	meshData.lodCount = header.lodCount;
+	payload += size_t(header.lodCount) * sizeof(CModel::Lod);
+	meshData.meshlets = reinterpret_cast<const CModel::Meshlet *>(payload);
+	meshData.meshletCount = header.meshletCount;
+	return true;
+}
+
+void CMeshCache::store (const CModel::Builder &builder)
+{
+	if (!hashSource())
+	{
+		return;
+	}
+
+	Header header {};
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = VERSION;
+	header.sourceHash = sourceHash;
+	header.settingsHash = settingsHash;
+	header.vertexSize = sizeof(CModel::Vertex);
+	header.vertexCount = static_cast<uint32_t>(builder.vertices.size());
+	header.indexCount = static_cast<uint32_t>(builder.indices.size());
+	header.lodCount = static_cast<uint32_t>(builder.lods.size());
+	header.meshletCount = static_cast<uint32_t>(builder.meshlets.size());
+
+	// write to a temporary file first so a crash never leaves a truncated cache behind
+	const std::string tempPath = makeTempPath(cachePath);
+	{
+		std::ofstream file {tempPath, std::ios::binary | std::ios::trunc};
+		if (!file.is_open())
+		{
+			return;
+		}
+
+		file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+		file.write(reinterpret_cast<const char *>(builder.vertices.data()), builder.vertices.size() * sizeof(CModel::Vertex));
+		file.write(reinterpret_cast<const char *>(builder.indices.data()), builder.indices.size() * sizeof(uint32_t));
+		file.write(reinterpret_cast<const char *>(builder.lods.data()), builder.lods.size() * sizeof(CModel::Lod));
+		file.write(reinterpret_cast<const char *>(builder.meshlets.data()), builder.meshlets.size() * sizeof(CModel::Meshlet));
+		if (!file.good())
+		{
+			file.close();
+			std::remove(tempPath.c_str());
+			return;
+		}
+	}
+
+	cacheFile.close();
+	if (!replaceFile(tempPath, cachePath))
+	{
+		std::remove(tempPath.c_str());
+	}
+}
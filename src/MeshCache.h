@@ -0,0 +1,57 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "Model.h"
+
+
+#include <string>
+#include <vector>
+
+
+// Binary cache of the imported mesh (vertices, indices, LOD table and meshlets), stored next to its source file
+// and keyed by a hash of the source contents and of the import settings. A valid cache is memory mapped and used in place.
+class CMeshCache
+{
+public:
+	static constexpr uint32_t VERSION = 5;
+
+	CMeshCache (const std::string &sourcePath, const CModel::ImportSettings &settings);
+
+	bool load ();
+
+	void store (const CModel::Builder &builder);
+
+	// points into the mapped cache file, valid while this object is alive
+	const CModel::MeshData &getMeshData () const
+	{
+		return meshData;
+	}
+
+private:
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t sourceHash;
+		uint64_t settingsHash;
+		uint32_t vertexSize;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t lodCount;
+		uint32_t meshletCount;
+		uint32_t reserved;
+	};
+
+	bool hashSource ();
+
+	static uint64_t hashSettings (const CModel::ImportSettings &settings);
+
+	std::string sourcePath;
+	std::string cachePath;
+	uint64_t sourceHash = 0;
+	bool hasSourceHash = false;
+	uint64_t settingsHash = 0;
+
+	CMappedFile cacheFile;
+	CModel::MeshData meshData {};
+};
@@ -0,0 +1,366 @@
+#include "MeshOptimizer.h"
+
+// std
+#include <algorithm>
+#include <cmath>
+
+
+namespace
+{
+	constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+	// tuning values from the Forsyth paper
+	constexpr size_t SCORE_CACHE_SIZE = 32;
+	constexpr uint32_t MAX_VALENCE_SCORE = 32;
+	constexpr float CACHE_DECAY_POWER = 1.5f;
+	constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+	constexpr float VALENCE_BOOST_SCALE = 2.0f;
+	constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+	struct ScoreTables
+	{
+		float cache[SCORE_CACHE_SIZE];
+		float valence[MAX_VALENCE_SCORE];
+
+		ScoreTables ()
+		{
+			for (size_t i = 0; i < SCORE_CACHE_SIZE; ++i)
+			{
+				cache[i] = i < 3 ? LAST_TRIANGLE_SCORE : std::pow(1.0f - float(i - 3) / float(SCORE_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+			}
+
+			valence[0] = 0.0f;
+			for (uint32_t i = 1; i < MAX_VALENCE_SCORE; ++i)
+			{
+				valence[i] = VALENCE_BOOST_SCALE * std::pow(float(i), -VALENCE_BOOST_POWER);
+			}
+		}
+	};
+
+	float vertexScore (const ScoreTables &tables, int cachePosition, uint32_t liveTriangles)
+	{
+		if (liveTriangles == 0)
+		{
+			return 0.0f;
+		}
+
+		float score = cachePosition >= 0 ? tables.cache[cachePosition] : 0.0f;
+		score += liveTriangles < MAX_VALENCE_SCORE ? tables.valence[liveTriangles] : VALENCE_BOOST_SCALE * std::pow(float(liveTriangles), -VALENCE_BOOST_POWER);
+		return score;
+	}
+}
+
+CMeshOptimizer::Stats CMeshOptimizer::analyze (const std::vector<uint32_t> &indices, size_t vertexCount, uint32_t cacheSize)
+{
+	Stats stats {};
+	if (indices.empty())
+	{
+		return stats;
+	}
+
+	// a vertex is resident while fewer than cacheSize misses happened since it was loaded
+	std::vector<uint32_t> cacheTimestamps(vertexCount, 0);
+	std::vector<uint8_t> referenced(vertexCount, 0);
+	uint32_t timestamp = cacheSize + 1;
+	size_t misses = 0;
+	size_t uniqueVertices = 0;
+
+	for (uint32_t index: indices)
+	{
+		if (timestamp - cacheTimestamps[index] > cacheSize)
+		{
+			cacheTimestamps[index] = timestamp++;
+			++misses;
+		}
+
+		if (!referenced[index])
+		{
+			referenced[index] = 1;
+			++uniqueVertices;
+		}
+	}
+
+	stats.acmr = float(misses) / float(indices.size() / 3);
+	stats.atvr = float(misses) / float(uniqueVertices);
+	return stats;
+}
+
+void CMeshOptimizer::optimizeVertexCache (std::vector<uint32_t> &indices, size_t vertexCount)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	static const ScoreTables tables {};
+
+	// per vertex list of triangles not emitted yet, the live ones are kept at the front of each range
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);
+	for (uint32_t index: indices)
+	{
+		++liveTriangles[index];
+	}
+
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		adjacencyOffsets[vertex + 1] = adjacencyOffsets[vertex] + liveTriangles[vertex];
+	}
+
+	std::vector<uint32_t> adjacency(indices.size());
+	{
+		std::vector<uint32_t> fillOffsets(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); ++i)
+		{
+			adjacency[fillOffsets[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	std::vector<int> cachePositions(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		vertexScores[vertex] = vertexScore(tables, -1, liveTriangles[vertex]);
+	}
+
+	std::vector<float> triangleScores(triangleCount);
+	uint32_t bestTriangle = 0;
+	for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+	{
+		triangleScores[triangle] = vertexScores[indices[3 * triangle + 0]] + vertexScores[indices[3 * triangle + 1]] + vertexScores[indices[3 * triangle + 2]];
+		if (triangleScores[triangle] > triangleScores[bestTriangle])
+		{
+			bestTriangle = static_cast<uint32_t>(triangle);
+		}
+	}
+
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint32_t> cache {};
+	std::vector<uint32_t> newCache {};
+	cache.reserve(SCORE_CACHE_SIZE + 3);
+	newCache.reserve(SCORE_CACHE_SIZE + 3);
+
+	std::vector<uint32_t> output {};
+	output.reserve(indices.size());
+	size_t searchCursor = 0;
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+	{
+		if (bestTriangle == INVALID_INDEX)
+		{
+			// nothing left around the cache, continue with the next triangle in input order
+			while (emitted[searchCursor])
+			{
+				++searchCursor;
+			}
+			bestTriangle = static_cast<uint32_t>(searchCursor);
+		}
+
+		const uint32_t *triangle = &indices[3 * bestTriangle];
+		output.insert(output.end(), triangle, triangle + 3);
+		emitted[bestTriangle] = 1;
+
+		newCache.clear();
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			const uint32_t vertex = triangle[corner];
+
+			uint32_t *begin = &adjacency[adjacencyOffsets[vertex]];
+			uint32_t *end = begin + liveTriangles[vertex];
+			*std::find(begin, end, bestTriangle) = *(end - 1);
+			--liveTriangles[vertex];
+
+			if (std::find(newCache.begin(), newCache.end(), vertex) == newCache.end())
+			{
+				newCache.push_back(vertex);
+			}
+		}
+
+		for (uint32_t vertex: cache)
+		{
+			if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+			{
+				newCache.push_back(vertex);
+			}
+		}
+
+		// vertices pushed past the end of the cache are updated once more to lose their cache score
+		for (size_t i = 0; i < newCache.size(); ++i)
+		{
+			const uint32_t vertex = newCache[i];
+			const int position = i < SCORE_CACHE_SIZE ? static_cast<int>(i) : -1;
+			cachePositions[vertex] = position;
+
+			const float score = vertexScore(tables, position, liveTriangles[vertex]);
+			const float delta = score - vertexScores[vertex];
+			vertexScores[vertex] = score;
+
+			const uint32_t *adjacent = &adjacency[adjacencyOffsets[vertex]];
+			for (uint32_t j = 0; j < liveTriangles[vertex]; ++j)
+			{
+				triangleScores[adjacent[j]] += delta;
+			}
+		}
+
+		if (newCache.size() > SCORE_CACHE_SIZE)
+		{
+			newCache.resize(SCORE_CACHE_SIZE);
+		}
+		cache.swap(newCache);
+
+		bestTriangle = INVALID_INDEX;
+		float bestScore = 0.0f;
+		for (uint32_t vertex: cache)
+		{
+			const uint32_t *adjacent = &adjacency[adjacencyOffsets[vertex]];
+			for (uint32_t j = 0; j < liveTriangles[vertex]; ++j)
+			{
+				if (bestTriangle == INVALID_INDEX || triangleScores[adjacent[j]] > bestScore)
+				{
+					bestTriangle = adjacent[j];
+					bestScore = triangleScores[adjacent[j]];
+				}
+			}
+		}
+	}
+
+	indices.swap(output);
+}
+
+void CMeshOptimizer::optimizeOverdraw (std::vector<uint32_t> &indices, const std::vector<CModel::Vertex> &vertices, float threshold)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount < 2)
+	{
+		return;
+	}
+
+	const Stats inputStats = analyze(indices, vertices.size());
+	const float acmrThreshold = inputStats.acmr * threshold;
+
+	// split the stream into clusters that each stay under the ACMR threshold when drawn with a cold cache,
+	// so they can be reordered without losing much of the cache reuse
+	std::vector<uint32_t> clusterStarts {};
+	{
+		std::vector<uint32_t> cacheTimestamps(vertices.size(), 0);
+		uint32_t timestamp = ANALYZE_CACHE_SIZE + 1;
+		size_t clusterMisses = 0;
+		size_t clusterTriangles = 0;
+
+		for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+		{
+			if (clusterTriangles == 0)
+			{
+				clusterStarts.push_back(static_cast<uint32_t>(triangle));
+			}
+
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				const uint32_t index = indices[3 * triangle + corner];
+				if (timestamp - cacheTimestamps[index] > ANALYZE_CACHE_SIZE)
+				{
+					cacheTimestamps[index] = timestamp++;
+					++clusterMisses;
+				}
+			}
+			++clusterTriangles;
+
+			if (float(clusterMisses) <= acmrThreshold * float(clusterTriangles))
+			{
+				timestamp += ANALYZE_CACHE_SIZE + 1;
+				clusterMisses = 0;
+				clusterTriangles = 0;
+			}
+		}
+	}
+
+	const size_t clusterCount = clusterStarts.size();
+	if (clusterCount < 2)
+	{
+		return;
+	}
+	clusterStarts.push_back(static_cast<uint32_t>(triangleCount));
+
+	// area weighted centroid and normal per cluster
+	std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3 {0.0f});
+	std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3 {0.0f});
+	glm::vec3 meshCentroid {0.0f};
+	float meshArea = 0.0f;
+
+	for (size_t cluster = 0; cluster < clusterCount; ++cluster)
+	{
+		float clusterArea = 0.0f;
+		for (uint32_t triangle = clusterStarts[cluster]; triangle < clusterStarts[cluster + 1]; ++triangle)
+		{
+			const glm::vec3 &p0 = vertices[indices[3 * triangle + 0]].position;
+			const glm::vec3 &p1 = vertices[indices[3 * triangle + 1]].position;
+			const glm::vec3 &p2 = vertices[indices[3 * triangle + 2]].position;
+
+			const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			const float area = glm::length(normal);
+
+			clusterCentroids[cluster] += (p0 + p1 + p2) * (area / 3.0f);
+			clusterNormals[cluster] += normal;
+			clusterArea += area;
+		}
+
+		meshCentroid += clusterCentroids[cluster];
+		meshArea += clusterArea;
+		clusterCentroids[cluster] = clusterArea > 0.0f ? clusterCentroids[cluster] / clusterArea : vertices[indices[3 * clusterStarts[cluster]]].position;
+	}
+
+	if (meshArea > 0.0f)
+	{
+		meshCentroid /= meshArea;
+	}
+
+	// clusters facing away from the mesh center are likely to occlude the rest, draw them first
+	std::vector<float> sortKeys(clusterCount);
+	for (size_t cluster = 0; cluster < clusterCount; ++cluster)
+	{
+		const float normalLength = glm::length(clusterNormals[cluster]);
+		sortKeys[cluster] = normalLength > 0.0f ? glm::dot(clusterCentroids[cluster] - meshCentroid, clusterNormals[cluster] / normalLength) : 0.0f;
+	}
+
+	std::vector<uint32_t> clusterOrder(clusterCount);
+	for (size_t cluster = 0; cluster < clusterCount; ++cluster)
+	{
+		clusterOrder[cluster] = static_cast<uint32_t>(cluster);
+	}
+	std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&sortKeys] (uint32_t a, uint32_t b)
+	{
+		return sortKeys[a] > sortKeys[b];
+	});
+
+	std::vector<uint32_t> output {};
+	output.reserve(indices.size());
+	for (uint32_t cluster: clusterOrder)
+	{
+		output.insert(output.end(), indices.begin() + 3 * size_t(clusterStarts[cluster]), indices.begin() + 3 * size_t(clusterStarts[cluster + 1]));
+	}
+
+	if (analyze(output, vertices.size()).acmr <= acmrThreshold)
+	{
+		indices.swap(output);
+	}
+}
+
+void CMeshOptimizer::optimizeVertexFetch (std::vector<CModel::Vertex> &vertices, std::vector<uint32_t> &indices)
+{
+	std::vector<uint32_t> remap(vertices.size(), INVALID_INDEX);
+	std::vector<CModel::Vertex> output {};
+	output.reserve(vertices.size());
+
+	for (uint32_t &index: indices)
+	{
+		if (remap[index] == INVALID_INDEX)
+		{
+			remap[index] = static_cast<uint32_t>(output.size());
+			output.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	vertices.swap(output);
+}
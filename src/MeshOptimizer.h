@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Model.h"
+
+// std
+#include <cstdint>
+#include <vector>
+
+
+// Index and vertex reordering passes run on imported meshes before upload.
+class CMeshOptimizer
+{
+public:
+	static constexpr uint32_t ANALYZE_CACHE_SIZE = 16;
+
+	struct Stats
+	{
+		// average cache miss ratio, transformed vertices per triangle (0.5 is ideal for large grids, 3 is worst)
+		float acmr = 0.0f;
+		// average transformed vertex ratio, transformed vertices per referenced vertex (1 is ideal)
+		float atvr = 0.0f;
+	};
+
+	// simulates a FIFO post-transform cache of the given size over the index stream
+	static Stats analyze (const std::vector<uint32_t> &indices, size_t vertexCount, uint32_t cacheSize = ANALYZE_CACHE_SIZE);
+
+	// reorders triangles for post-transform cache reuse (Forsyth, "Linear-Speed Vertex Cache Optimisation")
+	static void optimizeVertexCache (std::vector<uint32_t> &indices, size_t vertexCount);
+
+	// reorders the clusters of a cache optimized index stream front to back from the outside in, keeping
+	// the result only if the ACMR stays within threshold times the input ACMR
+	static void optimizeOverdraw (std::vector<uint32_t> &indices, const std::vector<CModel::Vertex> &vertices, float threshold = 1.05f);
+
+	// renumbers vertices in first use order so vertex fetch walks memory linearly, dropping unreferenced ones
+	static void optimizeVertexFetch (std::vector<CModel::Vertex> &vertices, std::vector<uint32_t> &indices);
+};
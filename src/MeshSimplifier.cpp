@@ -0,0 +1,415 @@
+#include "MeshSimplifier.h"
+
+#include "Utils.h"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+
+namespace
+{
+	constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+	enum class VertexKind : uint8_t
+	{
+		Manifold,
+		Border,
+		Locked
+	};
+
+	// symmetric 4x4 error matrix stored as A (3x3), b and c, scaled by the accumulated plane weight
+	struct Quadric
+	{
+		double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+		double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+		double c = 0.0;
+		double weight = 0.0;
+
+		void addPlane (const glm::dvec3 &normal, double distance, double planeWeight)
+		{
+			a00 += planeWeight * normal.x * normal.x;
+			a01 += planeWeight * normal.x * normal.y;
+			a02 += planeWeight * normal.x * normal.z;
+			a11 += planeWeight * normal.y * normal.y;
+			a12 += planeWeight * normal.y * normal.z;
+			a22 += planeWeight * normal.z * normal.z;
+			b0 += planeWeight * normal.x * distance;
+			b1 += planeWeight * normal.y * distance;
+			b2 += planeWeight * normal.z * distance;
+			c += planeWeight * distance * distance;
+			weight += planeWeight;
+		}
+
+		void add (const Quadric &other)
+		{
+			a00 += other.a00;
+			a01 += other.a01;
+			a02 += other.a02;
+			a11 += other.a11;
+			a12 += other.a12;
+			a22 += other.a22;
+			b0 += other.b0;
+			b1 += other.b1;
+			b2 += other.b2;
+			c += other.c;
+			weight += other.weight;
+		}
+
+		// weighted mean squared distance of the point to the accumulated planes
+		double evaluate (const glm::dvec3 &p) const
+		{
+			if (weight <= 0.0)
+			{
+				return 0.0;
+			}
+
+			const double rx = a00 * p.x + a01 * p.y + a02 * p.z + 2.0 * b0;
+			const double ry = a01 * p.x + a11 * p.y + a12 * p.z + 2.0 * b1;
+			const double rz = a02 * p.x + a12 * p.y + a22 * p.z + 2.0 * b2;
+			return std::max(0.0, (rx * p.x + ry * p.y + rz * p.z + c) / weight);
+		}
+	};
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		float error;
+	};
+
+	struct PositionHash
+	{
+		size_t operator() (const glm::vec3 &position) const
+		{
+			return static_cast<size_t>(hashBytes(&position, sizeof(position)));
+		}
+	};
+
+	uint64_t edgeKey (uint32_t a, uint32_t b)
+	{
+		return (uint64_t(a) << 32) | b;
+	}
+}
+
+float CMeshSimplifier::simplify (std::vector<uint32_t> &destination, const std::vector<uint32_t> &indices, const std::vector<CModel::Vertex> &vertices, size_t targetIndexCount, float maxError)
+{
+	destination = indices;
+	const size_t vertexCount = vertices.size();
+	if (indices.size() <= targetIndexCount)
+	{
+		return 0.f;
+	}
+
+	// vertices sharing a position differ in some other attribute, moving one of them would open a crack
+	std::vector<uint32_t> positionIds(vertexCount);
+	std::vector<uint32_t> siblingCounts(vertexCount, 0);
+	{
+		std::unordered_map<glm::vec3, uint32_t, PositionHash> firstVertices {};
+		firstVertices.reserve(vertexCount);
+		for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+		{
+			positionIds[vertex] = firstVertices.emplace(vertices[vertex].position, vertex).first->second;
+			++siblingCounts[positionIds[vertex]];
+		}
+	}
+
+	// an edge is on the border when its opposite half edge does not exist, and non-manifold when a half edge repeats
+	std::unordered_map<uint64_t, uint32_t> halfEdges {};
+	halfEdges.reserve(indices.size());
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			++halfEdges[edgeKey(positionIds[indices[i + corner]], positionIds[indices[i + (corner + 1) % 3]])];
+		}
+	}
+
+	std::vector<VertexKind> kinds(vertexCount, VertexKind::Manifold);
+	std::vector<uint32_t> borderNext(vertexCount, INVALID_INDEX);
+	std::vector<uint32_t> borderPrevious(vertexCount, INVALID_INDEX);
+	for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		if (siblingCounts[positionIds[vertex]] != 1)
+		{
+			kinds[vertex] = VertexKind::Locked;
+		}
+	}
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			const uint32_t a = indices[i + corner];
+			const uint32_t b = indices[i + (corner + 1) % 3];
+			const uint32_t edgeCount = halfEdges[edgeKey(positionIds[a], positionIds[b])];
+			const auto opposite = halfEdges.find(edgeKey(positionIds[b], positionIds[a]));
+
+			if (edgeCount > 1 || (opposite != halfEdges.end() && opposite->second > 1))
+			{
+				kinds[a] = VertexKind::Locked;
+				kinds[b] = VertexKind::Locked;
+			}
+			else if (opposite == halfEdges.end())
+			{
+				// a vertex touching more than one border loop is locked
+				if (borderNext[a] != INVALID_INDEX || borderPrevious[b] != INVALID_INDEX)
+				{
+					kinds[a] = VertexKind::Locked;
+					kinds[b] = VertexKind::Locked;
+				}
+				borderNext[a] = b;
+				borderPrevious[b] = a;
+				for (uint32_t vertex: {a, b})
+				{
+					if (kinds[vertex] == VertexKind::Manifold)
+					{
+						kinds[vertex] = VertexKind::Border;
+					}
+				}
+			}
+		}
+	}
+
+	// area weighted triangle planes, plus planes perpendicular to border edges so borders keep their shape
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		const uint32_t triangle[3] = {indices[i + 0], indices[i + 1], indices[i + 2]};
+		const glm::dvec3 p0 = vertices[triangle[0]].position;
+		const glm::dvec3 p1 = vertices[triangle[1]].position;
+		const glm::dvec3 p2 = vertices[triangle[2]].position;
+
+		glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+		const double area = glm::length(normal);
+		if (area <= 0.0)
+		{
+			continue;
+		}
+		normal /= area;
+
+		Quadric plane {};
+		plane.addPlane(normal, -glm::dot(normal, p0), area * 0.5);
+		for (uint32_t vertex: triangle)
+		{
+			quadrics[positionIds[vertex]].add(plane);
+		}
+
+		for (int corner = 0; corner < 3; ++corner)
+		{
+			const uint32_t a = triangle[corner];
+			const uint32_t b = triangle[(corner + 1) % 3];
+			if (borderNext[a] != b)
+			{
+				continue;
+			}
+
+			const glm::dvec3 pa = vertices[a].position;
+			const glm::dvec3 edge = glm::dvec3 {vertices[b].position} - pa;
+			const double edgeLength = glm::length(edge);
+			if (edgeLength <= 0.0)
+			{
+				continue;
+			}
+
+			const glm::dvec3 borderNormal = glm::normalize(glm::cross(edge, normal));
+			Quadric borderPlane {};
+			borderPlane.addPlane(borderNormal, -glm::dot(borderNormal, pa), edgeLength * edgeLength);
+			quadrics[positionIds[a]].add(borderPlane);
+			quadrics[positionIds[b]].add(borderPlane);
+		}
+	}
+
+	auto canCollapse = [&] (uint32_t from, uint32_t to)
+	{
+		switch (kinds[from])
+		{
+			case VertexKind::Manifold:
+				return true;
+			case VertexKind::Border:
+				return borderNext[from] == to || borderPrevious[from] == to;
+			default:
+				return false;
+		}
+	};
+
+	const double maxErrorSquared = double(maxError) * double(maxError);
+	double resultError = 0.0;
+
+	std::vector<Collapse> collapses {};
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<uint8_t> touched(vertexCount);
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency {};
+
+	while (destination.size() > targetIndexCount)
+	{
+		collapses.clear();
+		for (size_t i = 0; i < destination.size(); i += 3)
+		{
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				const uint32_t a = destination[i + corner];
+				const uint32_t b = destination[i + (corner + 1) % 3];
+				for (const auto &[from, to]: {std::pair {a, b}, std::pair {b, a}})
+				{
+					if (!canCollapse(from, to))
+					{
+						continue;
+					}
+
+					Quadric quadric = quadrics[positionIds[from]];
+					quadric.add(quadrics[positionIds[to]]);
+					const double error = quadric.evaluate(vertices[to].position);
+					if (error <= maxErrorSquared)
+					{
+						collapses.push_back({from, to, float(error)});
+					}
+				}
+			}
+		}
+
+		if (collapses.empty())
+		{
+			break;
+		}
+		std::sort(collapses.begin(), collapses.end(), [] (const Collapse &a, const Collapse &b)
+		{
+			return a.error < b.error;
+		});
+
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (uint32_t index: destination)
+		{
+			++adjacencyOffsets[index + 1];
+		}
+		for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+		{
+			adjacencyOffsets[vertex + 1] += adjacencyOffsets[vertex];
+		}
+		adjacency.resize(destination.size());
+		{
+			std::vector<uint32_t> fillOffsets(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t i = 0; i < destination.size(); ++i)
+			{
+				adjacency[fillOffsets[destination[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+		{
+			remap[vertex] = vertex;
+		}
+		std::fill(touched.begin(), touched.end(), 0);
+
+		// apply the cheapest collapses whose neighbourhoods do not overlap, estimating the triangles removed
+		const size_t trianglesToRemove = (destination.size() - targetIndexCount + 2) / 3;
+		size_t trianglesRemoved = 0;
+		size_t collapsesDone = 0;
+
+		for (const Collapse &collapse: collapses)
+		{
+			if (touched[collapse.from] || touched[collapse.to])
+			{
+				continue;
+			}
+
+			// reject collapses that would flip a triangle around the removed vertex
+			const glm::vec3 &target = vertices[collapse.to].position;
+			bool flips = false;
+			for (uint32_t j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1] && !flips; ++j)
+			{
+				const uint32_t *triangle = &destination[3 * adjacency[j]];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+				{
+					continue;
+				}
+
+				glm::vec3 before[3];
+				glm::vec3 after[3];
+				for (int corner = 0; corner < 3; ++corner)
+				{
+					before[corner] = vertices[triangle[corner]].position;
+					after[corner] = triangle[corner] == collapse.from ? target : before[corner];
+				}
+
+				const glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+				const glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+				flips = glm::dot(normalBefore, normalAfter) <= 0.f;
+			}
+
+			if (flips)
+			{
+				continue;
+			}
+
+			remap[collapse.from] = collapse.to;
+			quadrics[positionIds[collapse.to]].add(quadrics[positionIds[collapse.from]]);
+
+			// the border skips the removed vertex, so the next edge along it can collapse in a later pass
+			if (kinds[collapse.from] == VertexKind::Border)
+			{
+				if (borderNext[collapse.from] == collapse.to)
+				{
+					const uint32_t previous = borderPrevious[collapse.from];
+					if (previous != INVALID_INDEX && previous != collapse.to)
+					{
+						borderNext[previous] = collapse.to;
+						borderPrevious[collapse.to] = previous;
+					}
+				}
+				else
+				{
+					const uint32_t next = borderNext[collapse.from];
+					if (next != INVALID_INDEX && next != collapse.to)
+					{
+						borderPrevious[next] = collapse.to;
+						borderNext[collapse.to] = next;
+					}
+				}
+				borderNext[collapse.from] = INVALID_INDEX;
+				borderPrevious[collapse.from] = INVALID_INDEX;
+			}
+			resultError = std::max(resultError, double(collapse.error));
+
+			for (uint32_t j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1]; ++j)
+			{
+				const uint32_t *triangle = &destination[3 * adjacency[j]];
+				touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+			}
+
+			++collapsesDone;
+			trianglesRemoved += kinds[collapse.from] == VertexKind::Border ? 1 : 2;
+			if (trianglesRemoved >= trianglesToRemove)
+			{
+				break;
+			}
+		}
+
+		if (collapsesDone == 0)
+		{
+			break;
+		}
+
+		size_t writeOffset = 0;
+		for (size_t i = 0; i < destination.size(); i += 3)
+		{
+			const uint32_t a = remap[destination[i + 0]];
+			const uint32_t b = remap[destination[i + 1]];
+			const uint32_t c = remap[destination[i + 2]];
+			if (a == b || b == c || c == a)
+			{
+				continue;
+			}
+
+			destination[writeOffset + 0] = a;
+			destination[writeOffset + 1] = b;
+			destination[writeOffset + 2] = c;
+			writeOffset += 3;
+		}
+		destination.resize(writeOffset);
+	}
+
+	return static_cast<float>(std::sqrt(resultError));
+}
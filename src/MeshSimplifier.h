@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Model.h"
+
+// std
+#include <cstdint>
+#include <vector>
+
+
+// Quadric error edge-collapse simplification (Garland and Heckbert) that only removes vertices, so the
+// result indexes into the same vertex array as the input. Vertices on attribute seams and non-manifold
+// edges stay in place, open borders only collapse along the border.
+class CMeshSimplifier
+{
+public:
+	// collapses edges cheapest first until the index count reaches targetIndexCount or the next collapse would
+	// move the surface further than maxError in model space, returns the largest error of the collapses done
+	static float simplify (std::vector<uint32_t> &destination, const std::vector<uint32_t> &indices, const std::vector<CModel::Vertex> &vertices, size_t targetIndexCount, float maxError);
+};
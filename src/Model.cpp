@@ -1,78 +1,104 @@
 #include "Model.h"
 
-#include "Utils.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ModelLoader.h"
+#include "ObjLoader.h"
+#include "VertexWelder.h"
 
 // libs
-#define TINYOBJLOADER_IMPLEMENTATION
-
 #include <tiny_obj_loader.h>
 
-#define GLM_ENABLE_EXPERIMENTAL
-
-#include <glm/gtx/hash.hpp>
-
 // std
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstring>
-#include <unordered_map>
+#include <iostream>
 
-#ifndef ENGINE_DIR
-#define ENGINE_DIR "../"
-#endif
 
-namespace std
+CModel::CModel (CDevice &device, CGeometryPool &geometryPool, CUploadManager &uploadManager, const CModel::Builder &builder, VertexLayout layout)
+	: CModel {device, geometryPool, uploadManager, builder.getMeshData(), layout}
 {
-	template<> struct hash<CModel::Vertex>
-	{
-		size_t operator() (CModel::Vertex const &vertex) const
-		{
-			size_t seed = 0;
-			hashCombine(seed, vertex.position, vertex.color, vertex.normal, vertex.uv);
-			return seed;
-		}
-	};
-}  // namespace std
-
-
+}
 
-CModel::CModel (CDevice &device, const CModel::Builder &builder)
-	: Device {device}
+CModel::CModel (CDevice &device, CGeometryPool &geometryPool, CUploadManager &uploadManager, const MeshData &data, VertexLayout layout)
+	: Device {device}, GeometryPool {geometryPool}, vertexLayout {layout}, lods {data.lods, data.lods + data.lodCount}, meshlets {data.meshlets, data.meshlets + data.meshletCount}
 {
-	createVertexBuffers(builder.vertices);
-	createIndexBuffers(builder.indices);
+	if (lods.empty())
+	{
+		lods.push_back({0, data.indexCount, 0.f, 0, 0});
+	}
+
+	computeBounds(data.vertices, data.vertexCount);
+	if (vertexLayout == VertexLayout::Packed)
+	{
+		createPackedVertexBuffers(data.vertices, data.vertexCount, uploadManager);
+	}
+	else
+	{
+		createVertexBuffers(data.vertices, data.vertexCount, uploadManager);
+	}
+	createIndexBuffers(data.indices, data.indexCount, uploadManager);
 }
 
 CModel::~CModel ()
 {
+	GeometryPool.freeVertices(vertexRange);
+	if (hasIndexBuffer)
+	{
+		GeometryPool.freeIndices(indexType, indexRange);
+	}
 }
 
-std::unique_ptr<CModel> CModel::createModelFromFile (CDevice &device, const std::string &filepath)
+std::unique_ptr<CModel> CModel::createModelFromFile (CDevice &device, CGeometryPool &geometryPool, CUploadManager &uploadManager, CWorkerPool &workerPool, const std::string &filepath, VertexLayout layout)
 {
-	Builder builder {};
-	builder.loadModel(ENGINE_DIR + filepath);
-	return std::make_unique<CModel>(device, builder);
+	std::unique_ptr<CImportedMesh> mesh = CModelLoader::importMesh(filepath, workerPool);
+	return std::make_unique<CModel>(device, geometryPool, uploadManager, mesh->getMeshData(), layout);
 }
 
-void CModel::createVertexBuffers (const std::vector<Vertex> &vertices)
+void CModel::createVertexBuffers (const Vertex *vertices, uint32_t count, CUploadManager &uploadManager)
 {
-	vertexCount = static_cast<uint32_t>(vertices.size());
+	vertexCount = count;
 	assert(vertexCount >= 3 && "Vertex count must be at least 3");
-	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertexCount;
-	uint32_t vertexSize = sizeof(vertices[0]);
-
-	CBuffer stagingBuffer {Device, vertexSize, vertexCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,};
+	vertexRange = GeometryPool.allocateVertices(sizeof(Vertex), count);
+	vertexOffset = static_cast<int32_t>(vertexRange.offset / sizeof(Vertex));
+	uploadManager.uploadBuffer(vertices, vertexRange.size, GeometryPool.getVertexBuffer(vertexRange.block), vertexRange.offset);
+}
 
-	stagingBuffer.map();
-	stagingBuffer.writeToBuffer((void *) vertices.data());
+void CModel::createPackedVertexBuffers (const Vertex *vertices, uint32_t count, CUploadManager &uploadManager)
+{
+	vertexCount = count;
+	assert(vertexCount >= 3 && "Vertex count must be at least 3");
 
-	vertexBuffer = std::make_unique<CBuffer>(Device, vertexSize, vertexCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	glm::vec3 boundsMin = vertices[0].position;
+	glm::vec3 boundsMax = vertices[0].position;
+	for (uint32_t i = 1; i < count; ++i)
+	{
+		boundsMin = glm::min(boundsMin, vertices[i].position);
+		boundsMax = glm::max(boundsMax, vertices[i].position);
+	}
 
-	Device.copyBuffer(stagingBuffer.getBuffer(), vertexBuffer->getBuffer(), bufferSize);
+	const glm::vec3 boundsExtent = boundsMax - boundsMin;
+	dequantization = glm::mat4 {1.f};
+	dequantization[0][0] = boundsExtent.x;
+	dequantization[1][1] = boundsExtent.y;
+	dequantization[2][2] = boundsExtent.z;
+	dequantization[3] = glm::vec4 {boundsMin, 1.f};
+
+	// packed straight into the staging memory
+	vertexRange = GeometryPool.allocateVertices(sizeof(PackedVertex), count);
+	vertexOffset = static_cast<int32_t>(vertexRange.offset / sizeof(PackedVertex));
+	auto *packedVertices = static_cast<PackedVertex *>(uploadManager.stageBuffer(vertexRange.size, GeometryPool.getVertexBuffer(vertexRange.block), vertexRange.offset));
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		packedVertices[i] = PackedVertex::pack(vertices[i], boundsMin, boundsExtent);
+	}
 }
 
-void CModel::createIndexBuffers (const std::vector<uint32_t> &indices)
+void CModel::createIndexBuffers (const uint32_t *indices, uint32_t count, CUploadManager &uploadManager)
 {
-	indexCount = static_cast<uint32_t>(indices.size());
+	indexCount = count;
 	hasIndexBuffer = indexCount > 0;
 
 	if (!hasIndexBuffer)
@@ -80,40 +106,71 @@ void CModel::createIndexBuffers (const std::vector<uint32_t> &indices)
 		return;
 	}
 
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indexCount;
-	uint32_t indexSize = sizeof(indices[0]);
-
-	CBuffer stagingBuffer {Device, indexSize, indexCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,};
+	// every index of a mesh with less than 65536 vertices fits in 16 bits
+	if (vertexCount < 65536)
+	{
+		indexType = VK_INDEX_TYPE_UINT16;
+		indexRange = GeometryPool.allocateIndices(indexType, indexCount);
+		firstPoolIndex = static_cast<uint32_t>(indexRange.offset / sizeof(uint16_t));
+		auto *shortIndices = static_cast<uint16_t *>(uploadManager.stageBuffer(indexRange.size, GeometryPool.getIndexBuffer(indexType, indexRange.block), indexRange.offset));
+		std::copy(indices, indices + indexCount, shortIndices);
+	}
+	else
+	{
+		indexType = VK_INDEX_TYPE_UINT32;
+		indexRange = GeometryPool.allocateIndices(indexType, indexCount);
+		firstPoolIndex = static_cast<uint32_t>(indexRange.offset / sizeof(uint32_t));
+		uploadManager.uploadBuffer(indices, indexRange.size, GeometryPool.getIndexBuffer(indexType, indexRange.block), indexRange.offset);
+	}
+}
 
-	stagingBuffer.map();
-	stagingBuffer.writeToBuffer((void *) indices.data());
+void CModel::computeBounds (const Vertex *vertices, uint32_t count)
+{
+	if (count == 0)
+	{
+		return;
+	}
 
-	indexBuffer = std::make_unique<CBuffer>(Device, indexSize, indexCount, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	glm::vec3 boundsMin = vertices[0].position;
+	glm::vec3 boundsMax = vertices[0].position;
+	for (uint32_t i = 1; i < count; ++i)
+	{
+		boundsMin = glm::min(boundsMin, vertices[i].position);
+		boundsMax = glm::max(boundsMax, vertices[i].position);
+	}
 
-	Device.copyBuffer(stagingBuffer.getBuffer(), indexBuffer->getBuffer(), bufferSize);
+	boundsCenter = (boundsMin + boundsMax) * 0.5f;
+	boundsRadius = 0.f;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		boundsRadius = glm::max(boundsRadius, glm::length(vertices[i].position - boundsCenter));
+	}
 }
 
-void CModel::draw (VkCommandBuffer commandBuffer)
+void CModel::draw (VkCommandBuffer commandBuffer, uint32_t lod, uint32_t instanceCount, uint32_t firstInstance)
 {
 	if (hasIndexBuffer)
 	{
-		vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+		drawIndexRange(commandBuffer, lods[lod].firstIndex, lods[lod].indexCount, instanceCount, firstInstance);
 	}
 	else
 	{
-		vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+		vkCmdDraw(commandBuffer, vertexCount, instanceCount, static_cast<uint32_t>(vertexOffset), firstInstance);
 	}
 }
 
+void CModel::drawIndexRange (VkCommandBuffer commandBuffer, uint32_t firstIndex, uint32_t count, uint32_t instanceCount, uint32_t firstInstance)
+{
+	vkCmdDrawIndexed(commandBuffer, count, instanceCount, firstPoolIndex + firstIndex, vertexOffset, firstInstance);
+}
+
 void CModel::bind (VkCommandBuffer commandBuffer)
 {
-	VkBuffer buffers[] = {vertexBuffer->getBuffer()};
-	VkDeviceSize offsets[] = {0};
-	vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+	GeometryPool.bindVertexBuffer(commandBuffer, vertexRange.block);
 
 	if (hasIndexBuffer)
 	{
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+		GeometryPool.bindIndexBuffer(commandBuffer, indexType, indexRange.block);
 	}
 }
 
@@ -138,7 +195,124 @@ std::vector<VkVertexInputAttributeDescription> CModel::Vertex::getAttributeDescr
 	return attributeDescriptions;
 }
 
-void CModel::Builder::loadModel (const std::string &filepath)
+// octahedral mapping of a unit vector onto [-1, 1]^2, decoded by octahedralDecode in packed_shader.vert
+static glm::vec2 octahedralEncode (const glm::vec3 &normal)
+{
+	const float length = glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z);
+	if (length == 0.f)
+	{
+		return glm::vec2 {0.f};
+	}
+
+	glm::vec2 encoded = glm::vec2 {normal.x, normal.y} / length;
+	if (normal.z < 0.f)
+	{
+		const glm::vec2 sign {encoded.x >= 0.f ? 1.f : -1.f, encoded.y >= 0.f ? 1.f : -1.f};
+		encoded = (glm::vec2 {1.f} - glm::abs(glm::vec2 {encoded.y, encoded.x})) * sign;
+	}
+	return encoded;
+}
+
+CModel::PackedVertex CModel::PackedVertex::pack (const Vertex &vertex, const glm::vec3 &boundsMin, const glm::vec3 &boundsExtent)
+{
+	PackedVertex packed {};
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float normalized = boundsExtent[axis] > 0.f ? (vertex.position[axis] - boundsMin[axis]) / boundsExtent[axis] : 0.f;
+		packed.position[axis] = static_cast<uint16_t>(glm::round(glm::clamp(normalized, 0.f, 1.f) * 65535.f));
+	}
+	packed.position[3] = 0;
+
+	packed.normal = glm::packSnorm2x16(octahedralEncode(vertex.normal));
+	packed.color = glm::packUnorm4x8(glm::vec4 {vertex.color, 1.f});
+	packed.uv = glm::packHalf2x16(vertex.uv);
+	return packed;
+}
+
+std::vector<VkVertexInputBindingDescription> CModel::PackedVertex::getBindingDescriptions ()
+{
+	std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
+	bindingDescriptions[0].binding = 0;
+	bindingDescriptions[0].stride = sizeof(PackedVertex);
+	bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	return bindingDescriptions;
+}
+
+std::vector<VkVertexInputAttributeDescription> CModel::PackedVertex::getAttributeDescriptions ()
+{
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions {};
+
+	attributeDescriptions.push_back({0, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(PackedVertex, position)});
+	attributeDescriptions.push_back({1, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(PackedVertex, color)});
+	attributeDescriptions.push_back({2, 0, VK_FORMAT_R16G16_SNORM, offsetof(PackedVertex, normal)});
+	attributeDescriptions.push_back({3, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(PackedVertex, uv)});
+
+	return attributeDescriptions;
+}
+
+std::vector<VkVertexInputBindingDescription> CModel::getBindingDescriptions (VertexLayout layout)
+{
+	return layout == VertexLayout::Packed ? PackedVertex::getBindingDescriptions() : Vertex::getBindingDescriptions();
+}
+
+std::vector<VkVertexInputAttributeDescription> CModel::getAttributeDescriptions (VertexLayout layout)
+{
+	return layout == VertexLayout::Packed ? PackedVertex::getAttributeDescriptions() : Vertex::getAttributeDescriptions();
+}
+
+static void buildVertices (const tinyobj::attrib_t &attrib, const std::vector<tinyobj::index_t> &corners, CVertexWelder &welder, CModel::Builder &builder)
+{
+	for (const auto &index: corners)
+	{
+		CModel::Vertex vertex {};
+
+		if (index.vertex_index >= 0)
+		{
+			vertex.position = {attrib.vertices[3 * index.vertex_index + 0], attrib.vertices[3 * index.vertex_index + 1], attrib.vertices[3 * index.vertex_index + 2],};
+
+			vertex.color = {attrib.colors[3 * index.vertex_index + 0], attrib.colors[3 * index.vertex_index + 1], attrib.colors[3 * index.vertex_index + 2],};
+		}
+
+		if (index.normal_index >= 0)
+		{
+			vertex.normal = {attrib.normals[3 * index.normal_index + 0], attrib.normals[3 * index.normal_index + 1], attrib.normals[3 * index.normal_index + 2],};
+		}
+
+		if (index.texcoord_index >= 0)
+		{
+			vertex.uv = {attrib.texcoords[2 * index.texcoord_index + 0], attrib.texcoords[2 * index.texcoord_index + 1],};
+		}
+
+		builder.indices.push_back(welder.weld(vertex));
+	}
+}
+
+void CModel::Builder::loadModel (const std::string &filepath, CWorkerPool &workerPool)
+{
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::index_t> corners;
+	std::string warn;
+
+	if (!CObjLoader::load(filepath, attrib, corners, warn, workerPool))
+	{
+		loadModelSerial(filepath);
+		return;
+	}
+	if (!warn.empty())
+	{
+		std::cout << "model: " << filepath << ": " << warn;
+	}
+
+	vertices.clear();
+	indices.clear();
+
+	indices.reserve(corners.size());
+	CVertexWelder welder {vertices, corners.size(), weldGridStep};
+	buildVertices(attrib, corners, welder, *this);
+}
+
+void CModel::Builder::loadModelSerial (const std::string &filepath)
 {
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
@@ -150,41 +324,243 @@ void CModel::Builder::loadModel (const std::string &filepath)
 		throw std::runtime_error(warn + err);
 	}
 
+	// tinyobj keeps triangles whose indices are out of range, only its quads are checked
+	size_t skippedFaceCount = 0;
+	for (auto &shape: shapes)
+	{
+		std::vector<tinyobj::index_t> &corners = shape.mesh.indices;
+		size_t kept = 0;
+		for (size_t i = 0; i + 2 < corners.size(); i += 3)
+		{
+			if (CObjLoader::isValidCorner(corners[i], attrib) && CObjLoader::isValidCorner(corners[i + 1], attrib) && CObjLoader::isValidCorner(corners[i + 2], attrib))
+			{
+				std::copy(corners.begin() + i, corners.begin() + i + 3, corners.begin() + kept);
+				kept += 3;
+			}
+			else
+			{
+				++skippedFaceCount;
+			}
+		}
+		corners.resize(kept);
+	}
+	if (skippedFaceCount > 0)
+	{
+		warn += std::to_string(skippedFaceCount) + " faces with invalid vertex index skipped.\n";
+	}
+	if (!warn.empty())
+	{
+		std::cout << "model: " << filepath << ": " << warn;
+	}
+
 	vertices.clear();
 	indices.clear();
 
-	std::unordered_map<Vertex, uint32_t> uniqueVertices {};
+	size_t cornerCount = 0;
+	for (const auto &shape: shapes)
+	{
+		cornerCount += shape.mesh.indices.size();
+	}
+
+	indices.reserve(cornerCount);
+	CVertexWelder welder {vertices, cornerCount, weldGridStep};
 	for (const auto &shape: shapes)
 	{
-		for (const auto &index: shape.mesh.indices)
+		buildVertices(attrib, shape.mesh.indices, welder, *this);
+	}
+}
+
+void CModel::Builder::optimize (bool reduceOverdraw)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	const CMeshOptimizer::Stats before = CMeshOptimizer::analyze(indices, vertices.size());
+
+	CMeshOptimizer::optimizeVertexCache(indices, vertices.size());
+	if (reduceOverdraw)
+	{
+		CMeshOptimizer::optimizeOverdraw(indices, vertices);
+	}
+	CMeshOptimizer::optimizeVertexFetch(vertices, indices);
+
+	const CMeshOptimizer::Stats after = CMeshOptimizer::analyze(indices, vertices.size());
+	float optimizeTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+	std::cout << "mesh optimize: ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << " in " << optimizeTime << " ms" << std::endl;
+}
+
+void CModel::Builder::generateLods (uint32_t maxLodCount, float reduction, float maxError)
+{
+	lods.assign(1, {0, static_cast<uint32_t>(indices.size()), 0.f, 0, 0});
+	meshlets.clear();
+	if (vertices.empty() || indices.empty())
+	{
+		return;
+	}
+
+	glm::vec3 boundsMin = vertices[0].position;
+	glm::vec3 boundsMax = vertices[0].position;
+	for (const Vertex &vertex: vertices)
+	{
+		boundsMin = glm::min(boundsMin, vertex.position);
+		boundsMax = glm::max(boundsMax, vertex.position);
+	}
+	const float errorLimit = maxError * glm::length(boundsMax - boundsMin);
+
+	// each level is simplified from the previous one, so the errors of the steps add up
+	std::vector<uint32_t> previousIndices = indices;
+	std::vector<uint32_t> lodIndices {};
+	for (uint32_t level = 1; level < maxLodCount; ++level)
+	{
+		const size_t targetIndexCount = static_cast<size_t>(previousIndices.size() / 3 * reduction) * 3;
+		const float remainingError = errorLimit - lods.back().error;
+		const float error = CMeshSimplifier::simplify(lodIndices, previousIndices, vertices, targetIndexCount, remainingError);
+
+		// not worth a level if it barely removes anything
+		if (lodIndices.empty() || lodIndices.size() * 10 > previousIndices.size() * 9)
+		{
+			break;
+		}
+
+		CMeshOptimizer::optimizeVertexCache(lodIndices, vertices.size());
+		lods.push_back({static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(lodIndices.size()), lods.back().error + error, 0, 0});
+		indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+		previousIndices.swap(lodIndices);
+	}
+
+	std::cout << "mesh lods:";
+	for (const Lod &lod: lods)
+	{
+		std::cout << " " << lod.indexCount / 3;
+	}
+	std::cout << " triangles" << std::endl;
+}
+
+void CModel::Builder::buildMeshlets (uint32_t maxVertices, uint32_t maxTriangles)
+{
+	if (lods.empty())
+	{
+		lods.push_back({0, static_cast<uint32_t>(indices.size()), 0.f, 0, 0});
+	}
+	meshlets.clear();
+
+	std::vector<uint32_t> meshletVertices {};
+	std::vector<uint8_t> inMeshlet(vertices.size(), 0);
+
+	auto finishMeshlet = [&] (uint32_t firstIndex, uint32_t endIndex)
+	{
+		Meshlet meshlet {};
+		meshlet.firstIndex = firstIndex;
+		meshlet.indexCount = endIndex - firstIndex;
+
+		glm::vec3 boundsMin = vertices[meshletVertices[0]].position;
+		glm::vec3 boundsMax = boundsMin;
+		for (uint32_t vertex: meshletVertices)
 		{
-			Vertex vertex {};
+			boundsMin = glm::min(boundsMin, vertices[vertex].position);
+			boundsMax = glm::max(boundsMax, vertices[vertex].position);
+			inMeshlet[vertex] = 0;
+		}
 
-			if (index.vertex_index >= 0)
+		meshlet.center = (boundsMin + boundsMax) * 0.5f;
+		meshlet.radius = 0.f;
+		for (uint32_t vertex: meshletVertices)
+		{
+			meshlet.radius = glm::max(meshlet.radius, glm::length(vertices[vertex].position - meshlet.center));
+		}
+		meshletVertices.clear();
+
+		// the cone axis is the average triangle normal, the cutoff comes from the normal furthest away from it
+		std::vector<glm::vec3> normals {};
+		glm::vec3 normalSum {0.f};
+		for (uint32_t i = firstIndex; i < endIndex; i += 3)
+		{
+			const glm::vec3 &p0 = vertices[indices[i + 0]].position;
+			const glm::vec3 &p1 = vertices[indices[i + 1]].position;
+			const glm::vec3 &p2 = vertices[indices[i + 2]].position;
+			const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			const float length = glm::length(normal);
+			if (length > 0.f)
 			{
-				vertex.position = {attrib.vertices[3 * index.vertex_index + 0], attrib.vertices[3 * index.vertex_index + 1], attrib.vertices[3 * index.vertex_index + 2],};
+				normals.push_back(normal / length);
+				normalSum += normals.back();
+			}
+		}
+
+		meshlet.coneAxis = glm::vec3 {0.f};
+		meshlet.coneCutoff = 1.f;
+		const float sumLength = glm::length(normalSum);
+		if (sumLength > 0.f)
+		{
+			meshlet.coneAxis = normalSum / sumLength;
 
-				vertex.color = {attrib.colors[3 * index.vertex_index + 0], attrib.colors[3 * index.vertex_index + 1], attrib.colors[3 * index.vertex_index + 2],};
+			float minDot = 1.f;
+			for (const glm::vec3 &normal: normals)
+			{
+				minDot = glm::min(minDot, glm::dot(normal, meshlet.coneAxis));
 			}
 
-			if (index.normal_index >= 0)
+			// cones wider than about 84 degrees would almost never cull
+			if (minDot > 0.1f)
 			{
-				vertex.normal = {attrib.normals[3 * index.normal_index + 0], attrib.normals[3 * index.normal_index + 1], attrib.normals[3 * index.normal_index + 2],};
+				meshlet.coneCutoff = glm::sqrt(1.f - minDot * minDot);
 			}
+		}
+
+		meshlets.push_back(meshlet);
+	};
+
+	for (Lod &lod: lods)
+	{
+		lod.firstMeshlet = static_cast<uint32_t>(meshlets.size());
 
-			if (index.texcoord_index >= 0)
+		uint32_t meshletStart = lod.firstIndex;
+		const uint32_t lodEnd = lod.firstIndex + lod.indexCount;
+		for (uint32_t i = lod.firstIndex; i < lodEnd; i += 3)
+		{
+			const uint32_t *triangle = &indices[i];
+			uint32_t newVertices = 0;
+			for (uint32_t corner = 0; corner < 3; ++corner)
+			{
+				const bool repeated = (corner > 0 && triangle[corner] == triangle[0]) || (corner > 1 && triangle[corner] == triangle[1]);
+				newVertices += inMeshlet[triangle[corner]] || repeated ? 0 : 1;
+			}
+
+			if (i > meshletStart && (meshletVertices.size() + newVertices > maxVertices || (i - meshletStart) / 3 >= maxTriangles))
 			{
-				vertex.uv = {attrib.texcoords[2 * index.texcoord_index + 0], attrib.texcoords[2 * index.texcoord_index + 1],};
+				finishMeshlet(meshletStart, i);
+				meshletStart = i;
 			}
 
-			if (uniqueVertices.count(vertex) == 0)
+			for (uint32_t corner = 0; corner < 3; ++corner)
 			{
-				uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-				vertices.push_back(vertex);
+				const uint32_t vertex = triangle[corner];
+				if (!inMeshlet[vertex])
+				{
+					inMeshlet[vertex] = 1;
+					meshletVertices.push_back(vertex);
+				}
 			}
-			indices.push_back(uniqueVertices[vertex]);
 		}
+
+		if (lodEnd > meshletStart)
+		{
+			finishMeshlet(meshletStart, lodEnd);
+		}
+		lod.meshletCount = static_cast<uint32_t>(meshlets.size()) - lod.firstMeshlet;
 	}
-}
 
+	std::cout << "mesh meshlets: " << meshlets.size() << " across " << lods.size() << " lods" << std::endl;
+}
 
+CModel::MeshData CModel::Builder::getMeshData () const
+{
+	MeshData data {};
+	data.vertices = vertices.data();
+	data.vertexCount = static_cast<uint32_t>(vertices.size());
+	data.indices = indices.data();
+	data.indexCount = static_cast<uint32_t>(indices.size());
+	data.lods = lods.data();
+	data.lodCount = static_cast<uint32_t>(lods.size());
+	data.meshlets = meshlets.data();
+	data.meshletCount = static_cast<uint32_t>(meshlets.size());
+	return data;
+}
@@ -2,6 +2,9 @@
 
 #include "Buffer.h"
 #include "Device.h"
+#include "GeometryPool.h"
+#include "UploadManager.h"
+#include "WorkerPool.h"
 
 // libs
 #define GLM_FORCE_RADIANS
@@ -17,6 +20,12 @@
 class CModel
 {
 public:
+	enum class VertexLayout
+	{
+		Full,
+		Packed
+	};
+
 	struct Vertex
 	{
 		glm::vec3 position {};
@@ -34,36 +43,218 @@ public:
 		}
 	};
 
+	// 20 byte vertex: unorm16 position inside the mesh bounds, octahedral snorm16 normal, unorm8 color, half uv
+	struct PackedVertex
+	{
+		uint16_t position[4];
+		uint32_t normal;
+		uint32_t color;
+		uint32_t uv;
+
+		static PackedVertex pack (const Vertex &vertex, const glm::vec3 &boundsMin, const glm::vec3 &boundsExtent);
+
+		static std::vector<VkVertexInputBindingDescription> getBindingDescriptions ();
+
+		static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions ();
+	};
+
+	// index range of one level of detail, all levels share the vertex buffer
+	struct Lod
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		// largest distance between this level and the full detail surface, in model space
+		float error;
+		uint32_t firstMeshlet;
+		uint32_t meshletCount;
+	};
+
+	// contiguous run of triangles with a bounding sphere and a cone containing all triangle normals
+	struct Meshlet
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		glm::vec3 center;
+		float radius;
+		glm::vec3 coneAxis;
+		// sin of the cone half angle, 1 when the normals spread too much to ever cull
+		float coneCutoff;
+
+		// true when every triangle faces away from the camera, all positions and axes in the same space
+		bool isBackFacing (const glm::vec3 &cameraPosition) const
+		{
+			const glm::vec3 offset = center - cameraPosition;
+			return glm::dot(offset, coneAxis) >= coneCutoff * glm::length(offset) + radius;
+		}
+	};
+
+	// non-owning view of everything uploaded for a mesh
+	struct MeshData
+	{
+		const Vertex *vertices = nullptr;
+		uint32_t vertexCount = 0;
+		const uint32_t *indices = nullptr;
+		uint32_t indexCount = 0;
+		const Lod *lods = nullptr;
+		uint32_t lodCount = 0;
+		const Meshlet *meshlets = nullptr;
+		uint32_t meshletCount = 0;
+	};
+
+	// how an imported source file is processed into mesh data, the defaults of the Builder steps
+	struct ImportSettings
+	{
+		float weldGridStep = 0.0f;
+		bool reduceOverdraw = true;
+		uint32_t maxLodCount = 4;
+		float lodReduction = 0.5f;
+		float lodMaxError = 0.02f;
+		uint32_t meshletMaxVertices = 64;
+		uint32_t meshletMaxTriangles = 124;
+	};
+
 	struct Builder
 	{
 		std::vector<Vertex> vertices {};
 		std::vector<uint32_t> indices {};
+		// empty means a single level covering all indices
+		std::vector<Lod> lods {};
+		std::vector<Meshlet> meshlets {};
+
+		// vertices whose attributes all round to the same multiple of weldGridStep are merged, 0 welds exact matches
+		// only, see CVertexWelder
+		float weldGridStep = 0.0f;
+
+		// parses on worker threads, falls back to loadModelSerial for files the parallel parser does not handle
+		void loadModel (const std::string &filepath, CWorkerPool &workerPool);
+
+		void loadModelSerial (const std::string &filepath);
+
+		// reorders triangles for vertex cache reuse and optionally overdraw, then vertices into first use order
+		void optimize (bool reduceOverdraw = true);
+
+		// appends up to maxLodCount - 1 simplified levels after the current indices, each with about reduction times
+		// the triangles of the previous one, stopping once the error would exceed maxError times the mesh diagonal
+		void generateLods (uint32_t maxLodCount = 4, float reduction = 0.5f, float maxError = 0.02f);
 
-		void loadModel (const std::string &filepath);
+		// splits the triangles of every level, in their current order, into meshlets of bounded size
+		void buildMeshlets (uint32_t maxVertices = 64, uint32_t maxTriangles = 124);
+
+		MeshData getMeshData () const;
 	};
 
-	CModel (CDevice &device, const CModel::Builder &builder);
+	CModel (CDevice &device, CGeometryPool &geometryPool, CUploadManager &uploadManager, const CModel::Builder &builder, VertexLayout layout = VertexLayout::Full);
+
+	// the geometry is staged in the upload manager and can be drawn once its next submit has been called
+	CModel (CDevice &device, CGeometryPool &geometryPool, CUploadManager &uploadManager, const MeshData &data, VertexLayout layout = VertexLayout::Full);
 
 	~CModel ();
 
-	static std::unique_ptr<CModel> createModelFromFile (CDevice &device, const std::string &filepath);
+	static std::unique_ptr<CModel> createModelFromFile (CDevice &device, CGeometryPool &geometryPool, CUploadManager &uploadManager, CWorkerPool &workerPool, const std::string &filepath, VertexLayout layout = VertexLayout::Full);
+
+	static std::vector<VkVertexInputBindingDescription> getBindingDescriptions (VertexLayout layout);
+
+	static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions (VertexLayout layout);
+
+	VertexLayout getVertexLayout () const
+	{
+		return vertexLayout;
+	}
+
+	// maps the quantized positions of a packed mesh back to model space, identity for the full layout
+	const glm::mat4 &getDequantization () const
+	{
+		return dequantization;
+	}
+
+	uint32_t getLodCount () const
+	{
+		return static_cast<uint32_t>(lods.size());
+	}
+
+	const Lod &getLod (uint32_t lod) const
+	{
+		return lods[lod];
+	}
+
+	const Meshlet *getMeshlets (uint32_t lod) const
+	{
+		return meshlets.data() + lods[lod].firstMeshlet;
+	}
+
+	// bounding sphere of the vertex positions in model space
+	const glm::vec3 &getBoundsCenter () const
+	{
+		return boundsCenter;
+	}
 
+	float getBoundsRadius () const
+	{
+		return boundsRadius;
+	}
+
+	bool hasIndices () const
+	{
+		return hasIndexBuffer;
+	}
+
+	VkIndexType getIndexType () const
+	{
+		return indexType;
+	}
+
+	// geometry pool blocks of the vertex and index ranges, both are 0 unless the first block was full
+	uint32_t getVertexBlock () const
+	{
+		return vertexRange.block;
+	}
+
+	uint32_t getIndexBlock () const
+	{
+		return indexRange.block;
+	}
+
+	// binds the shared pool buffers, models drawn one after another only need the index buffer rebound when the index
+	// type or a block changes
 	void bind (VkCommandBuffer commandBuffer);
 
-	void draw (VkCommandBuffer commandBuffer);
+	// firstInstance selects the per object data of the first instance, the others follow it
+	void draw (VkCommandBuffer commandBuffer, uint32_t lod = 0, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+
+	void drawIndexRange (VkCommandBuffer commandBuffer, uint32_t firstIndex, uint32_t count, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+
+	// the indexed draw of a whole lod as an indirect command, only for models with indices
+	VkDrawIndexedIndirectCommand getIndirectCommand (uint32_t lod, uint32_t instanceCount, uint32_t firstInstance) const
+	{
+		return {lods[lod].indexCount, instanceCount, firstPoolIndex + lods[lod].firstIndex, vertexOffset, firstInstance};
+	}
 
 private:
-	void createVertexBuffers (const std::vector<Vertex> &vertices);
+	void createVertexBuffers (const Vertex *vertices, uint32_t count, CUploadManager &uploadManager);
+
+	void createPackedVertexBuffers (const Vertex *vertices, uint32_t count, CUploadManager &uploadManager);
+
+	void createIndexBuffers (const uint32_t *indices, uint32_t count, CUploadManager &uploadManager);
 
-	void createIndexBuffers (const std::vector<uint32_t> &indices);
+	void computeBounds (const Vertex *vertices, uint32_t count);
 
 	CDevice &Device;
+	CGeometryPool &GeometryPool;
 
-	std::unique_ptr<CBuffer> vertexBuffer;
+	VertexLayout vertexLayout;
+	glm::mat4 dequantization {1.f};
+	glm::vec3 boundsCenter {0.f};
+	float boundsRadius = 0.f;
+	CGeometryPool::Range vertexRange {};
+	int32_t vertexOffset = 0;
 	uint32_t vertexCount;
 
 	bool hasIndexBuffer = false;
-	std::unique_ptr<CBuffer> indexBuffer;
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+	CGeometryPool::Range indexRange {};
+	uint32_t firstPoolIndex = 0;
 	uint32_t indexCount;
+	std::vector<Lod> lods;
+	std::vector<Meshlet> meshlets;
 };
 
@@ -0,0 +1,118 @@
+#include "ModelLoader.h"
+
+// std
+#include <chrono>
+#include <iostream>
+
+#ifndef ENGINE_DIR
+#define ENGINE_DIR "../"
+#endif
+
+
+CImportedMesh::CImportedMesh (const std::string &enginePath, CWorkerPool &workerPool, const CModel::ImportSettings &settings)
+	: cache {enginePath, settings}
+{
+	fromCache = cache.load();
+	if (fromCache)
+	{
+		meshData = cache.getMeshData();
+		return;
+	}
+
+	builder.weldGridStep = settings.weldGridStep;
+	builder.loadModel(enginePath, workerPool);
+	builder.optimize(settings.reduceOverdraw);
+	builder.generateLods(settings.maxLodCount, settings.lodReduction, settings.lodMaxError);
+	builder.buildMeshlets(settings.meshletMaxVertices, settings.meshletMaxTriangles);
+	cache.store(builder);
+	meshData = builder.getMeshData();
+}
+
+CModelLoader::CModelLoader (CDevice &device, CGeometryPool &geometryPool, CUploadManager &uploadManager, CWorkerPool &workerPool)
+	: Device {device}, GeometryPool {geometryPool}, UploadManager {uploadManager}, WorkerPool {workerPool}
+{
+}
+
+CModelLoader::~CModelLoader ()
+{
+	// the tasks write into the requests
+	for (auto &request: requests)
+	{
+		try
+		{
+			WorkerPool.wait(request->task);
+		}
+		catch (...)
+		{
+		}
+	}
+}
+
+std::unique_ptr<CImportedMesh> CModelLoader::importMesh (const std::string &filepath, CWorkerPool &workerPool, const CModel::ImportSettings &settings)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	auto mesh = std::make_unique<CImportedMesh>(ENGINE_DIR + filepath, workerPool, settings);
+
+	float loadTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+	std::cout << "model: " << filepath << (mesh->isFromCache() ? " (mesh cache)" : " (obj)") << " loaded in " << loadTime << " ms" << std::endl;
+	return mesh;
+}
+
+CModelLoader::ModelFuture CModelLoader::loadAsync (const std::string &filepath, CModel::VertexLayout layout, const CModel::ImportSettings &settings)
+{
+	auto request = std::make_unique<Request>();
+	request->filepath = filepath;
+	request->layout = layout;
+	request->settings = settings;
+	Request *pendingRequest = request.get();
+	request->task = WorkerPool.schedule([this, pendingRequest] ()
+	{
+		pendingRequest->mesh = importMesh(pendingRequest->filepath, WorkerPool, pendingRequest->settings);
+	});
+
+	ModelFuture future = request->model.get_future().share();
+	requests.push_back(std::move(request));
+	return future;
+}
+
+void CModelLoader::uploadReady ()
+{
+	std::vector<std::unique_ptr<Request>> readyRequests {};
+	for (auto it = requests.begin(); it != requests.end();)
+	{
+		if ((*it)->task->isDone())
+		{
+			readyRequests.push_back(std::move(*it));
+			it = requests.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	if (readyRequests.empty())
+	{
+		return;
+	}
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// the mesh data is copied into the staging ring, so meshes can be released right away
+	for (auto &request: readyRequests)
+	{
+		try
+		{
+			WorkerPool.wait(request->task);
+			request->model.set_value(std::make_shared<CModel>(Device, GeometryPool, UploadManager, request->mesh->getMeshData(), request->layout));
+		}
+		catch (...)
+		{
+			std::cout << "model: " << request->filepath << " failed to load" << std::endl;
+			request->model.set_exception(std::current_exception());
+		}
+	}
+
+	float uploadTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+	std::cout << "model upload: " << readyRequests.size() << " models staged, " << uploadTime << " ms" << std::endl;
+}
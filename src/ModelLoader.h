@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Device.h"
+#include "MeshCache.h"
+#include "Model.h"
+#include "WorkerPool.h"
+
+// std
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// Mesh data ready for upload, either mapped from the mesh cache or imported from the source file.
+class CImportedMesh
+{
+public:
+	CImportedMesh (const std::string &enginePath, CWorkerPool &workerPool, const CModel::ImportSettings &settings = {});
+
+	const CModel::MeshData &getMeshData () const
+	{
+		return meshData;
+	}
+
+	bool isFromCache () const
+	{
+		return fromCache;
+	}
+
+private:
+	CMeshCache cache;
+	CModel::Builder builder {};
+	CModel::MeshData meshData {};
+	bool fromCache = false;
+};
+
+// Loads models in the background. Each file is imported by a task on the worker pool, the meshes that finished parsing are
+// staged in the upload manager by uploadReady, which the owner calls once per frame before submitting uploads.
+class CModelLoader
+{
+public:
+	using ModelFuture = std::shared_future<std::shared_ptr<CModel>>;
+
+	CModelLoader (CDevice &device, CGeometryPool &geometryPool, CUploadManager &uploadManager, CWorkerPool &workerPool);
+
+	~CModelLoader ();
+
+	CModelLoader (const CModelLoader &) = delete;
+
+	CModelLoader &operator= (const CModelLoader &) = delete;
+
+	// imports a mesh on the calling thread, filepath is relative to the engine directory
+	static std::unique_ptr<CImportedMesh> importMesh (const std::string &filepath, CWorkerPool &workerPool, const CModel::ImportSettings &settings = {});
+
+	// the future becomes ready once the model has been staged, it can be drawn after the next upload submit
+	ModelFuture loadAsync (const std::string &filepath, CModel::VertexLayout layout = CModel::VertexLayout::Full, const CModel::ImportSettings &settings = {});
+
+	void uploadReady ();
+
+	size_t getPendingCount () const
+	{
+		return requests.size();
+	}
+
+private:
+	struct Request
+	{
+		std::string filepath;
+		CModel::VertexLayout layout;
+		CModel::ImportSettings settings;
+		// fills mesh, waiting for it rethrows what the import threw
+		CWorkerPool::Task task;
+		std::unique_ptr<CImportedMesh> mesh;
+		std::promise<std::shared_ptr<CModel>> model;
+	};
+
+	CDevice &Device;
+	CGeometryPool &GeometryPool;
+	CUploadManager &UploadManager;
+	CWorkerPool &WorkerPool;
+	std::vector<std::unique_ptr<Request>> requests;
+};
@@ -0,0 +1,446 @@
+#include "ObjLoader.h"
+
+// libs
+#define TINYOBJLOADER_IMPLEMENTATION
+
+#include <tiny_obj_loader.h>
+
+// std
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+
+namespace
+{
+	constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+
+	enum RelativeComponent : uint8_t
+	{
+		RELATIVE_POSITION = 1 << 0,
+		RELATIVE_NORMAL = 1 << 1,
+		RELATIVE_TEXCOORD = 1 << 2,
+	};
+
+	struct RelativeCorner
+	{
+		uint32_t corner;
+		uint8_t components;
+	};
+
+	struct ObjChunk
+	{
+		char *begin = nullptr;
+		char *end = nullptr;
+
+		std::vector<float> positions {};
+		std::vector<float> colors {};
+		std::vector<float> normals {};
+		std::vector<float> texcoords {};
+
+		// faces are 3 or 4 corners long, quads are split once all positions are known
+		std::vector<tinyobj::index_t> faceCorners {};
+		std::vector<uint8_t> faceSizes {};
+		std::vector<RelativeCorner> relativeCorners {};
+		// the triangulated faces without the ones that index past the attributes
+		std::vector<tinyobj::index_t> triangleCorners {};
+		size_t skippedFaceCount = 0;
+
+		size_t positionBase = 0;
+		size_t normalBase = 0;
+		size_t texcoordBase = 0;
+		size_t cornerBase = 0;
+
+		bool unsupported = false;
+		std::string error {};
+	};
+
+	// Same rules as tinyobj's parseTriple, but negative (relative) indices are resolved against the
+	// chunk-local attribute counts and flagged so the merge can rebase them.
+	bool parseCorner (const char **token, int positionCount, int normalCount, int texcoordCount, tinyobj::index_t &corner, uint8_t &relative)
+	{
+		corner = {-1, -1, -1};
+		relative = 0;
+
+		auto fixIndex = [&] (int idx, int count, int &out, uint8_t flag)
+		{
+			if (idx == 0)
+			{
+				return false;
+			}
+			if (idx < 0)
+			{
+				relative |= flag;
+			}
+			return tinyobj::fixIndex(idx, count, &out);
+		};
+
+		if (!fixIndex(atoi(*token), positionCount, corner.vertex_index, RELATIVE_POSITION))
+		{
+			return false;
+		}
+
+		*token += strcspn(*token, "/ \t\r");
+		if ((*token)[0] != '/')
+		{
+			return true;
+		}
+		(*token)++;
+
+		// i//k
+		if ((*token)[0] == '/')
+		{
+			(*token)++;
+			if (!fixIndex(atoi(*token), normalCount, corner.normal_index, RELATIVE_NORMAL))
+			{
+				return false;
+			}
+			*token += strcspn(*token, "/ \t\r");
+			return true;
+		}
+
+		// i/j/k or i/j
+		if (!fixIndex(atoi(*token), texcoordCount, corner.texcoord_index, RELATIVE_TEXCOORD))
+		{
+			return false;
+		}
+
+		*token += strcspn(*token, "/ \t\r");
+		if ((*token)[0] != '/')
+		{
+			return true;
+		}
+
+		(*token)++;
+		if (!fixIndex(atoi(*token), normalCount, corner.normal_index, RELATIVE_NORMAL))
+		{
+			return false;
+		}
+		*token += strcspn(*token, "/ \t\r");
+		return true;
+	}
+
+	void parseChunk (ObjChunk &chunk)
+	{
+		char *cursor = chunk.begin;
+		while (cursor < chunk.end)
+		{
+			// terminate the line in place, line endings are '\n', '\r' or "\r\n" like tinyobj's safeGetline
+			char *line = cursor;
+			while (cursor < chunk.end && *cursor != '\n' && *cursor != '\r')
+			{
+				cursor++;
+			}
+			if (cursor < chunk.end)
+			{
+				*cursor++ = '\0';
+			}
+
+			const char *token = line;
+			token += strspn(token, " \t");
+
+			if (token[0] == '\0' || token[0] == '#')
+			{
+				continue;
+			}
+
+			if (token[0] == 'v' && IS_SPACE(token[1]))
+			{
+				token += 2;
+				float x, y, z, r, g, b;
+				tinyobj::parseVertexWithColor(&x, &y, &z, &r, &g, &b, &token);
+				chunk.positions.insert(chunk.positions.end(), {x, y, z});
+				chunk.colors.insert(chunk.colors.end(), {r, g, b});
+				continue;
+			}
+
+			if (token[0] == 'v' && token[1] == 'n' && IS_SPACE(token[2]))
+			{
+				token += 3;
+				float x, y, z;
+				tinyobj::parseReal3(&x, &y, &z, &token);
+				chunk.normals.insert(chunk.normals.end(), {x, y, z});
+				continue;
+			}
+
+			if (token[0] == 'v' && token[1] == 't' && IS_SPACE(token[2]))
+			{
+				token += 3;
+				float x, y;
+				tinyobj::parseReal2(&x, &y, &token);
+				chunk.texcoords.insert(chunk.texcoords.end(), {x, y});
+				continue;
+			}
+
+			if ((token[0] == 'l' || token[0] == 'p') && IS_SPACE(token[1]))
+			{
+				chunk.unsupported = true;
+				return;
+			}
+
+			if (token[0] == 'f' && IS_SPACE(token[1]))
+			{
+				token += 2;
+				token += strspn(token, " \t");
+
+				tinyobj::index_t faceCorners[4];
+				RelativeCorner faceRelative[4];
+				size_t faceSize = 0;
+				size_t faceRelativeCount = 0;
+				while (!IS_NEW_LINE(token[0]))
+				{
+					tinyobj::index_t corner;
+					uint8_t relative;
+					if (!parseCorner(&token, static_cast<int>(chunk.positions.size() / 3), static_cast<int>(chunk.normals.size() / 3), static_cast<int>(chunk.texcoords.size() / 2), corner, relative))
+					{
+						chunk.error = "Failed parse `f' line(e.g. zero value for face index.)";
+						return;
+					}
+					if (faceSize == 4)
+					{
+						chunk.unsupported = true;
+						return;
+					}
+					if (relative)
+					{
+						faceRelative[faceRelativeCount++] = {static_cast<uint32_t>(chunk.faceCorners.size() + faceSize), relative};
+					}
+					faceCorners[faceSize++] = corner;
+					token += strspn(token, " \t\r");
+				}
+
+				// tinyobj drops degenerate faces
+				if (faceSize >= 3)
+				{
+					chunk.faceCorners.insert(chunk.faceCorners.end(), faceCorners, faceCorners + faceSize);
+					chunk.faceSizes.push_back(static_cast<uint8_t>(faceSize));
+					chunk.relativeCorners.insert(chunk.relativeCorners.end(), faceRelative, faceRelative + faceRelativeCount);
+				}
+				continue;
+			}
+
+			// groups, objects, materials, smoothing groups and tags do not change the geometry we use
+		}
+	}
+
+	bool validPosition (const tinyobj::index_t &corner, const tinyobj::attrib_t &attrib)
+	{
+		return corner.vertex_index >= 0 && corner.vertex_index < static_cast<int>(attrib.vertices.size() / 3);
+	}
+
+	// tinyobj splits quads along the shorter diagonal. Like tinyobj it skips faces whose positions are out of
+	// range, and like the serial import, the triangles with any other index out of range.
+	void triangulateChunk (ObjChunk &chunk, const tinyobj::attrib_t &attrib)
+	{
+		std::vector<tinyobj::index_t> &triangles = chunk.triangleCorners;
+		triangles.resize(chunk.faceCorners.size() * 3 / 2 + 3);
+		tinyobj::index_t *out = triangles.data();
+
+		const tinyobj::index_t *face = chunk.faceCorners.data();
+		for (uint8_t faceSize: chunk.faceSizes)
+		{
+			if (!std::all_of(face, face + faceSize, [&] (const tinyobj::index_t &corner) { return validPosition(corner, attrib); }))
+			{
+				++chunk.skippedFaceCount;
+			}
+			else if (faceSize == 3)
+			{
+				*out++ = face[0];
+				*out++ = face[1];
+				*out++ = face[2];
+			}
+			else
+			{
+				auto position = [&] (const tinyobj::index_t &corner, int axis)
+				{
+					return attrib.vertices[3 * size_t(corner.vertex_index) + axis];
+				};
+
+				float sqr02 = 0.f;
+				float sqr13 = 0.f;
+				for (int axis = 0; axis < 3; axis++)
+				{
+					float e02 = position(face[2], axis) - position(face[0], axis);
+					float e13 = position(face[3], axis) - position(face[1], axis);
+					sqr02 += e02 * e02;
+					sqr13 += e13 * e13;
+				}
+
+				if (sqr02 < sqr13)
+				{
+					*out++ = face[0];
+					*out++ = face[1];
+					*out++ = face[2];
+					*out++ = face[0];
+					*out++ = face[2];
+					*out++ = face[3];
+				}
+				else
+				{
+					*out++ = face[0];
+					*out++ = face[1];
+					*out++ = face[3];
+					*out++ = face[1];
+					*out++ = face[2];
+					*out++ = face[3];
+				}
+			}
+			face += faceSize;
+		}
+		triangles.resize(out - triangles.data());
+
+		size_t kept = 0;
+		for (size_t i = 0; i < triangles.size(); i += 3)
+		{
+			if (CObjLoader::isValidCorner(triangles[i], attrib) && CObjLoader::isValidCorner(triangles[i + 1], attrib) && CObjLoader::isValidCorner(triangles[i + 2], attrib))
+			{
+				std::copy(triangles.begin() + i, triangles.begin() + i + 3, triangles.begin() + kept);
+				kept += 3;
+			}
+			else
+			{
+				++chunk.skippedFaceCount;
+			}
+		}
+		triangles.resize(kept);
+	}
+}  // namespace
+
+bool CObjLoader::isValidCorner (const tinyobj::index_t &corner, const tinyobj::attrib_t &attrib)
+{
+	// -1 marks a missing normal or texcoord
+	return validPosition(corner, attrib) && corner.normal_index >= -1 && corner.normal_index < static_cast<int>(attrib.normals.size() / 3) && corner.texcoord_index >= -1 && corner.texcoord_index < static_cast<int>(attrib.texcoords.size() / 2);
+}
+
+bool CObjLoader::load (const std::string &filepath, tinyobj::attrib_t &attrib, std::vector<tinyobj::index_t> &corners, std::string &warn, CWorkerPool &workerPool)
+{
+	std::ifstream file {filepath, std::ios::ate | std::ios::binary};
+	if (!file.is_open())
+	{
+		throw std::runtime_error("failed to open file: " + filepath);
+	}
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+	std::vector<char> text(fileSize + 1);
+	file.seekg(0);
+	file.read(text.data(), fileSize);
+	text[fileSize] = '\0';
+
+	// line aligned chunks, several per thread so uneven chunks balance out
+	const size_t chunkSize = std::max(MIN_CHUNK_SIZE, fileSize / (size_t(workerPool.getThreadCount()) * 8) + 1);
+	std::vector<ObjChunk> chunks {};
+	for (size_t begin = 0; begin < fileSize;)
+	{
+		size_t end = std::min(fileSize, begin + chunkSize);
+		while (end < fileSize && text[end - 1] != '\n' && text[end - 1] != '\r')
+		{
+			end++;
+		}
+
+		ObjChunk chunk {};
+		chunk.begin = text.data() + begin;
+		chunk.end = text.data() + end;
+		chunks.push_back(std::move(chunk));
+		begin = end;
+	}
+
+	workerPool.parallelFor(chunks.size(), 1, [&] (size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			parseChunk(chunks[i]);
+		}
+	});
+
+	// chunk bases in file order
+	size_t positionCount = 0;
+	size_t normalCount = 0;
+	size_t texcoordCount = 0;
+	for (auto &chunk: chunks)
+	{
+		// a zero index fails tinyobj::LoadObj too
+		if (!chunk.error.empty())
+		{
+			throw std::runtime_error(chunk.error);
+		}
+		if (chunk.unsupported)
+		{
+			return false;
+		}
+
+		chunk.positionBase = positionCount;
+		chunk.normalBase = normalCount;
+		chunk.texcoordBase = texcoordCount;
+		positionCount += chunk.positions.size() / 3;
+		normalCount += chunk.normals.size() / 3;
+		texcoordCount += chunk.texcoords.size() / 2;
+	}
+
+	attrib = tinyobj::attrib_t {};
+	attrib.vertices.resize(positionCount * 3);
+	attrib.colors.resize(positionCount * 3);
+	attrib.normals.resize(normalCount * 3);
+	attrib.texcoords.resize(texcoordCount * 2);
+
+	workerPool.parallelFor(chunks.size(), 1, [&] (size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			auto &chunk = chunks[i];
+			std::copy(chunk.positions.begin(), chunk.positions.end(), attrib.vertices.begin() + chunk.positionBase * 3);
+			std::copy(chunk.colors.begin(), chunk.colors.end(), attrib.colors.begin() + chunk.positionBase * 3);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), attrib.normals.begin() + chunk.normalBase * 3);
+			std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), attrib.texcoords.begin() + chunk.texcoordBase * 2);
+
+			for (const auto &relative: chunk.relativeCorners)
+			{
+				auto &corner = chunk.faceCorners[relative.corner];
+				if (relative.components & RELATIVE_POSITION)
+				{
+					corner.vertex_index += static_cast<int>(chunk.positionBase);
+				}
+				if (relative.components & RELATIVE_NORMAL)
+				{
+					corner.normal_index += static_cast<int>(chunk.normalBase);
+				}
+				if (relative.components & RELATIVE_TEXCOORD)
+				{
+					corner.texcoord_index += static_cast<int>(chunk.texcoordBase);
+				}
+			}
+		}
+	});
+
+	// quads index positions of other chunks, which are only all in place now
+	workerPool.parallelFor(chunks.size(), 1, [&] (size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			triangulateChunk(chunks[i], attrib);
+		}
+	});
+
+	size_t cornerCount = 0;
+	size_t skippedFaceCount = 0;
+	for (auto &chunk: chunks)
+	{
+		chunk.cornerBase = cornerCount;
+		cornerCount += chunk.triangleCorners.size();
+		skippedFaceCount += chunk.skippedFaceCount;
+	}
+	if (skippedFaceCount > 0)
+	{
+		warn += std::to_string(skippedFaceCount) + " faces with invalid vertex index skipped.\n";
+	}
+
+	corners.resize(cornerCount);
+	workerPool.parallelFor(chunks.size(), 1, [&] (size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			std::copy(chunks[i].triangleCorners.begin(), chunks[i].triangleCorners.end(), corners.begin() + chunks[i].cornerBase);
+		}
+	});
+
+	return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "WorkerPool.h"
+
+// libs
+#include <tiny_obj_loader.h>
+
+// std
+#include <string>
+#include <vector>
+
+
+// Parallel OBJ geometry parser. The file is split into line-aligned chunks which are parsed on the worker
+// pool and merged in file order, producing the same attributes and triangulated corner list as
+// tinyobj::LoadObj. Returns false when the file uses something only tinyobj handles (n-gons above
+// quads, line and point primitives), in which case the caller should fall back to tinyobj. Faces with
+// indices past the attributes are skipped with a warning instead of failing the load.
+class CObjLoader
+{
+public:
+	static bool load (const std::string &filepath, tinyobj::attrib_t &attrib, std::vector<tinyobj::index_t> &corners, std::string &warn, CWorkerPool &workerPool);
+
+	// whether the corner's position and, if present, normal and texcoord exist in attrib
+	static bool isValidCorner (const tinyobj::index_t &corner, const tinyobj::attrib_t &attrib);
+};
@@ -0,0 +1,124 @@
+#include "ParallelCommandRecorder.h"
+
+// std
+#include <algorithm>
+#include <stdexcept>
+
+
+CParallelCommandRecorder::CParallelCommandRecorder (CDevice &device, CWorkerPool &workerPool, uint32_t frameCount)
+		: Device {device}, WorkerPool {workerPool}, sliceCount {workerPool.getThreadCount()}
+{
+	VkCommandPoolCreateInfo poolInfo {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = Device.findPhysicalQueueFamilies().graphicsFamily;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	pools.resize(frameCount * sliceCount);
+	for (SlicePool &pool: pools)
+	{
+		if (vkCreateCommandPool(Device.GetDevice(), &poolInfo, nullptr, &pool.commandPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create command pool!");
+		}
+	}
+}
+
+CParallelCommandRecorder::~CParallelCommandRecorder ()
+{
+	for (SlicePool &pool: pools)
+	{
+		vkDestroyCommandPool(Device.GetDevice(), pool.commandPool, nullptr);
+	}
+}
+
+void CParallelCommandRecorder::beginFrame (int frameIndex)
+{
+	this->frameIndex = frameIndex;
+	for (uint32_t slice = 0; slice < sliceCount; ++slice)
+	{
+		SlicePool &pool = pools[frameIndex * sliceCount + slice];
+		vkResetCommandPool(Device.GetDevice(), pool.commandPool, 0);
+		pool.usedCount = 0;
+	}
+}
+
+VkResult CParallelCommandRecorder::acquireCommandBuffer (SlicePool &pool, VkCommandBuffer &commandBuffer)
+{
+	if (pool.usedCount == pool.commandBuffers.size())
+	{
+		VkCommandBufferAllocateInfo allocInfo {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandPool = pool.commandPool;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer allocated;
+		VkResult result = vkAllocateCommandBuffers(Device.GetDevice(), &allocInfo, &allocated);
+		if (result != VK_SUCCESS)
+		{
+			return result;
+		}
+		pool.commandBuffers.push_back(allocated);
+	}
+
+	commandBuffer = pool.commandBuffers[pool.usedCount++];
+	return VK_SUCCESS;
+}
+
+void CParallelCommandRecorder::record (VkCommandBuffer primaryCommandBuffer, const Inheritance &inheritance, size_t count, const std::function<void (VkCommandBuffer, uint32_t, size_t, size_t)> &function)
+{
+	recorded.assign(sliceCount, VK_NULL_HANDLE);
+	results.assign(sliceCount, VK_SUCCESS);
+
+	const size_t sliceSize = std::max<size_t>((count + sliceCount - 1) / sliceCount, 1);
+	// a failed slice records its result, the error is thrown once no slice is recording anymore
+	WorkerPool.parallelFor(count, sliceSize, [&] (size_t begin, size_t end)
+	{
+		const uint32_t slice = static_cast<uint32_t>(begin / sliceSize);
+		VkCommandBuffer commandBuffer;
+		results[slice] = acquireCommandBuffer(pools[frameIndex * sliceCount + slice], commandBuffer);
+		if (results[slice] != VK_SUCCESS)
+		{
+			return;
+		}
+
+		VkCommandBufferInheritanceInfo inheritanceInfo {};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = inheritance.renderPass;
+		inheritanceInfo.subpass = inheritance.subpass;
+		inheritanceInfo.framebuffer = inheritance.framebuffer;
+
+		VkCommandBufferBeginInfo beginInfo {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+		results[slice] = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		if (results[slice] != VK_SUCCESS)
+		{
+			return;
+		}
+
+		// dynamic state is not inherited from the primary
+		VkViewport viewport {0.f, 0.f, static_cast<float>(inheritance.extent.width), static_cast<float>(inheritance.extent.height), 0.f, 1.f};
+		VkRect2D scissor {{0, 0}, inheritance.extent};
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		function(commandBuffer, slice, begin, end);
+
+		results[slice] = vkEndCommandBuffer(commandBuffer);
+		recorded[slice] = commandBuffer;
+	});
+
+	if (std::any_of(results.begin(), results.end(), [] (VkResult result) { return result != VK_SUCCESS; }))
+	{
+		throw std::runtime_error("failed to record secondary command buffer!");
+	}
+
+	// slices past the end of the items were never recorded
+	recorded.erase(std::remove(recorded.begin(), recorded.end(), VK_NULL_HANDLE), recorded.end());
+	if (!recorded.empty())
+	{
+		vkCmdExecuteCommands(primaryCommandBuffer, static_cast<uint32_t>(recorded.size()), recorded.data());
+	}
+}
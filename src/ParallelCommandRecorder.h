@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Device.h"
+#include "WorkerPool.h"
+
+
+#include <functional>
+#include <vector>
+
+
+// Records a render pass on worker threads into secondary command buffers. Work is split into one slice per
+// thread of the worker pool, and every slice has its own command pool per frame in flight, so no two threads
+// ever record from the same pool. The pools of a frame are reset together by beginFrame. The primary command
+// buffer executes the slices in slice order, so the result does not depend on which thread recorded what.
+class CParallelCommandRecorder
+{
+public:
+	// the render pass instance the secondary command buffers continue, viewport and scissor cover extent
+	struct Inheritance
+	{
+		VkRenderPass renderPass;
+		uint32_t subpass;
+		VkFramebuffer framebuffer;
+		VkExtent2D extent;
+	};
+
+	CParallelCommandRecorder (CDevice &device, CWorkerPool &workerPool, uint32_t frameCount);
+
+	~CParallelCommandRecorder ();
+
+	CParallelCommandRecorder (const CParallelCommandRecorder &) = delete;
+
+	CParallelCommandRecorder &operator= (const CParallelCommandRecorder &) = delete;
+
+	// resets the pools of this frame index, whose commands must have completed
+	void beginFrame (int frameIndex);
+
+	// calls function(commandBuffer, slice, begin, end) for each slice of count items on the worker pool, then
+	// executes the recorded slices in primaryCommandBuffer, whose render pass was begun with secondary contents
+	void record (VkCommandBuffer primaryCommandBuffer, const Inheritance &inheritance, size_t count, const std::function<void (VkCommandBuffer, uint32_t, size_t, size_t)> &function);
+
+	uint32_t getSliceCount () const
+	{
+		return sliceCount;
+	}
+
+private:
+	struct SlicePool
+	{
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		// allocated as needed and kept, resetting the pool resets them as well
+		std::vector<VkCommandBuffer> commandBuffers;
+		uint32_t usedCount = 0;
+	};
+
+	// the next unused command buffer of the pool, only called by the thread recording its slice
+	VkResult acquireCommandBuffer (SlicePool &pool, VkCommandBuffer &commandBuffer);
+
+	CDevice &Device;
+	CWorkerPool &WorkerPool;
+
+	uint32_t sliceCount;
+	// sliceCount pools per frame, indexed by frame * sliceCount + slice
+	std::vector<SlicePool> pools;
+	int frameIndex = 0;
+
+	// per slice results of the last record, kept so recording does not allocate
+	std::vector<VkCommandBuffer> recorded;
+	std::vector<VkResult> results;
+};
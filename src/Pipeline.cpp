@@ -13,17 +13,14 @@
 #endif
 
 
-CPipeline::CPipeline (CDevice &device, const std::string &vertFilepath, const std::string &fragFilepath, const PipelineConfigInfo &configInfo)
-		: Device {device}
+CPipeline::CPipeline (CDevice &device, VkPipelineBindPoint bindPoint)
+		: Device {device}, bindPoint {bindPoint}
 {
-	createGraphicsPipeline(vertFilepath, fragFilepath, configInfo);
 }
 
 CPipeline::~CPipeline ()
 {
-	vkDestroyShaderModule(Device.GetDevice(), vertShaderModule, nullptr);
-	vkDestroyShaderModule(Device.GetDevice(), fragShaderModule, nullptr);
-	vkDestroyPipeline(Device.GetDevice(), graphicsPipeline, nullptr);
+	vkDestroyPipeline(Device.GetDevice(), pipeline, nullptr);
 }
 
 std::vector<char> CPipeline::readFile (const std::string &filepath)
@@ -46,84 +43,10 @@ std::vector<char> CPipeline::readFile (const std::string &filepath)
 	return buffer;
 }
 
-void CPipeline::createGraphicsPipeline (const std::string &vertFilepath, const std::string &fragFilepath, const PipelineConfigInfo &configInfo)
-{
-	assert(configInfo.pipelineLayout != VK_NULL_HANDLE && "Cannot create graphics pipeline: no pipelineLayout provided in configInfo");
-	assert(configInfo.renderPass != VK_NULL_HANDLE && "Cannot create graphics pipeline: no renderPass provided in configInfo");
-
-	auto vertCode = readFile(vertFilepath);
-	auto fragCode = readFile(fragFilepath);
-
-	createShaderModule(vertCode, &vertShaderModule);
-	createShaderModule(fragCode, &fragShaderModule);
-
-	VkPipelineShaderStageCreateInfo shaderStages[2];
-	shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-	shaderStages[0].module = vertShaderModule;
-	shaderStages[0].pName = "main";
-	shaderStages[0].flags = 0;
-	shaderStages[0].pNext = nullptr;
-	shaderStages[0].pSpecializationInfo = nullptr;
-	shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	shaderStages[1].module = fragShaderModule;
-	shaderStages[1].pName = "main";
-	shaderStages[1].flags = 0;
-	shaderStages[1].pNext = nullptr;
-	shaderStages[1].pSpecializationInfo = nullptr;
-
-	auto &bindingDescriptions = configInfo.bindingDescriptions;
-	auto &attributeDescriptions = configInfo.attributeDescriptions;
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo {};
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
-	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-	vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
-
-	VkGraphicsPipelineCreateInfo pipelineInfo {};
-	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineInfo.stageCount = 2;
-	pipelineInfo.pStages = shaderStages;
-	pipelineInfo.pVertexInputState = &vertexInputInfo;
-	pipelineInfo.pInputAssemblyState = &configInfo.inputAssemblyInfo;
-	pipelineInfo.pViewportState = &configInfo.viewportInfo;
-	pipelineInfo.pRasterizationState = &configInfo.rasterizationInfo;
-	pipelineInfo.pMultisampleState = &configInfo.multisampleInfo;
-	pipelineInfo.pColorBlendState = &configInfo.colorBlendInfo;
-	pipelineInfo.pDepthStencilState = &configInfo.depthStencilInfo;
-	pipelineInfo.pDynamicState = &configInfo.dynamicStateInfo;
-
-	pipelineInfo.layout = configInfo.pipelineLayout;
-	pipelineInfo.renderPass = configInfo.renderPass;
-	pipelineInfo.subpass = configInfo.subpass;
-
-	pipelineInfo.basePipelineIndex = -1;
-	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-
-	if (vkCreateGraphicsPipelines(Device.GetDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to create graphics pipeline");
-	}
-}
-
-void CPipeline::createShaderModule (const std::vector<char> &code, VkShaderModule *shaderModule)
-{
-	VkShaderModuleCreateInfo createInfo {};
-	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
-	createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
-
-	if (vkCreateShaderModule(Device.GetDevice(), &createInfo, nullptr, shaderModule) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to create shader module");
-	}
-}
-
 void CPipeline::bind (VkCommandBuffer commandBuffer)
 {
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+	assert(isCompiled() && "Cannot bind a pipeline before the registry has compiled it");
+	vkCmdBindPipeline(commandBuffer, bindPoint, pipeline);
 }
 
 void CPipeline::defaultPipelineConfigInfo (PipelineConfigInfo &configInfo)
@@ -3,6 +3,7 @@
 #include "Device.h"
 
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -27,28 +28,67 @@ struct PipelineConfigInfo
 	uint32_t subpass = 0;
 };
 
+// value of the specialization constant with the given constant_id, bools are VK_TRUE or VK_FALSE and floats their bits
+struct SpecializationConstant
+{
+	uint32_t constantID;
+	uint32_t value;
+};
+
+// A graphics or compute pipeline, created by CPipelineRegistry which shares it between every request for the
+// same shaders and state.
 class CPipeline
 {
 public:
-	CPipeline (CDevice& device, const std::string &vertFilepath, const std::string &fragFilepath, const PipelineConfigInfo &configInfo);
+	CPipeline (CDevice& device, VkPipelineBindPoint bindPoint);
+
 	~CPipeline ();
 
+	CPipeline (const CPipeline &) = delete;
+
+	CPipeline &operator= (const CPipeline &) = delete;
+
 	void bind (VkCommandBuffer commandBuffer);
 
+	// false until the registry has compiled the pipeline
+	bool isCompiled () const
+	{
+		return pipeline != VK_NULL_HANDLE;
+	}
+
 	static void defaultPipelineConfigInfo (PipelineConfigInfo &configInfo);
 
 	static void enableAlphaBlending (PipelineConfigInfo &configInfo);
 
-private:
 	static std::vector<char> readFile (const std::string &filepath);
 
-	void createGraphicsPipeline (const std::string &vertFilepath, const std::string &fragFilepath, const PipelineConfigInfo &configInfo);
-
-	void createShaderModule (const std::vector<char> &code, VkShaderModule *shaderModule);
+private:
+	friend class CPipelineRegistry;
 
 	CDevice& Device;
-	VkPipeline graphicsPipeline;
-	VkShaderModule vertShaderModule;
-	VkShaderModule fragShaderModule;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkPipelineBindPoint bindPoint;
 };
 
+// A pipeline specialized by constants. The specialized pipeline is compiled in the background by
+// CPipelineRegistry, until it is ready the generic fallback built without the constants is bound instead.
+class CPipelineVariant
+{
+public:
+	void bind (VkCommandBuffer commandBuffer)
+	{
+		(specialized ? specialized : fallback)->bind(commandBuffer);
+	}
+
+	bool isSpecialized () const
+	{
+		return specialized != nullptr;
+	}
+
+private:
+	friend class CPipelineRegistry;
+
+	std::shared_ptr<CPipeline> fallback;
+	// set by CPipelineRegistry::update once the background compilation has finished
+	std::shared_ptr<CPipeline> specialized;
+};
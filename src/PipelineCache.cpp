@@ -0,0 +1,158 @@
+#include "PipelineCache.h"
+
+#include "MappedFile.h"
+#include "Utils.h"
+
+// std
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+
+static constexpr char CACHE_MAGIC[4] = {'V', 'P', 'C', 'H'};
+
+CPipelineCache::CPipelineCache (VkDevice device, const VkPhysicalDeviceProperties &properties, const std::string &filepath)
+		: device {device}, properties {properties}, filepath {filepath}
+{
+	CMappedFile file {};
+	const uint8_t *initialData = nullptr;
+	if (file.open(filepath))
+	{
+		if (const char *reason = validate(file.getData(), file.getSize()))
+		{
+			std::cout << "pipeline cache: ignoring " << filepath << ", " << reason << std::endl;
+		}
+		else
+		{
+			initialData = file.getData() + sizeof(Header);
+			loadedSize = file.getSize() - sizeof(Header);
+		}
+	}
+
+	VkPipelineCacheCreateInfo createInfo {};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = loadedSize;
+	createInfo.pInitialData = initialData;
+
+	if (vkCreatePipelineCache(device, &createInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create pipeline cache!");
+	}
+
+	if (initialData)
+	{
+		loadedHash = hashBytes(initialData, loadedSize);
+		std::cout << "pipeline cache: loaded " << loadedSize << " bytes" << std::endl;
+	}
+}
+
+CPipelineCache::~CPipelineCache ()
+{
+	save();
+	vkDestroyPipelineCache(device, pipelineCache, nullptr);
+}
+
+const char *CPipelineCache::validate (const uint8_t *fileData, size_t fileSize) const
+{
+	if (fileSize < sizeof(Header))
+	{
+		return "file is truncated";
+	}
+
+	Header header {};
+	memcpy(&header, fileData, sizeof(Header));
+	if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != VERSION)
+	{
+		return "unknown format";
+	}
+	if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID)
+	{
+		return "written for another device";
+	}
+	if (header.driverVersion != properties.driverVersion || memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		return "written by another driver";
+	}
+
+	const uint8_t *data = fileData + sizeof(Header);
+	const size_t dataSize = fileSize - sizeof(Header);
+	if (header.dataSize != dataSize || header.dataHash != hashBytes(data, dataSize))
+	{
+		return "data is damaged";
+	}
+
+	// the driver's own header, drivers are expected to reject a mismatch but not all of them do
+	uint32_t driverHeader[4] {};
+	if (dataSize < sizeof(driverHeader) + VK_UUID_SIZE)
+	{
+		return "data is truncated";
+	}
+	memcpy(driverHeader, data, sizeof(driverHeader));
+	if (driverHeader[0] < sizeof(driverHeader) + VK_UUID_SIZE || driverHeader[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || driverHeader[2] != properties.vendorID || driverHeader[3] != properties.deviceID || memcmp(data + sizeof(driverHeader), properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		return "driver header does not match the device";
+	}
+	return nullptr;
+}
+
+bool CPipelineCache::save ()
+{
+	size_t dataSize = 0;
+	if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+	{
+		return false;
+	}
+
+	std::vector<uint8_t> data(dataSize);
+	if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	Header header {};
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = VERSION;
+	header.vendorID = properties.vendorID;
+	header.deviceID = properties.deviceID;
+	header.driverVersion = properties.driverVersion;
+	memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = dataSize;
+	header.dataHash = hashBytes(data.data(), dataSize);
+
+	// nothing was added since the file was loaded
+	if (dataSize == loadedSize && header.dataHash == loadedHash)
+	{
+		return true;
+	}
+
+	const std::string tempPath = makeTempPath(filepath);
+	{
+		std::ofstream file {tempPath, std::ios::binary | std::ios::trunc};
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+		file.write(reinterpret_cast<const char *>(data.data()), dataSize);
+		if (!file.good())
+		{
+			file.close();
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+	if (!replaceFile(tempPath, filepath))
+	{
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	loadedSize = dataSize;
+	loadedHash = header.dataHash;
+	return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+// libs
+#include <vulkan/vulkan.h>
+
+// std
+#include <cstdint>
+#include <string>
+
+
+// Device-wide VkPipelineCache that persists between runs. The file starts with a header holding the vendor, device,
+// driver version and cache UUID it was written for, plus a hash of the data, so a cache from another GPU or driver
+// or a damaged file is discarded instead of being handed to the driver.
+class CPipelineCache
+{
+public:
+	static constexpr uint32_t VERSION = 1;
+
+	CPipelineCache (VkDevice device, const VkPhysicalDeviceProperties &properties, const std::string &filepath);
+
+	// writes the cache back before destroying it
+	~CPipelineCache ();
+
+	CPipelineCache (const CPipelineCache &) = delete;
+
+	CPipelineCache &operator= (const CPipelineCache &) = delete;
+
+	// replaces the file through a temporary one, so a crash never leaves a truncated cache behind
+	bool save ();
+
+	VkPipelineCache getPipelineCache () const
+	{
+		return pipelineCache;
+	}
+
+	// true when the cache was created from a valid file
+	bool isWarm () const
+	{
+		return loadedSize > 0;
+	}
+
+	size_t getLoadedSize () const
+	{
+		return loadedSize;
+	}
+
+private:
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint32_t reserved;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		uint64_t dataSize;
+		uint64_t dataHash;
+	};
+
+	// returns the reason the file can not be used, null when it is valid
+	const char *validate (const uint8_t *fileData, size_t fileSize) const;
+
+	VkDevice device;
+	VkPhysicalDeviceProperties properties;
+	std::string filepath;
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+	size_t loadedSize = 0;
+	uint64_t loadedHash = 0;
+};
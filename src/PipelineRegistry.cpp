@@ -0,0 +1,465 @@
+#include "PipelineRegistry.h"
+
+// std
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <stdexcept>
+
+
+template<typename T> static void appendKey (std::string &key, const T &value)
+{
+	key.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template<typename T> static void appendKey (std::string &key, const std::vector<T> &values)
+{
+	appendKey(key, values.size());
+	key.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+}
+
+CPipelineRegistry::CPipelineRegistry (CDevice &device, CWorkerPool &workerPool)
+		: Device {device}, WorkerPool {workerPool}
+{
+}
+
+CPipelineRegistry::~CPipelineRegistry ()
+{
+	// the background compilations use the shader modules and layouts destroyed below
+	for (BackgroundVariant &background: backgroundVariants)
+	{
+		try
+		{
+			WorkerPool.wait(background.task);
+		}
+		catch (const std::exception &)
+		{
+		}
+	}
+	backgroundVariants.clear();
+	variants.clear();
+	pipelines.clear();
+	for (auto &kv: shaderModules)
+	{
+		vkDestroyShaderModule(Device.GetDevice(), kv.second, nullptr);
+	}
+	for (auto &kv: pipelineLayouts)
+	{
+		vkDestroyPipelineLayout(Device.GetDevice(), kv.second, nullptr);
+	}
+}
+
+VkShaderModule CPipelineRegistry::getShaderModule (const std::string &filepath)
+{
+	auto it = shaderModules.find(filepath);
+	if (it != shaderModules.end())
+	{
+		return it->second;
+	}
+
+	const std::vector<char> code = CPipeline::readFile(filepath);
+
+	VkShaderModuleCreateInfo createInfo {};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = code.size();
+	createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+
+	VkShaderModule shaderModule;
+	if (vkCreateShaderModule(Device.GetDevice(), &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shader module: " + filepath);
+	}
+
+	shaderModules.emplace(filepath, shaderModule);
+	++stats.shaderModuleCount;
+	return shaderModule;
+}
+
+VkPipelineLayout CPipelineRegistry::getPipelineLayout (const std::vector<VkDescriptorSetLayout> &setLayouts, const std::vector<VkPushConstantRange> &pushConstantRanges)
+{
+	std::string key {};
+	appendKey(key, setLayouts);
+	appendKey(key, pushConstantRanges);
+
+	std::lock_guard<std::mutex> lock {mutex};
+	auto it = pipelineLayouts.find(key);
+	if (it != pipelineLayouts.end())
+	{
+		return it->second;
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+	pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+	pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+	VkPipelineLayout pipelineLayout;
+	if (vkCreatePipelineLayout(Device.GetDevice(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create pipeline layout!");
+	}
+
+	pipelineLayouts.emplace(std::move(key), pipelineLayout);
+	++stats.pipelineLayoutCount;
+	return pipelineLayout;
+}
+
+std::string CPipelineRegistry::getGraphicsKey (VkShaderModule vertShaderModule, VkShaderModule fragShaderModule, const PipelineConfigInfo &configInfo)
+{
+	std::string key {};
+	key.reserve(512);
+	appendKey(key, vertShaderModule);
+	appendKey(key, fragShaderModule);
+	appendKey(key, configInfo.bindingDescriptions);
+	appendKey(key, configInfo.attributeDescriptions);
+
+	appendKey(key, configInfo.viewportInfo.viewportCount);
+	appendKey(key, configInfo.viewportInfo.scissorCount);
+	appendKey(key, configInfo.inputAssemblyInfo.topology);
+	appendKey(key, configInfo.inputAssemblyInfo.primitiveRestartEnable);
+
+	const VkPipelineRasterizationStateCreateInfo &rasterization = configInfo.rasterizationInfo;
+	appendKey(key, rasterization.depthClampEnable);
+	appendKey(key, rasterization.rasterizerDiscardEnable);
+	appendKey(key, rasterization.polygonMode);
+	appendKey(key, rasterization.cullMode);
+	appendKey(key, rasterization.frontFace);
+	appendKey(key, rasterization.depthBiasEnable);
+	appendKey(key, rasterization.depthBiasConstantFactor);
+	appendKey(key, rasterization.depthBiasClamp);
+	appendKey(key, rasterization.depthBiasSlopeFactor);
+	appendKey(key, rasterization.lineWidth);
+
+	const VkPipelineMultisampleStateCreateInfo &multisample = configInfo.multisampleInfo;
+	appendKey(key, multisample.rasterizationSamples);
+	appendKey(key, multisample.sampleShadingEnable);
+	appendKey(key, multisample.minSampleShading);
+	appendKey(key, multisample.alphaToCoverageEnable);
+	appendKey(key, multisample.alphaToOneEnable);
+
+	appendKey(key, configInfo.colorBlendInfo.logicOpEnable);
+	appendKey(key, configInfo.colorBlendInfo.logicOp);
+	appendKey(key, configInfo.colorBlendInfo.attachmentCount);
+	appendKey(key, configInfo.colorBlendInfo.blendConstants);
+	appendKey(key, configInfo.colorBlendAttachment);
+
+	const VkPipelineDepthStencilStateCreateInfo &depthStencil = configInfo.depthStencilInfo;
+	appendKey(key, depthStencil.depthTestEnable);
+	appendKey(key, depthStencil.depthWriteEnable);
+	appendKey(key, depthStencil.depthCompareOp);
+	appendKey(key, depthStencil.depthBoundsTestEnable);
+	appendKey(key, depthStencil.stencilTestEnable);
+	appendKey(key, depthStencil.front);
+	appendKey(key, depthStencil.back);
+	appendKey(key, depthStencil.minDepthBounds);
+	appendKey(key, depthStencil.maxDepthBounds);
+
+	appendKey(key, configInfo.dynamicStateEnables);
+	appendKey(key, configInfo.pipelineLayout);
+	appendKey(key, configInfo.renderPass);
+	appendKey(key, configInfo.subpass);
+	return key;
+}
+
+std::shared_ptr<CPipeline> CPipelineRegistry::requestGraphicsPipeline (const std::string &vertFilepath, const std::string &fragFilepath, const PipelineConfigInfo &configInfo)
+{
+	assert(configInfo.pipelineLayout != VK_NULL_HANDLE && "Cannot create graphics pipeline: no pipelineLayout provided in configInfo");
+	assert(configInfo.renderPass != VK_NULL_HANDLE && "Cannot create graphics pipeline: no renderPass provided in configInfo");
+	assert(configInfo.colorBlendInfo.attachmentCount <= 1 && "Cannot create graphics pipeline: only one blend attachment is supported");
+
+	std::lock_guard<std::mutex> lock {mutex};
+	++stats.requestCount;
+
+	PendingGraphicsPipeline pending {};
+	pending.vertShaderModule = getShaderModule(vertFilepath);
+	pending.fragShaderModule = getShaderModule(fragFilepath);
+
+	std::string key = "G" + getGraphicsKey(pending.vertShaderModule, pending.fragShaderModule, configInfo);
+	auto it = pipelines.find(key);
+	if (it != pipelines.end())
+	{
+		return it->second;
+	}
+
+	pending.pipeline = std::make_shared<CPipeline>(Device, VK_PIPELINE_BIND_POINT_GRAPHICS);
+	pending.configInfo = std::make_unique<PipelineConfigInfo>(configInfo);
+	pending.configInfo->colorBlendInfo.pAttachments = &pending.configInfo->colorBlendAttachment;
+	pending.configInfo->dynamicStateInfo.pDynamicStates = pending.configInfo->dynamicStateEnables.data();
+	pending.configInfo->dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(pending.configInfo->dynamicStateEnables.size());
+
+	pipelines.emplace(std::move(key), pending.pipeline);
+	pendingGraphicsPipelines.push_back(std::move(pending));
+	return pendingGraphicsPipelines.back().pipeline;
+}
+
+std::shared_ptr<CPipelineVariant> CPipelineRegistry::requestGraphicsVariant (const std::string &vertFilepath, const std::string &fragFilepath, const PipelineConfigInfo &configInfo, std::vector<SpecializationConstant> constants)
+{
+	std::shared_ptr<CPipeline> fallback = requestGraphicsPipeline(vertFilepath, fragFilepath, configInfo);
+
+	std::lock_guard<std::mutex> lock {mutex};
+	std::sort(constants.begin(), constants.end(), [] (const SpecializationConstant &a, const SpecializationConstant &b) { return a.constantID < b.constantID; });
+
+	PendingGraphicsPipeline pending {};
+	pending.vertShaderModule = getShaderModule(vertFilepath);
+	pending.fragShaderModule = getShaderModule(fragFilepath);
+
+	std::string key = "V" + getGraphicsKey(pending.vertShaderModule, pending.fragShaderModule, configInfo);
+	appendKey(key, constants);
+	auto it = variants.find(key);
+	if (it != variants.end())
+	{
+		return it->second;
+	}
+
+	auto variant = std::make_shared<CPipelineVariant>();
+	variant->fallback = fallback;
+	variants.emplace(std::move(key), variant);
+	++stats.variantCount;
+	if (constants.empty())
+	{
+		variant->specialized = fallback;
+		++stats.specializedCount;
+		return variant;
+	}
+
+	BackgroundVariant background {};
+	background.variant = variant;
+	background.pending = std::make_unique<PendingGraphicsPipeline>(std::move(pending));
+	background.pending->pipeline = std::make_shared<CPipeline>(Device, VK_PIPELINE_BIND_POINT_GRAPHICS);
+	background.pending->configInfo = std::make_unique<PipelineConfigInfo>(configInfo);
+	background.pending->configInfo->colorBlendInfo.pAttachments = &background.pending->configInfo->colorBlendAttachment;
+	background.pending->configInfo->dynamicStateInfo.pDynamicStates = background.pending->configInfo->dynamicStateEnables.data();
+	background.pending->configInfo->dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(background.pending->configInfo->dynamicStateEnables.size());
+	background.pending->constants = std::move(constants);
+
+	PendingGraphicsPipeline *pendingPipeline = background.pending.get();
+	background.task = WorkerPool.schedule([this, pendingPipeline] ()
+	{
+		if (createGraphicsPipelines(pendingPipeline, 1) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create specialized pipeline");
+		}
+	});
+	backgroundVariants.push_back(std::move(background));
+	return variant;
+}
+
+void CPipelineRegistry::update ()
+{
+	std::lock_guard<std::mutex> lock {mutex};
+	for (auto it = backgroundVariants.begin(); it != backgroundVariants.end();)
+	{
+		if (!it->task->isDone())
+		{
+			++it;
+			continue;
+		}
+
+		// a variant that failed to compile keeps drawing with its fallback, wait returns at once for a done task
+		try
+		{
+			WorkerPool.wait(it->task);
+			it->variant->specialized = it->pending->pipeline;
+			++stats.specializedCount;
+			++stats.pipelineCount;
+		}
+		catch (const std::exception &e)
+		{
+			std::cerr << e.what() << ", keeping the fallback" << std::endl;
+		}
+		it = backgroundVariants.erase(it);
+	}
+}
+
+std::shared_ptr<CPipeline> CPipelineRegistry::requestComputePipeline (const std::string &compFilepath, VkPipelineLayout pipelineLayout)
+{
+	assert(pipelineLayout != VK_NULL_HANDLE && "Cannot create compute pipeline: no pipelineLayout provided");
+
+	std::lock_guard<std::mutex> lock {mutex};
+	++stats.requestCount;
+
+	PendingComputePipeline pending {};
+	pending.compShaderModule = getShaderModule(compFilepath);
+	pending.pipelineLayout = pipelineLayout;
+
+	std::string key = "C";
+	appendKey(key, pending.compShaderModule);
+	appendKey(key, pipelineLayout);
+	auto it = pipelines.find(key);
+	if (it != pipelines.end())
+	{
+		return it->second;
+	}
+
+	pending.pipeline = std::make_shared<CPipeline>(Device, VK_PIPELINE_BIND_POINT_COMPUTE);
+	pipelines.emplace(std::move(key), pending.pipeline);
+	pendingComputePipelines.push_back(std::move(pending));
+	return pendingComputePipelines.back().pipeline;
+}
+
+size_t CPipelineRegistry::getBatchSize (size_t pipelineCount)
+{
+	const size_t threadCount = WorkerPool.getThreadCount();
+	return std::max<size_t>((pipelineCount + threadCount - 1) / threadCount, 1);
+}
+
+void CPipelineRegistry::compile ()
+{
+	std::lock_guard<std::mutex> lock {mutex};
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<PendingGraphicsPipeline> graphics = std::move(pendingGraphicsPipelines);
+	std::vector<PendingComputePipeline> compute = std::move(pendingComputePipelines);
+	pendingGraphicsPipelines.clear();
+	pendingComputePipelines.clear();
+	compileGraphicsPipelines(graphics);
+	compileComputePipelines(compute);
+
+	stats.compileTime += std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+VkResult CPipelineRegistry::createGraphicsPipelines (PendingGraphicsPipeline *pending, size_t count)
+{
+	std::vector<std::array<VkPipelineShaderStageCreateInfo, 2>> shaderStages(count);
+	std::vector<VkSpecializationInfo> specializationInfos(count);
+	std::vector<std::vector<VkSpecializationMapEntry>> mapEntries(count);
+	std::vector<VkPipelineVertexInputStateCreateInfo> vertexInputInfos(count);
+	std::vector<VkGraphicsPipelineCreateInfo> pipelineInfos(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const PipelineConfigInfo &configInfo = *pending[i].configInfo;
+		const std::vector<SpecializationConstant> &constants = pending[i].constants;
+
+		// the values are read straight from the constants, each is 4 bytes after its constant id
+		for (size_t j = 0; j < constants.size(); ++j)
+		{
+			mapEntries[i].push_back({constants[j].constantID, static_cast<uint32_t>(j * sizeof(SpecializationConstant) + offsetof(SpecializationConstant, value)), sizeof(uint32_t)});
+		}
+		VkSpecializationInfo &specializationInfo = specializationInfos[i];
+		specializationInfo.mapEntryCount = static_cast<uint32_t>(mapEntries[i].size());
+		specializationInfo.pMapEntries = mapEntries[i].data();
+		specializationInfo.dataSize = constants.size() * sizeof(SpecializationConstant);
+		specializationInfo.pData = constants.data();
+
+		for (VkPipelineShaderStageCreateInfo &stage: shaderStages[i])
+		{
+			stage = {};
+			stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			stage.pName = "main";
+			stage.pSpecializationInfo = constants.empty() ? nullptr : &specializationInfo;
+		}
+		shaderStages[i][0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+		shaderStages[i][0].module = pending[i].vertShaderModule;
+		shaderStages[i][1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		shaderStages[i][1].module = pending[i].fragShaderModule;
+
+		VkPipelineVertexInputStateCreateInfo &vertexInputInfo = vertexInputInfos[i];
+		vertexInputInfo = {};
+		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(configInfo.attributeDescriptions.size());
+		vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(configInfo.bindingDescriptions.size());
+		vertexInputInfo.pVertexAttributeDescriptions = configInfo.attributeDescriptions.data();
+		vertexInputInfo.pVertexBindingDescriptions = configInfo.bindingDescriptions.data();
+
+		VkGraphicsPipelineCreateInfo &pipelineInfo = pipelineInfos[i];
+		pipelineInfo = {};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineInfo.stageCount = 2;
+		pipelineInfo.pStages = shaderStages[i].data();
+		pipelineInfo.pVertexInputState = &vertexInputInfo;
+		pipelineInfo.pInputAssemblyState = &configInfo.inputAssemblyInfo;
+		pipelineInfo.pViewportState = &configInfo.viewportInfo;
+		pipelineInfo.pRasterizationState = &configInfo.rasterizationInfo;
+		pipelineInfo.pMultisampleState = &configInfo.multisampleInfo;
+		pipelineInfo.pColorBlendState = &configInfo.colorBlendInfo;
+		pipelineInfo.pDepthStencilState = &configInfo.depthStencilInfo;
+		pipelineInfo.pDynamicState = &configInfo.dynamicStateInfo;
+		pipelineInfo.layout = configInfo.pipelineLayout;
+		pipelineInfo.renderPass = configInfo.renderPass;
+		pipelineInfo.subpass = configInfo.subpass;
+		pipelineInfo.basePipelineIndex = -1;
+		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	}
+
+	std::vector<VkPipeline> handles(count, VK_NULL_HANDLE);
+	const VkResult result = vkCreateGraphicsPipelines(Device.GetDevice(), Device.getPipelineCache().getPipelineCache(), static_cast<uint32_t>(count), pipelineInfos.data(), nullptr, handles.data());
+	for (size_t i = 0; i < count; ++i)
+	{
+		pending[i].pipeline->pipeline = handles[i];
+	}
+	return result;
+}
+
+void CPipelineRegistry::compileGraphicsPipelines (std::vector<PendingGraphicsPipeline> &pending)
+{
+	if (pending.empty())
+	{
+		return;
+	}
+
+	// workers can not throw, each batch records its result instead
+	const size_t batchSize = getBatchSize(pending.size());
+	const size_t batchCount = (pending.size() + batchSize - 1) / batchSize;
+	std::vector<VkResult> results(batchCount, VK_SUCCESS);
+	WorkerPool.parallelFor(pending.size(), batchSize, [&] (size_t begin, size_t end)
+	{
+		results[begin / batchSize] = createGraphicsPipelines(&pending[begin], end - begin);
+	});
+
+	stats.pipelineCount += static_cast<uint32_t>(pending.size());
+	stats.batchCount += static_cast<uint32_t>(batchCount);
+
+	if (std::any_of(results.begin(), results.end(), [] (VkResult result) { return result != VK_SUCCESS; }))
+	{
+		throw std::runtime_error("failed to create graphics pipeline");
+	}
+}
+
+void CPipelineRegistry::compileComputePipelines (std::vector<PendingComputePipeline> &pending)
+{
+	if (pending.empty())
+	{
+		return;
+	}
+
+	std::vector<VkComputePipelineCreateInfo> pipelineInfos(pending.size());
+	for (size_t i = 0; i < pending.size(); ++i)
+	{
+		VkComputePipelineCreateInfo &pipelineInfo = pipelineInfos[i];
+		pipelineInfo = {};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = pending[i].compShaderModule;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = pending[i].pipelineLayout;
+		pipelineInfo.basePipelineIndex = -1;
+		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	}
+
+	const size_t batchSize = getBatchSize(pending.size());
+	const size_t batchCount = (pending.size() + batchSize - 1) / batchSize;
+	std::vector<VkPipeline> handles(pending.size(), VK_NULL_HANDLE);
+	std::vector<VkResult> results(batchCount, VK_SUCCESS);
+	WorkerPool.parallelFor(pending.size(), batchSize, [&] (size_t begin, size_t end)
+	{
+		results[begin / batchSize] = vkCreateComputePipelines(Device.GetDevice(), Device.getPipelineCache().getPipelineCache(), static_cast<uint32_t>(end - begin), &pipelineInfos[begin], nullptr, &handles[begin]);
+	});
+
+	for (size_t i = 0; i < pending.size(); ++i)
+	{
+		pending[i].pipeline->pipeline = handles[i];
+	}
+	stats.pipelineCount += static_cast<uint32_t>(pending.size());
+	stats.batchCount += static_cast<uint32_t>(batchCount);
+
+	if (std::any_of(results.begin(), results.end(), [] (VkResult result) { return result != VK_SUCCESS; }))
+	{
+		throw std::runtime_error("failed to create compute pipeline");
+	}
+}
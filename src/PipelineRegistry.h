@@ -0,0 +1,124 @@
+#pragma once
+
+#include "Device.h"
+#include "Pipeline.h"
+#include "WorkerPool.h"
+
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// Creates the pipelines of every render system. Requests with the same shaders and state return the same
+// CPipeline, every shader file is loaded into one module and pipeline layouts with the same set layouts and
+// push constants are shared. Pipelines are created by compile, which splits the requests since its last call
+// into one batch per worker thread, each created by a single vkCreate*Pipelines call through the device's
+// pipeline cache. A requested pipeline must not be bound before compile has run.
+// Variants are specialized by constants and compiled by worker pool tasks, so using one for the first time
+// does not stall the frame. Their generic fallback is compiled like any other request.
+class CPipelineRegistry
+{
+public:
+	struct Stats
+	{
+		uint32_t requestCount = 0;
+		uint32_t pipelineCount = 0;
+		uint32_t shaderModuleCount = 0;
+		uint32_t pipelineLayoutCount = 0;
+		uint32_t batchCount = 0;
+		uint32_t variantCount = 0;
+		// variants whose specialized pipeline has been swapped in
+		uint32_t specializedCount = 0;
+		// milliseconds spent in compile
+		float compileTime = 0.f;
+	};
+
+	CPipelineRegistry (CDevice &device, CWorkerPool &workerPool);
+
+	~CPipelineRegistry ();
+
+	CPipelineRegistry (const CPipelineRegistry &) = delete;
+
+	CPipelineRegistry &operator= (const CPipelineRegistry &) = delete;
+
+	// only the first blend attachment of configInfo is used
+	std::shared_ptr<CPipeline> requestGraphicsPipeline (const std::string &vertFilepath, const std::string &fragFilepath, const PipelineConfigInfo &configInfo);
+
+	// the fallback is requestGraphicsPipeline with the same arguments and is created by the next compile, it is
+	// drawn with until update swaps in the specialized pipeline
+	std::shared_ptr<CPipelineVariant> requestGraphicsVariant (const std::string &vertFilepath, const std::string &fragFilepath, const PipelineConfigInfo &configInfo, std::vector<SpecializationConstant> constants);
+
+	std::shared_ptr<CPipeline> requestComputePipeline (const std::string &compFilepath, VkPipelineLayout pipelineLayout);
+
+	// the layout is owned by the registry
+	VkPipelineLayout getPipelineLayout (const std::vector<VkDescriptorSetLayout> &setLayouts, const std::vector<VkPushConstantRange> &pushConstantRanges = {});
+
+	// creates the pipelines requested since the last call and returns once all of them exist
+	void compile ();
+
+	// called once per frame while no commands are recorded, swaps in the variants whose compilation has finished
+	void update ();
+
+	const Stats &getStats () const
+	{
+		return stats;
+	}
+
+private:
+	struct PendingGraphicsPipeline
+	{
+		std::shared_ptr<CPipeline> pipeline;
+		VkShaderModule vertShaderModule;
+		VkShaderModule fragShaderModule;
+		// a copy whose internal pointers point into itself, so the state outlives the request
+		std::unique_ptr<PipelineConfigInfo> configInfo;
+		// applied to both stages, sorted by constant id
+		std::vector<SpecializationConstant> constants;
+	};
+
+	struct BackgroundVariant
+	{
+		std::shared_ptr<CPipelineVariant> variant;
+		std::unique_ptr<PendingGraphicsPipeline> pending;
+		// a worker pool task, throws when the pipeline could not be created
+		CWorkerPool::Task task;
+	};
+
+	struct PendingComputePipeline
+	{
+		std::shared_ptr<CPipeline> pipeline;
+		VkShaderModule compShaderModule;
+		VkPipelineLayout pipelineLayout;
+	};
+
+	VkShaderModule getShaderModule (const std::string &filepath);
+
+	// the bytes of every state that affects the created pipeline, pointers are followed instead of compared
+	static std::string getGraphicsKey (VkShaderModule vertShaderModule, VkShaderModule fragShaderModule, const PipelineConfigInfo &configInfo);
+
+	// creates count pipelines with one vkCreateGraphicsPipelines call, safe to call from any thread
+	VkResult createGraphicsPipelines (PendingGraphicsPipeline *pending, size_t count);
+
+	void compileGraphicsPipelines (std::vector<PendingGraphicsPipeline> &pending);
+
+	void compileComputePipelines (std::vector<PendingComputePipeline> &pending);
+
+	// pipelines per batch so that every thread of the worker pool creates one batch
+	size_t getBatchSize (size_t pipelineCount);
+
+	CDevice &Device;
+	CWorkerPool &WorkerPool;
+
+	std::unordered_map<std::string, VkShaderModule> shaderModules;
+	std::unordered_map<std::string, VkPipelineLayout> pipelineLayouts;
+	std::unordered_map<std::string, std::shared_ptr<CPipeline>> pipelines;
+	std::unordered_map<std::string, std::shared_ptr<CPipelineVariant>> variants;
+	std::vector<BackgroundVariant> backgroundVariants;
+	std::vector<PendingGraphicsPipeline> pendingGraphicsPipelines;
+	std::vector<PendingComputePipeline> pendingComputePipelines;
+	Stats stats {};
+	std::mutex mutex;
+};
@@ -0,0 +1,88 @@
+#include "RangeAllocator.h"
+
+// std
+#include <cassert>
+#include <iterator>
+
+
+CRangeAllocator::CRangeAllocator (uint64_t capacity)
+	: capacity {capacity}
+{
+	if (capacity > 0)
+	{
+		insertFreeRange(0, capacity);
+	}
+}
+
+bool CRangeAllocator::allocate (uint64_t size, uint64_t alignment, uint64_t &offset)
+{
+	assert(size > 0 && alignment > 0 && "Range size and alignment must be non zero");
+
+	// the smallest ranges first, skipping ones that are too small once the start is aligned
+	for (auto candidate = freeBySize.lower_bound({size, 0}); candidate != freeBySize.end(); ++candidate)
+	{
+		const uint64_t rangeSize = candidate->first;
+		const uint64_t rangeOffset = candidate->second;
+		const uint64_t alignedOffset = (rangeOffset + alignment - 1) / alignment * alignment;
+		const uint64_t padding = alignedOffset - rangeOffset;
+		if (padding + size > rangeSize)
+		{
+			continue;
+		}
+
+		eraseFreeRange(freeRanges.find(rangeOffset));
+		if (padding > 0)
+		{
+			insertFreeRange(rangeOffset, padding);
+		}
+		if (padding + size < rangeSize)
+		{
+			insertFreeRange(alignedOffset + size, rangeSize - padding - size);
+		}
+
+		usedSize += size;
+		offset = alignedOffset;
+		return true;
+	}
+
+	return false;
+}
+
+void CRangeAllocator::free (uint64_t offset, uint64_t size)
+{
+	assert(offset + size <= capacity && "Freed range is outside the allocator");
+	usedSize -= size;
+
+	auto next = freeRanges.lower_bound(offset);
+	if (next != freeRanges.end() && next->first == offset + size)
+	{
+		size += next->second;
+		next = std::next(next);
+		eraseFreeRange(std::prev(next));
+	}
+
+	if (next != freeRanges.begin())
+	{
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset)
+		{
+			offset = previous->first;
+			size += previous->second;
+			eraseFreeRange(previous);
+		}
+	}
+
+	insertFreeRange(offset, size);
+}
+
+void CRangeAllocator::insertFreeRange (uint64_t offset, uint64_t size)
+{
+	freeRanges.emplace(offset, size);
+	freeBySize.emplace(size, offset);
+}
+
+void CRangeAllocator::eraseFreeRange (std::map<uint64_t, uint64_t>::iterator range)
+{
+	freeBySize.erase({range->second, range->first});
+	freeRanges.erase(range);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <utility>
+
+
+// Best fit allocator of ranges inside [0, capacity). Freed ranges merge with their free neighbours.
+// Alignments do not need to be powers of two, so ranges can be aligned to a vertex stride.
+class CRangeAllocator
+{
+public:
+	explicit CRangeAllocator (uint64_t capacity);
+
+	// returns false when no free range can hold size bytes at the requested alignment
+	bool allocate (uint64_t size, uint64_t alignment, uint64_t &offset);
+
+	void free (uint64_t offset, uint64_t size);
+
+	uint64_t getCapacity () const
+	{
+		return capacity;
+	}
+
+	uint64_t getUsedSize () const
+	{
+		return usedSize;
+	}
+
+	size_t getFreeRangeCount () const
+	{
+		return freeRanges.size();
+	}
+
+	uint64_t getLargestFreeRange () const
+	{
+		return freeBySize.empty() ? 0 : freeBySize.rbegin()->first;
+	}
+
+private:
+	void insertFreeRange (uint64_t offset, uint64_t size);
+
+	void eraseFreeRange (std::map<uint64_t, uint64_t>::iterator range);
+
+	uint64_t capacity;
+	uint64_t usedSize = 0;
+
+	// offset -> size, and (size, offset) for the best fit search
+	std::map<uint64_t, uint64_t> freeRanges;
+	std::set<std::pair<uint64_t, uint64_t>> freeBySize;
+};
@@ -119,7 +119,7 @@ void CRenderer::endFrame ()
 	currentFrameIndex = (currentFrameIndex + 1) % CSwapChain::MAX_FRAMES_IN_FLIGHT;
 }
 
-void CRenderer::beginSwapChainRenderPass (VkCommandBuffer commandBuffer)
+void CRenderer::beginSwapChainRenderPass (VkCommandBuffer commandBuffer, VkSubpassContents contents)
 {
 	assert(isFrameStarted && "Can't call beginSwapChainRenderPass if frame is not in progress");
 	assert(commandBuffer == getCurrentCommandBuffer() && "Can't begin render pass on command buffer from a different frame");
@@ -138,7 +138,11 @@ void CRenderer::beginSwapChainRenderPass (VkCommandBuffer commandBuffer)
 	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 	renderPassInfo.pClearValues = clearValues.data();
 
-	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+	if (contents != VK_SUBPASS_CONTENTS_INLINE)
+	{
+		return;
+	}
 
 	VkViewport viewport {};
 	viewport.x = 0.0f;
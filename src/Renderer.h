@@ -26,6 +26,35 @@ public:
 		return SwapChain->extentAspectRatio();
 	}
 
+	VkExtent2D getSwapChainExtent () const
+	{
+		return SwapChain->getSwapChainExtent();
+	}
+
+	// depth attachment of the frame in progress, it holds the frame's depth after its render pass has ended
+	VkImage getCurrentDepthImage () const
+	{
+		assert(isFrameStarted && "Cannot get depth image when frame not in progress");
+		return SwapChain->getDepthImage(static_cast<int>(currentImageIndex));
+	}
+
+	VkImageView getCurrentDepthImageView () const
+	{
+		assert(isFrameStarted && "Cannot get depth image view when frame not in progress");
+		return SwapChain->getDepthImageView(static_cast<int>(currentImageIndex));
+	}
+
+	VkFramebuffer getCurrentFrameBuffer () const
+	{
+		assert(isFrameStarted && "Cannot get frame buffer when frame not in progress");
+		return SwapChain->getFrameBuffer(static_cast<int>(currentImageIndex));
+	}
+
+	VkFormat getDepthFormat () const
+	{
+		return SwapChain->getSwapChainDepthFormat();
+	}
+
 	bool isFrameInProgress () const
 	{
 		return isFrameStarted;
@@ -47,7 +76,8 @@ public:
 
 	void endFrame ();
 
-	void beginSwapChainRenderPass (VkCommandBuffer commandBuffer);
+	// with secondary contents the pass may only execute secondary command buffers, which set their own viewport
+	void beginSwapChainRenderPass (VkCommandBuffer commandBuffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 
 	void endSwapChainRenderPass (VkCommandBuffer commandBuffer);
 
@@ -32,6 +32,21 @@ public:
 		return swapChainImageViews[index];
 	}
 
+	VkImage getDepthImage (int index)
+	{
+		return depthImages[index];
+	}
+
+	VkImageView getDepthImageView (int index)
+	{
+		return depthImageViews[index];
+	}
+
+	VkFormat getSwapChainDepthFormat ()
+	{
+		return swapChainDepthFormat;
+	}
+
 	size_t imageCount ()
 	{
 		return swapChainImages.size();
@@ -103,7 +118,7 @@ private:
 	VkRenderPass renderPass;
 
 	std::vector<VkImage> depthImages;
-	std::vector<VkDeviceMemory> depthImageMemorys;
+	std::vector<CMemoryAllocator::Allocation> depthImageMemorys;
 	std::vector<VkImageView> depthImageViews;
 	std::vector<VkImage> swapChainImages;
 	std::vector<VkImageView> swapChainImageViews;
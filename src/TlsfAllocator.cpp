@@ -0,0 +1,279 @@
+#include "TlsfAllocator.h"
+
+// std
+#include <algorithm>
+#include <cassert>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+static uint32_t lowestBit (uint64_t mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, mask);
+	return index;
+#else
+	return __builtin_ctzll(mask);
+#endif
+}
+
+static uint32_t highestBit (uint64_t mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, mask);
+	return index;
+#else
+	return 63 - __builtin_clzll(mask);
+#endif
+}
+
+CTlsfAllocator::CTlsfAllocator (uint64_t capacity)
+	: capacity {capacity}
+{
+	for (auto &heads: freeHeads)
+	{
+		std::fill(std::begin(heads), std::end(heads), INVALID_NODE);
+	}
+
+	if (capacity > 0)
+	{
+		uint32_t node = createNode();
+		nodes[node].size = capacity;
+		insertFreeNode(node);
+	}
+}
+
+void CTlsfAllocator::mapping (uint64_t size, uint32_t &firstLevel, uint32_t &secondLevel)
+{
+	if (size < (1ull << SMALL_SIZE_LOG2))
+	{
+		firstLevel = 0;
+		secondLevel = static_cast<uint32_t>(size >> (SMALL_SIZE_LOG2 - SECOND_LEVEL_LOG2));
+		return;
+	}
+
+	const uint32_t topBit = highestBit(size);
+	firstLevel = topBit - SMALL_SIZE_LOG2 + 1;
+	secondLevel = static_cast<uint32_t>(size >> (topBit - SECOND_LEVEL_LOG2)) ^ SECOND_LEVEL_COUNT;
+}
+
+uint32_t CTlsfAllocator::findFreeNode (uint64_t size) const
+{
+	// rounding up to the next size class means any range in the list found is large enough
+	if (size < (1ull << SMALL_SIZE_LOG2))
+	{
+		const uint64_t step = 1ull << (SMALL_SIZE_LOG2 - SECOND_LEVEL_LOG2);
+		size = (size + step - 1) & ~(step - 1);
+	}
+	else
+	{
+		size += (1ull << (highestBit(size) - SECOND_LEVEL_LOG2)) - 1;
+	}
+
+	uint32_t firstLevel;
+	uint32_t secondLevel;
+	mapping(size, firstLevel, secondLevel);
+	if (firstLevel >= FIRST_LEVEL_COUNT)
+	{
+		return INVALID_NODE;
+	}
+
+	uint32_t secondLevelMask = secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+	if (secondLevelMask == 0)
+	{
+		const uint64_t firstLevelMask = firstLevelBitmap & (~0ull << (firstLevel + 1));
+		if (firstLevelMask == 0)
+		{
+			return INVALID_NODE;
+		}
+		firstLevel = lowestBit(firstLevelMask);
+		secondLevelMask = secondLevelBitmaps[firstLevel];
+	}
+
+	return freeHeads[firstLevel][lowestBit(secondLevelMask)];
+}
+
+uint32_t CTlsfAllocator::allocate (uint64_t size, uint64_t alignment, uint64_t &offset)
+{
+	assert(size > 0 && "Allocation size must be non zero");
+	assert(alignment > 0 && (alignment & (alignment - 1)) == 0 && "Alignment must be a power of two");
+
+	const uint32_t node = findFreeNode(size + alignment - 1);
+	if (node == INVALID_NODE)
+	{
+		return INVALID_NODE;
+	}
+	removeFreeNode(node);
+
+	// the physical neighbours of a free range are never free, so the padding and the remainder become new free ranges
+	const uint64_t alignedOffset = (nodes[node].offset + alignment - 1) & ~(alignment - 1);
+	const uint64_t padding = alignedOffset - nodes[node].offset;
+	if (padding > 0)
+	{
+		uint32_t paddingNode = createNode();
+		nodes[paddingNode].offset = nodes[node].offset;
+		nodes[paddingNode].size = padding;
+		nodes[paddingNode].previousPhysical = nodes[node].previousPhysical;
+		nodes[paddingNode].nextPhysical = node;
+		if (nodes[node].previousPhysical != INVALID_NODE)
+		{
+			nodes[nodes[node].previousPhysical].nextPhysical = paddingNode;
+		}
+		nodes[node].previousPhysical = paddingNode;
+		nodes[node].offset = alignedOffset;
+		nodes[node].size -= padding;
+		insertFreeNode(paddingNode);
+	}
+
+	if (nodes[node].size > size)
+	{
+		uint32_t remainderNode = createNode();
+		nodes[remainderNode].offset = nodes[node].offset + size;
+		nodes[remainderNode].size = nodes[node].size - size;
+		nodes[remainderNode].previousPhysical = node;
+		nodes[remainderNode].nextPhysical = nodes[node].nextPhysical;
+		if (nodes[node].nextPhysical != INVALID_NODE)
+		{
+			nodes[nodes[node].nextPhysical].previousPhysical = remainderNode;
+		}
+		nodes[node].nextPhysical = remainderNode;
+		nodes[node].size = size;
+		insertFreeNode(remainderNode);
+	}
+
+	usedSize += size;
+	++allocationCount;
+	offset = nodes[node].offset;
+	return node;
+}
+
+void CTlsfAllocator::free (uint32_t node)
+{
+	assert(node < nodes.size() && !nodes[node].free && "Freed node is not allocated");
+	usedSize -= nodes[node].size;
+	--allocationCount;
+
+	const uint32_t previous = nodes[node].previousPhysical;
+	if (previous != INVALID_NODE && nodes[previous].free)
+	{
+		removeFreeNode(previous);
+		nodes[node].offset = nodes[previous].offset;
+		nodes[node].size += nodes[previous].size;
+		nodes[node].previousPhysical = nodes[previous].previousPhysical;
+		if (nodes[node].previousPhysical != INVALID_NODE)
+		{
+			nodes[nodes[node].previousPhysical].nextPhysical = node;
+		}
+		releaseNode(previous);
+	}
+
+	const uint32_t next = nodes[node].nextPhysical;
+	if (next != INVALID_NODE && nodes[next].free)
+	{
+		removeFreeNode(next);
+		nodes[node].size += nodes[next].size;
+		nodes[node].nextPhysical = nodes[next].nextPhysical;
+		if (nodes[node].nextPhysical != INVALID_NODE)
+		{
+			nodes[nodes[node].nextPhysical].previousPhysical = node;
+		}
+		releaseNode(next);
+	}
+
+	insertFreeNode(node);
+}
+
+uint64_t CTlsfAllocator::getLargestFreeRange () const
+{
+	if (firstLevelBitmap == 0)
+	{
+		return 0;
+	}
+
+	// the largest range is somewhere in the highest non empty list
+	const uint32_t firstLevel = highestBit(firstLevelBitmap);
+	const uint32_t secondLevel = highestBit(secondLevelBitmaps[firstLevel]);
+	uint64_t largest = 0;
+	for (uint32_t node = freeHeads[firstLevel][secondLevel]; node != INVALID_NODE; node = nodes[node].nextFree)
+	{
+		largest = std::max(largest, nodes[node].size);
+	}
+	return largest;
+}
+
+void CTlsfAllocator::insertFreeNode (uint32_t node)
+{
+	uint32_t firstLevel;
+	uint32_t secondLevel;
+	mapping(nodes[node].size, firstLevel, secondLevel);
+
+	uint32_t &head = freeHeads[firstLevel][secondLevel];
+	nodes[node].free = true;
+	nodes[node].previousFree = INVALID_NODE;
+	nodes[node].nextFree = head;
+	if (head != INVALID_NODE)
+	{
+		nodes[head].previousFree = node;
+	}
+	head = node;
+
+	firstLevelBitmap |= 1ull << firstLevel;
+	secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+	++freeRangeCount;
+}
+
+void CTlsfAllocator::removeFreeNode (uint32_t node)
+{
+	uint32_t firstLevel;
+	uint32_t secondLevel;
+	mapping(nodes[node].size, firstLevel, secondLevel);
+
+	if (nodes[node].previousFree != INVALID_NODE)
+	{
+		nodes[nodes[node].previousFree].nextFree = nodes[node].nextFree;
+	}
+	else
+	{
+		freeHeads[firstLevel][secondLevel] = nodes[node].nextFree;
+	}
+	if (nodes[node].nextFree != INVALID_NODE)
+	{
+		nodes[nodes[node].nextFree].previousFree = nodes[node].previousFree;
+	}
+
+	if (freeHeads[firstLevel][secondLevel] == INVALID_NODE)
+	{
+		secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+		if (secondLevelBitmaps[firstLevel] == 0)
+		{
+			firstLevelBitmap &= ~(1ull << firstLevel);
+		}
+	}
+
+	nodes[node].free = false;
+	--freeRangeCount;
+}
+
+uint32_t CTlsfAllocator::createNode ()
+{
+	if (unusedNodes.empty())
+	{
+		nodes.emplace_back();
+		return static_cast<uint32_t>(nodes.size() - 1);
+	}
+
+	uint32_t node = unusedNodes.back();
+	unusedNodes.pop_back();
+	nodes[node] = Node {};
+	return node;
+}
+
+void CTlsfAllocator::releaseNode (uint32_t node)
+{
+	nodes[node].free = false;
+	unusedNodes.push_back(node);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Two level segregated fit allocator of ranges inside [0, capacity). Free ranges are kept in lists of
+// size classes with bitmaps over them, so allocate and free take constant time. Neighbouring free
+// ranges are merged on free.
+class CTlsfAllocator
+{
+public:
+	static constexpr uint32_t INVALID_NODE = UINT32_MAX;
+
+	explicit CTlsfAllocator (uint64_t capacity);
+
+	// alignment must be a power of two, returns INVALID_NODE when no free range is large enough
+	uint32_t allocate (uint64_t size, uint64_t alignment, uint64_t &offset);
+
+	void free (uint32_t node);
+
+	uint64_t getCapacity () const
+	{
+		return capacity;
+	}
+
+	uint64_t getUsedSize () const
+	{
+		return usedSize;
+	}
+
+	uint32_t getAllocationCount () const
+	{
+		return allocationCount;
+	}
+
+	bool isEmpty () const
+	{
+		return allocationCount == 0;
+	}
+
+	uint32_t getFreeRangeCount () const
+	{
+		return freeRangeCount;
+	}
+
+	uint64_t getLargestFreeRange () const;
+
+private:
+	static constexpr uint32_t SECOND_LEVEL_LOG2 = 5;
+	static constexpr uint32_t SECOND_LEVEL_COUNT = 1 << SECOND_LEVEL_LOG2;
+	// sizes below 256 bytes are split linearly over the second level of the first list
+	static constexpr uint32_t SMALL_SIZE_LOG2 = 8;
+	static constexpr uint32_t FIRST_LEVEL_COUNT = 64 - SMALL_SIZE_LOG2 + 1;
+
+	struct Node
+	{
+		uint64_t offset = 0;
+		uint64_t size = 0;
+		uint32_t previousPhysical = INVALID_NODE;
+		uint32_t nextPhysical = INVALID_NODE;
+		uint32_t previousFree = INVALID_NODE;
+		uint32_t nextFree = INVALID_NODE;
+		bool free = false;
+	};
+
+	static void mapping (uint64_t size, uint32_t &firstLevel, uint32_t &secondLevel);
+
+	// first free node of a list whose every range is at least size bytes
+	uint32_t findFreeNode (uint64_t size) const;
+
+	void insertFreeNode (uint32_t node);
+
+	void removeFreeNode (uint32_t node);
+
+	uint32_t createNode ();
+
+	void releaseNode (uint32_t node);
+
+	uint64_t capacity;
+	uint64_t usedSize = 0;
+	uint32_t allocationCount = 0;
+	uint32_t freeRangeCount = 0;
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> unusedNodes;
+
+	uint64_t firstLevelBitmap = 0;
+	uint32_t secondLevelBitmaps[FIRST_LEVEL_COUNT] = {};
+	uint32_t freeHeads[FIRST_LEVEL_COUNT][SECOND_LEVEL_COUNT];
+};
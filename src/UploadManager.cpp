@@ -0,0 +1,345 @@
+#include "UploadManager.h"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+
+CUploadManager::CUploadManager (CDevice &device, VkDeviceSize capacity)
+	: Device {device}, capacity {capacity}
+{
+	QueueFamilyIndices queueFamilyIndices = Device.findPhysicalQueueFamilies();
+	dedicatedTransfer = Device.hasDedicatedTransferQueue();
+	graphicsFamily = queueFamilyIndices.graphicsFamily;
+	transferFamily = dedicatedTransfer ? queueFamilyIndices.transferFamily : graphicsFamily;
+
+	commandPool = createCommandPool(transferFamily);
+	if (dedicatedTransfer)
+	{
+		acquireCommandPool = createCommandPool(graphicsFamily);
+	}
+
+	// a multiple of 16 keeps image copies aligned to their texel size
+	alignment = std::max<VkDeviceSize>(16, Device.properties.limits.optimalBufferCopyOffsetAlignment);
+	this->capacity = capacity / alignment * alignment;
+
+	ringBuffer = std::make_unique<CBuffer>(Device, 1, static_cast<uint32_t>(this->capacity), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	ringBuffer->map();
+}
+
+CUploadManager::~CUploadManager ()
+{
+	submit();
+	for (auto &submission: submissions)
+	{
+		vkWaitForFences(Device.GetDevice(), 1, &submission.fence, VK_TRUE, UINT64_MAX);
+		idleSubmissions.push_back(std::move(submission));
+	}
+	for (auto &submission: idleSubmissions)
+	{
+		vkDestroyFence(Device.GetDevice(), submission.fence, nullptr);
+		vkDestroySemaphore(Device.GetDevice(), submission.transferComplete, nullptr);
+	}
+
+	vkDestroyCommandPool(Device.GetDevice(), commandPool, nullptr);
+	vkDestroyCommandPool(Device.GetDevice(), acquireCommandPool, nullptr);
+}
+
+VkCommandPool CUploadManager::createCommandPool (uint32_t queueFamily)
+{
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queueFamily;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+	VkCommandPool pool;
+	if (vkCreateCommandPool(Device.GetDevice(), &poolInfo, nullptr, &pool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create upload command pool!");
+	}
+	return pool;
+}
+
+void *CUploadManager::stageBuffer (VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset)
+{
+	VkBuffer stagingBuffer;
+	VkDeviceSize stagingOffset;
+	void *staging = allocateStaging(size, stagingBuffer, stagingOffset);
+
+	VkBufferCopy copyRegion {};
+	copyRegion.srcOffset = stagingOffset;
+	copyRegion.dstOffset = dstOffset;
+	copyRegion.size = size;
+	vkCmdCopyBuffer(getCommandBuffer(), stagingBuffer, dstBuffer, 1, &copyRegion);
+	return staging;
+}
+
+void CUploadManager::uploadBuffer (const void *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset)
+{
+	memcpy(stageBuffer(size, dstBuffer, dstOffset), data, size);
+}
+
+void CUploadManager::uploadImage (const void *data, VkDeviceSize size, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount)
+{
+	VkBuffer stagingBuffer;
+	VkDeviceSize stagingOffset;
+	memcpy(allocateStaging(size, stagingBuffer, stagingOffset), data, size);
+
+	VkCommandBuffer commandBuffer = getCommandBuffer();
+
+	VkImageMemoryBarrier barrier {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.layerCount = layerCount;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	VkBufferImageCopy region {};
+	region.bufferOffset = stagingOffset;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = layerCount;
+	region.imageOffset = {0, 0, 0};
+	region.imageExtent = {width, height, 1};
+	vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	// on a transfer queue the layout transition is part of the release to the graphics family
+	if (dedicatedTransfer)
+	{
+		barrier.dstAccessMask = 0;
+		barrier.srcQueueFamilyIndex = transferFamily;
+		barrier.dstQueueFamilyIndex = graphicsFamily;
+		imageReleaseBarriers.push_back(barrier);
+		return;
+	}
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void CUploadManager::submit ()
+{
+	if (recording.commandBuffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	if (dedicatedTransfer)
+	{
+		// the buffer copies are made available by the semaphore signal
+		vkCmdPipelineBarrier(recording.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(imageReleaseBarriers.size()), imageReleaseBarriers.data());
+	}
+	else
+	{
+		// makes the copies visible to everything submitted to the queue afterwards
+		VkMemoryBarrier barrier {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		vkCmdPipelineBarrier(recording.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	if (vkEndCommandBuffer(recording.commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to record upload command buffer!");
+	}
+
+	VkSubmitInfo submitInfo {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &recording.commandBuffer;
+	if (dedicatedTransfer)
+	{
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &recording.transferComplete;
+	}
+
+	if (vkQueueSubmit(Device.transferQueue(), 1, &submitInfo, dedicatedTransfer ? VK_NULL_HANDLE : recording.fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to submit upload command buffer!");
+	}
+
+	if (dedicatedTransfer)
+	{
+		submitAcquire();
+	}
+
+	recording.ringEnd = head;
+	submissions.push_back(std::move(recording));
+	recording = Submission {};
+}
+
+void CUploadManager::submitAcquire ()
+{
+	VkCommandBufferBeginInfo beginInfo {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(recording.acquireCommandBuffer, &beginInfo);
+
+	// the semaphore wait only covers this submission, the barrier carries the buffer copies on to the later ones
+	VkMemoryBarrier memoryBarrier {};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.srcAccessMask = 0;
+	memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	for (auto &barrier: imageReleaseBarriers)
+	{
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	}
+	vkCmdPipelineBarrier(recording.acquireCommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &memoryBarrier, 0, nullptr, static_cast<uint32_t>(imageReleaseBarriers.size()), imageReleaseBarriers.data());
+	imageReleaseBarriers.clear();
+
+	if (vkEndCommandBuffer(recording.acquireCommandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to record upload acquire command buffer!");
+	}
+
+	// the graphics queue only waits here, frames submitted before the upload keep running
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	VkSubmitInfo submitInfo {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pWaitSemaphores = &recording.transferComplete;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &recording.acquireCommandBuffer;
+
+	if (vkQueueSubmit(Device.graphicsQueue(), 1, &submitInfo, recording.fence) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to submit upload acquire command buffer!");
+	}
+}
+
+void *CUploadManager::allocateStaging (VkDeviceSize size, VkBuffer &stagingBuffer, VkDeviceSize &stagingOffset)
+{
+	if (size > capacity)
+	{
+		auto buffer = std::make_unique<CBuffer>(Device, 1, static_cast<uint32_t>(size), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		buffer->map();
+		stagingBuffer = buffer->getBuffer();
+		stagingOffset = 0;
+
+		getCommandBuffer();
+		recording.stagingBuffers.push_back(std::move(buffer));
+		return recording.stagingBuffers.back()->getMappedMemory();
+	}
+
+	retireSubmissions(false);
+	for (;;)
+	{
+		// nothing staged is still in use, so the next upload can start at the beginning of the ring
+		if (head == tail)
+		{
+			head = (head + capacity - 1) / capacity * capacity;
+			tail = head;
+		}
+
+		VkDeviceSize start = (head + alignment - 1) / alignment * alignment;
+		if (start % capacity + size > capacity)
+		{
+			start = (start / capacity + 1) * capacity;
+		}
+
+		if (start + size - tail <= capacity)
+		{
+			head = start + size;
+			stagingBuffer = ringBuffer->getBuffer();
+			stagingOffset = start % capacity;
+			return static_cast<char *>(ringBuffer->getMappedMemory()) + stagingOffset;
+		}
+
+		// the ring is full, the copies recorded so far have to be submitted before their space can come back
+		if (submissions.empty())
+		{
+			submit();
+		}
+		retireSubmissions(true);
+	}
+}
+
+VkCommandBuffer CUploadManager::getCommandBuffer ()
+{
+	if (recording.commandBuffer != VK_NULL_HANDLE)
+	{
+		return recording.commandBuffer;
+	}
+
+	if (!idleSubmissions.empty())
+	{
+		recording = std::move(idleSubmissions.back());
+		idleSubmissions.pop_back();
+	}
+	else
+	{
+		VkCommandBufferAllocateInfo allocInfo {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = commandPool;
+		allocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(Device.GetDevice(), &allocInfo, &recording.commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate upload command buffer!");
+		}
+
+		VkFenceCreateInfo fenceInfo {};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		if (vkCreateFence(Device.GetDevice(), &fenceInfo, nullptr, &recording.fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create upload fence!");
+		}
+
+		if (dedicatedTransfer)
+		{
+			allocInfo.commandPool = acquireCommandPool;
+			VkSemaphoreCreateInfo semaphoreInfo {};
+			semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			if (vkAllocateCommandBuffers(Device.GetDevice(), &allocInfo, &recording.acquireCommandBuffer) != VK_SUCCESS || vkCreateSemaphore(Device.GetDevice(), &semaphoreInfo, nullptr, &recording.transferComplete) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create upload ownership transfer objects!");
+			}
+		}
+	}
+
+	VkCommandBufferBeginInfo beginInfo {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(recording.commandBuffer, &beginInfo);
+	return recording.commandBuffer;
+}
+
+void CUploadManager::retireSubmissions (bool waitForOldest)
+{
+	if (waitForOldest && !submissions.empty())
+	{
+		vkWaitForFences(Device.GetDevice(), 1, &submissions.front().fence, VK_TRUE, UINT64_MAX);
+	}
+
+	while (!submissions.empty() && vkGetFenceStatus(Device.GetDevice(), submissions.front().fence) == VK_SUCCESS)
+	{
+		Submission &submission = submissions.front();
+		tail = std::max(tail, submission.ringEnd);
+		submission.stagingBuffers.clear();
+		vkResetFences(Device.GetDevice(), 1, &submission.fence);
+		vkResetCommandBuffer(submission.commandBuffer, 0);
+		if (submission.acquireCommandBuffer != VK_NULL_HANDLE)
+		{
+			vkResetCommandBuffer(submission.acquireCommandBuffer, 0);
+		}
+
+		idleSubmissions.push_back(std::move(submission));
+		submissions.pop_front();
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Buffer.h"
+#include "Device.h"
+
+// std
+#include <deque>
+#include <memory>
+#include <vector>
+
+
+// Stages uploads in a persistently mapped ring buffer and records their copies into one command buffer,
+// submitted by submit. Each submission has a fence, and the ring space it used is reused once the fence
+// has signaled, so uploading never waits for the queue to go idle.
+// On devices with a separate transfer family the copies run on the transfer queue, and a small graphics submission
+// waits on the transfer semaphore, so only the frames submitted after an upload wait for it. Buffer destinations
+// are shared with the transfer family, since the graphics queue keeps reading their other ranges, while images
+// are released to the graphics family and acquired by that submission.
+class CUploadManager
+{
+public:
+	static constexpr VkDeviceSize DEFAULT_CAPACITY = 32 * 1024 * 1024;
+
+	CUploadManager (CDevice &device, VkDeviceSize capacity = DEFAULT_CAPACITY);
+
+	~CUploadManager ();
+
+	CUploadManager (const CUploadManager &) = delete;
+
+	CUploadManager &operator= (const CUploadManager &) = delete;
+
+	// returns staging memory for size bytes that is copied to dstBuffer at dstOffset, it must be written before the next submit,
+	// dstBuffer has to be created sharedWithTransfer
+	void *stageBuffer (VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset);
+
+	void uploadBuffer (const void *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset);
+
+	// copies tightly packed texels into every layer of mip 0, the image ends in SHADER_READ_ONLY_OPTIMAL layout
+	void uploadImage (const void *data, VkDeviceSize size, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
+
+	// submits the copies recorded since the last call, later submissions on the queue see their results
+	void submit ();
+
+	bool hasPendingCopies () const
+	{
+		return recording.commandBuffer != VK_NULL_HANDLE;
+	}
+
+private:
+	struct Submission
+	{
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		// graphics side of the ownership transfer, only used with a dedicated transfer queue
+		VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;
+		VkSemaphore transferComplete = VK_NULL_HANDLE;
+		// signaled by the last submission of the upload
+		VkFence fence = VK_NULL_HANDLE;
+		// ring position after the last byte staged for this submission
+		VkDeviceSize ringEnd = 0;
+		// uploads larger than the ring get their own staging buffer
+		std::vector<std::unique_ptr<CBuffer>> stagingBuffers;
+	};
+
+	void *allocateStaging (VkDeviceSize size, VkBuffer &stagingBuffer, VkDeviceSize &stagingOffset);
+
+	VkCommandPool createCommandPool (uint32_t queueFamily);
+
+	// makes the copies visible to the graphics queue and acquires the images released by the transfer submission
+	void submitAcquire ();
+
+	VkCommandBuffer getCommandBuffer ();
+
+	// releases the ring space of every submission whose fence has signaled, waiting for the oldest one if requested
+	void retireSubmissions (bool waitForOldest);
+
+	CDevice &Device;
+
+	bool dedicatedTransfer;
+	uint32_t transferFamily;
+	uint32_t graphicsFamily;
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkCommandPool acquireCommandPool = VK_NULL_HANDLE;
+	std::unique_ptr<CBuffer> ringBuffer;
+	VkDeviceSize capacity;
+	VkDeviceSize alignment;
+
+	// positions grow without wrapping, the ring offset is position % capacity
+	VkDeviceSize head = 0;
+	VkDeviceSize tail = 0;
+
+	Submission recording {};
+	// release barriers of the recorded image copies, the acquire barriers on the graphics queue mirror them
+	std::vector<VkImageMemoryBarrier> imageReleaseBarriers;
+	std::deque<Submission> submissions;
+	std::vector<Submission> idleSubmissions;
+};
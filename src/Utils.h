@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <functional>
 
 
@@ -10,4 +12,32 @@ template<typename T, typename... Rest> void hashCombine (std::size_t &seed, cons
 	(hashCombine(seed, rest), ...);
 };
 
+// 64-bit hash over raw bytes, consumes 8 bytes per step
+inline uint64_t hashBytes (const void *data, size_t size, uint64_t seed = 0)
+{
+	constexpr uint64_t prime1 = 0x9e3779b97f4a7c15ull;
+	constexpr uint64_t prime2 = 0xbf58476d1ce4e5b9ull;
+
+	const auto *bytes = static_cast<const uint8_t *>(data);
+	uint64_t hash = seed ^ (size * prime1);
+
+	size_t offset = 0;
+	for (; offset + 8 <= size; offset += 8)
+	{
+		uint64_t word;
+		memcpy(&word, bytes + offset, 8);
+		word *= prime2;
+		word ^= word >> 31;
+		hash = (hash ^ word) * prime1;
+		hash ^= hash >> 29;
+	}
+
+	uint64_t tail = 0;
+	memcpy(&tail, bytes + offset, size - offset);
+	hash = (hash ^ (tail * prime2)) * prime1;
 
+	hash ^= hash >> 32;
+	hash *= prime2;
+	hash ^= hash >> 29;
+	return hash;
+}
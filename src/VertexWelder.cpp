@@ -0,0 +1,118 @@
+#include "VertexWelder.h"
+
+#include "Utils.h"
+
+// std
+#include <cmath>
+#include <cstring>
+
+
+CVertexWelder::CVertexWelder (std::vector<CModel::Vertex> &vertices, size_t expectedCount, float gridStep)
+	: vertices {vertices}, firstIndex {static_cast<uint32_t>(vertices.size())}
+{
+	if (gridStep > 0.0f)
+	{
+		inverseGridStep = 1.0f / gridStep;
+	}
+
+	// keep the load factor at or below 3/4 for the expected count so the table never rehashes
+	size_t capacity = 16;
+	while (capacity * 3 < expectedCount * 4)
+	{
+		capacity *= 2;
+	}
+
+	slots.assign(capacity, {0, EMPTY_SLOT});
+	mask = capacity - 1;
+	maxLoad = capacity / 4 * 3;
+}
+
+CVertexWelder::Key CVertexWelder::makeKey (const CModel::Vertex &vertex) const
+{
+	float values[FLOAT_COUNT];
+	memcpy(values, &vertex, sizeof(values));
+
+	Key key;
+	for (size_t i = 0; i < FLOAT_COUNT; ++i)
+	{
+		if (inverseGridStep > 0.0f)
+		{
+			key[i] = static_cast<int32_t>(std::floor(values[i] * inverseGridStep + 0.5f));
+		}
+		else
+		{
+			// adding zero folds -0 into +0 so the bits agree wherever operator== does
+			const float value = values[i] + 0.0f;
+			memcpy(&key[i], &value, sizeof(value));
+		}
+	}
+	return key;
+}
+
+uint32_t CVertexWelder::weld (const CModel::Vertex &vertex)
+{
+	if (count >= maxLoad)
+	{
+		grow();
+	}
+
+	const Key key = makeKey(vertex);
+	const uint64_t fullHash = hashBytes(key.data(), sizeof(Key));
+	const uint32_t hash = static_cast<uint32_t>(fullHash >> 32);
+
+	size_t position = static_cast<size_t>(fullHash) & mask;
+	for (;;)
+	{
+		Slot &slot = slots[position];
+		if (slot.index == EMPTY_SLOT)
+		{
+			slot.hash = hash;
+			slot.index = static_cast<uint32_t>(vertices.size());
+			vertices.push_back(vertex);
+			++count;
+			if (inverseGridStep > 0.0f)
+			{
+				keys.push_back(key);
+			}
+			return slot.index;
+		}
+
+		if (slot.hash == hash)
+		{
+			const bool equal = inverseGridStep > 0.0f ? keys[slot.index - firstIndex] == key : vertices[slot.index] == vertex;
+			if (equal)
+			{
+				return slot.index;
+			}
+		}
+
+		position = (position + 1) & mask;
+	}
+}
+
+void CVertexWelder::grow ()
+{
+	std::vector<Slot> oldSlots {};
+	oldSlots.swap(slots);
+
+	const size_t capacity = oldSlots.size() * 2;
+	slots.assign(capacity, {0, EMPTY_SLOT});
+	mask = capacity - 1;
+	maxLoad = capacity / 4 * 3;
+
+	for (const Slot &slot: oldSlots)
+	{
+		if (slot.index == EMPTY_SLOT)
+		{
+			continue;
+		}
+
+		const Key key = makeKey(vertices[slot.index]);
+		size_t position = static_cast<size_t>(hashBytes(key.data(), sizeof(Key))) & mask;
+		while (slots[position].index != EMPTY_SLOT)
+		{
+			position = (position + 1) & mask;
+		}
+		slots[position] = slot;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Model.h"
+
+// std
+#include <array>
+#include <cstdint>
+#include <vector>
+
+
+// Deduplicates vertices into an output array using a flat open-addressing table keyed by a hash of the
+// vertex bits. With gridStep > 0 it quantizes, then welds: every attribute is rounded to the nearest multiple
+// of gridStep and vertices whose rounded attributes all match are welded, keeping the first one seen. This is
+// not a distance tolerance, two vertices closer than gridStep on either side of a rounding boundary stay apart.
+class CVertexWelder
+{
+public:
+	CVertexWelder (std::vector<CModel::Vertex> &vertices, size_t expectedCount, float gridStep = 0.0f);
+
+	CVertexWelder (const CVertexWelder &) = delete;
+
+	CVertexWelder &operator= (const CVertexWelder &) = delete;
+
+	// returns the index of the matching vertex, appending it to the output array if it is new
+	uint32_t weld (const CModel::Vertex &vertex);
+
+	size_t getCapacity () const
+	{
+		return slots.size();
+	}
+
+private:
+	static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+	static constexpr size_t FLOAT_COUNT = sizeof(CModel::Vertex) / sizeof(float);
+	static_assert(sizeof(CModel::Vertex) == FLOAT_COUNT * sizeof(float), "Vertex must be tightly packed floats");
+
+	using Key = std::array<int32_t, FLOAT_COUNT>;
+
+	struct Slot
+	{
+		uint32_t hash;
+		uint32_t index;
+	};
+
+	Key makeKey (const CModel::Vertex &vertex) const;
+
+	void grow ();
+
+	std::vector<CModel::Vertex> &vertices;
+	uint32_t firstIndex = 0;
+	std::vector<Slot> slots;
+	size_t count = 0;
+	size_t mask = 0;
+	size_t maxLoad = 0;
+
+	float inverseGridStep = 0.0f;
+	std::vector<Key> keys;
+};
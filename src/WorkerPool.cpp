@@ -0,0 +1,362 @@
+#include "WorkerPool.h"
+
+// std
+#include <algorithm>
+
+
+namespace
+{
+	// the pool and deque of a worker thread
+	thread_local const CWorkerPool *currentPool = nullptr;
+	thread_local uint32_t currentQueueIndex = 0;
+}
+
+CWorkerPool::CWorkerPool (uint32_t threadCount)
+		: mainThreadId {std::this_thread::get_id()}
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	queues.reserve(threadCount + 1);
+	for (uint32_t i = 0; i <= threadCount; ++i)
+	{
+		queues.push_back(std::make_unique<WorkQueue>());
+	}
+
+	threads.reserve(threadCount - 1);
+	for (uint32_t i = 1; i < threadCount; ++i)
+	{
+		threads.emplace_back(&CWorkerPool::workerLoop, this, i);
+	}
+}
+
+CWorkerPool::~CWorkerPool ()
+{
+	{
+		std::lock_guard<std::mutex> lock {sleepMutex};
+		stopping = true;
+	}
+	workReady.notify_all();
+
+	for (auto &thread: threads)
+	{
+		thread.join();
+	}
+}
+
+CWorkerPool::Task CWorkerPool::schedule (std::function<void ()> function, const std::vector<Task> &dependencies, Affinity affinity)
+{
+	Task task = std::make_shared<CTask>();
+	task->function = std::move(function);
+	task->affinity = affinity;
+
+	for (const Task &dependency: dependencies)
+	{
+		std::lock_guard<std::mutex> lock {dependency->mutex};
+		if (!dependency->done.load(std::memory_order_relaxed))
+		{
+			dependency->dependents.push_back(task);
+			task->pendingCount.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	if (task->pendingCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		enqueue(task);
+	}
+	return task;
+}
+
+void CWorkerPool::wait (const Task &task)
+{
+	waitUntilDone(*task);
+	if (task->exception)
+	{
+		std::rethrow_exception(task->exception);
+	}
+}
+
+void CWorkerPool::wait (const std::vector<Task> &tasks)
+{
+	// every task has to be done before rethrowing, the others may still reference the caller's state
+	for (const Task &task: tasks)
+	{
+		waitUntilDone(*task);
+	}
+	for (const Task &task: tasks)
+	{
+		if (task->exception)
+		{
+			std::rethrow_exception(task->exception);
+		}
+	}
+}
+
+void CWorkerPool::runMainThreadTasks ()
+{
+	for (;;)
+	{
+		Task task {};
+		{
+			std::lock_guard<std::mutex> lock {mainThreadQueue.mutex};
+			if (mainThreadQueue.tasks.empty())
+			{
+				return;
+			}
+			task = std::move(mainThreadQueue.tasks.front());
+			mainThreadQueue.tasks.pop_front();
+		}
+		run(task);
+	}
+}
+
+void CWorkerPool::parallelFor (size_t count, size_t chunkSize, const std::function<void (size_t, size_t)> &function)
+{
+	chunkSize = std::max<size_t>(chunkSize, 1);
+	const size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+	if (chunkCount <= 1 || threads.empty())
+	{
+		for (size_t begin = 0; begin < count; begin += chunkSize)
+		{
+			function(begin, std::min(begin + chunkSize, count));
+		}
+		return;
+	}
+
+	// the caller and helper tasks, which idle threads steal, claim chunks from a shared counter until none are left
+	std::atomic<size_t> nextChunk {0};
+	auto runChunks = [&] ()
+	{
+		for (size_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++)
+		{
+			const size_t begin = chunk * chunkSize;
+			function(begin, std::min(begin + chunkSize, count));
+		}
+	};
+
+	std::vector<Task> helpers {};
+	const size_t helperCount = std::min<size_t>(threads.size(), chunkCount - 1);
+	helpers.reserve(helperCount);
+	for (size_t i = 0; i < helperCount; ++i)
+	{
+		helpers.push_back(schedule(runChunks));
+	}
+
+	std::exception_ptr exception {};
+	try
+	{
+		runChunks();
+	}
+	catch (...)
+	{
+		exception = std::current_exception();
+	}
+
+	// helpers reference this frame, those nobody picked up yet find no chunks left and return right away
+	for (const Task &helper: helpers)
+	{
+		waitUntilDone(*helper);
+		if (!exception)
+		{
+			exception = helper->exception;
+		}
+	}
+	if (exception)
+	{
+		std::rethrow_exception(exception);
+	}
+}
+
+void CWorkerPool::parallelFor (size_t count, const std::function<void (size_t, size_t)> &function)
+{
+	const size_t chunkCount = static_cast<size_t>(getThreadCount()) * 4;
+	parallelFor(count, (count + chunkCount - 1) / chunkCount, function);
+}
+
+void CWorkerPool::workerLoop (uint32_t queueIndex)
+{
+	currentPool = this;
+	currentQueueIndex = queueIndex;
+
+	for (;;)
+	{
+		if (runOneTask(queueIndex, false))
+		{
+			continue;
+		}
+
+		// enqueue counts the task before it checks for sleepers, and a worker counts itself before checking for tasks
+		std::unique_lock<std::mutex> lock {sleepMutex};
+		sleepingWorkers.fetch_add(1);
+		workReady.wait(lock, [this] () { return stopping || queuedCount.load() > 0; });
+		sleepingWorkers.fetch_sub(1);
+		if (stopping)
+		{
+			return;
+		}
+	}
+}
+
+uint32_t CWorkerPool::getQueueIndex () const
+{
+	if (currentPool == this)
+	{
+		return currentQueueIndex;
+	}
+	return std::this_thread::get_id() == mainThreadId ? 0 : static_cast<uint32_t>(queues.size()) - 1;
+}
+
+void CWorkerPool::enqueue (Task task)
+{
+	if (task->affinity == Affinity::MainThread)
+	{
+		{
+			std::lock_guard<std::mutex> lock {mainThreadQueue.mutex};
+			mainThreadQueue.tasks.push_back(std::move(task));
+		}
+		wakeWaiters();
+		return;
+	}
+
+	{
+		WorkQueue &queue = *queues[getQueueIndex()];
+		std::lock_guard<std::mutex> lock {queue.mutex};
+		queue.tasks.push_back(std::move(task));
+	}
+	queuedCount.fetch_add(1);
+
+	if (sleepingWorkers.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock {sleepMutex};
+		workReady.notify_one();
+	}
+	wakeWaiters();
+}
+
+void CWorkerPool::wakeWaiters ()
+{
+	// like the workers, a waiter counts itself before it checks the task and the queues, the fence keeps the
+	// release of the task or the queued task from passing the count
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (waitingThreads.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock {sleepMutex};
+		waitWake.notify_all();
+	}
+}
+
+bool CWorkerPool::runOneTask (uint32_t queueIndex, bool mainThread)
+{
+	Task task {};
+
+	// main thread tasks first, nobody else can run them
+	if (mainThread)
+	{
+		std::lock_guard<std::mutex> lock {mainThreadQueue.mutex};
+		if (!mainThreadQueue.tasks.empty())
+		{
+			task = std::move(mainThreadQueue.tasks.front());
+			mainThreadQueue.tasks.pop_front();
+		}
+	}
+
+	// the newest task of the own deque is the most likely to still be in cache, steals take the oldest. The main
+	// thread keeps to its own deque unless there are no workers to run the rest.
+	const uint32_t queueCount = mainThread && !threads.empty() ? 1 : static_cast<uint32_t>(queues.size());
+	for (uint32_t i = 0; task == nullptr && i < queueCount; ++i)
+	{
+		WorkQueue &queue = *queues[(queueIndex + i) % queues.size()];
+		std::lock_guard<std::mutex> lock {queue.mutex};
+		if (queue.tasks.empty())
+		{
+			continue;
+		}
+		if (i == 0)
+		{
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		}
+		else
+		{
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+		queuedCount.fetch_sub(1);
+	}
+
+	if (task == nullptr)
+	{
+		return false;
+	}
+	run(task);
+	return true;
+}
+
+bool CWorkerPool::hasRunnableTask (uint32_t queueIndex, bool mainThread)
+{
+	if (mainThread)
+	{
+		std::lock_guard<std::mutex> lock {mainThreadQueue.mutex};
+		if (!mainThreadQueue.tasks.empty())
+		{
+			return true;
+		}
+	}
+	if (mainThread && !threads.empty())
+	{
+		std::lock_guard<std::mutex> lock {queues[queueIndex]->mutex};
+		return !queues[queueIndex]->tasks.empty();
+	}
+	return queuedCount.load() > 0;
+}
+
+void CWorkerPool::run (const Task &task)
+{
+	try
+	{
+		task->function();
+	}
+	catch (...)
+	{
+		task->exception = std::current_exception();
+	}
+	// releases whatever the function captured
+	task->function = nullptr;
+
+	std::vector<Task> dependents {};
+	{
+		std::lock_guard<std::mutex> lock {task->mutex};
+		task->done.store(true, std::memory_order_release);
+		dependents.swap(task->dependents);
+	}
+	wakeWaiters();
+
+	for (Task &dependent: dependents)
+	{
+		if (dependent->pendingCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			enqueue(std::move(dependent));
+		}
+	}
+}
+
+void CWorkerPool::waitUntilDone (const CTask &task)
+{
+	const uint32_t queueIndex = getQueueIndex();
+	const bool mainThread = std::this_thread::get_id() == mainThreadId;
+	while (!task.isDone())
+	{
+		if (runOneTask(queueIndex, mainThread))
+		{
+			continue;
+		}
+
+		// nothing to help with, the task is running on another thread
+		std::unique_lock<std::mutex> lock {sleepMutex};
+		waitingThreads.fetch_add(1);
+		waitWake.wait(lock, [&] () { return task.isDone() || hasRunnableTask(queueIndex, mainThread); });
+		waitingThreads.fetch_sub(1);
+	}
+}
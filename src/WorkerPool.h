@@ -0,0 +1,136 @@
+#pragma once
+
+// std
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// The engine's job system. Persistent worker threads run scheduled tasks from per thread deques: a thread pops
+// the newest task of its own deque and steals the oldest of another's once it runs dry. Tasks can depend on
+// other tasks and only start after those are done. Tasks with main thread affinity, such as GLFW calls, run
+// on the thread that created the pool while it waits. Waiting threads run other tasks instead of blocking, so
+// tasks can schedule and wait for tasks, and parallelFor can be called from inside tasks. The main thread only
+// runs what it scheduled itself, it never steals the background work of the workers in the middle of a frame,
+// and tasks scheduled from threads outside the pool go to an injection queue that only the workers take from.
+// A waiting thread with nothing it may run sleeps until the task is done or new work arrives.
+class CWorkerPool
+{
+public:
+	enum class Affinity
+	{
+		Any,
+		// runs on the thread that created the pool, while it waits or in runMainThreadTasks
+		MainThread
+	};
+
+	// a scheduled function, done once it has run
+	class CTask
+	{
+	public:
+		bool isDone () const
+		{
+			return done.load(std::memory_order_acquire);
+		}
+
+	private:
+		friend class CWorkerPool;
+
+		std::function<void ()> function;
+		Affinity affinity = Affinity::Any;
+		// dependencies that are not done yet, plus one held by schedule so the task can not start early
+		std::atomic<uint32_t> pendingCount {1};
+		// guards done and dependents against a dependency finishing while a dependent is added
+		std::mutex mutex;
+		std::vector<std::shared_ptr<CTask>> dependents;
+		std::atomic<bool> done {false};
+		// thrown by function, rethrown by wait
+		std::exception_ptr exception;
+	};
+
+	using Task = std::shared_ptr<CTask>;
+
+	// threadCount counts the calling thread, zero uses one thread per hardware thread
+	explicit CWorkerPool (uint32_t threadCount = 0);
+
+	// tasks that have not run yet are dropped, so wait for everything that references the caller's state
+	~CWorkerPool ();
+
+	CWorkerPool (const CWorkerPool &) = delete;
+
+	CWorkerPool &operator= (const CWorkerPool &) = delete;
+
+	// runs function once every dependency is done
+	Task schedule (std::function<void ()> function, const std::vector<Task> &dependencies = {}, Affinity affinity = Affinity::Any);
+
+	// runs other tasks until the tasks are done, then rethrows the first exception one of them threw
+	void wait (const Task &task);
+
+	void wait (const std::vector<Task> &tasks);
+
+	// runs the main thread tasks that are ready, only call on the thread that created the pool
+	void runMainThreadTasks ();
+
+	// calls function(begin, end) for consecutive ranges of at most chunkSize out of count items, the chunk size is
+	// the grain, small enough to balance uneven items and large enough to amortize claiming a chunk
+	void parallelFor (size_t count, size_t chunkSize, const std::function<void (size_t, size_t)> &function);
+
+	// picks a grain of a few chunks per thread, for items of similar cost
+	void parallelFor (size_t count, const std::function<void (size_t, size_t)> &function);
+
+	uint32_t getThreadCount () const
+	{
+		return static_cast<uint32_t>(threads.size()) + 1;
+	}
+
+private:
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void workerLoop (uint32_t queueIndex);
+
+	// the deque of the calling thread, the injection queue for threads outside the pool
+	uint32_t getQueueIndex () const;
+
+	// the threads that wait for a task can stop sleeping
+	void wakeWaiters ();
+
+	void enqueue (Task task);
+
+	// runs one ready task, false if there was none the calling thread may run
+	bool runOneTask (uint32_t queueIndex, bool mainThread);
+
+	// whether runOneTask could find a task
+	bool hasRunnableTask (uint32_t queueIndex, bool mainThread);
+
+	void run (const Task &task);
+
+	void waitUntilDone (const CTask &task);
+
+	std::vector<std::thread> threads;
+	std::thread::id mainThreadId;
+	// one per thread, the main thread's first, then the injection queue of the threads outside the pool
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	WorkQueue mainThreadQueue;
+	// tasks in queues, so idle workers know whether stealing can succeed
+	std::atomic<size_t> queuedCount {0};
+
+	std::mutex sleepMutex;
+	std::condition_variable workReady;
+	std::atomic<uint32_t> sleepingWorkers {0};
+	bool stopping = false;
+	// threads sleeping in waitUntilDone
+	std::condition_variable waitWake;
+	std::atomic<uint32_t> waitingThreads {0};
+};
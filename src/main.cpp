@@ -3,14 +3,86 @@
 
 // std
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 
-int main() {
-  CFirstApp app{};
+int main(int argc, char **argv) {
+  // --objects N fills the scene with N extra objects for benchmarking the render modes
+  // --descriptor-updates N times N descriptor set updates per update path instead of running
+  // --worker-tasks N times scheduling N tasks and a parallel for over N items instead of running
+  // --weld-corners N times welding a generated mesh of N corners against the old unordered_map instead of running
+  // --mesh-cache PATH times importing the model at PATH without and then with its mesh cache instead of running
+  // --compare-obj PATH loads the model at PATH with the parallel and the tinyobj parser and diffs them instead of running
+  // --headlight lights the scene with the headlight variant of the shader instead of ambient light only
+  // --record-benchmark times recording 10k, 100k and 1M objects with the simple and the indirect render system
+  uint32_t benchmarkObjectCount = 0;
+  uint32_t descriptorUpdateCount = 0;
+  uint32_t workerTaskCount = 0;
+  uint32_t weldCornerCount = 0;
+  const char *meshCachePath = nullptr;
+  const char *compareObjPath = nullptr;
+  bool recordBenchmark = false;
+  LightingModel lightingModel = SCENE_LIGHTING_MODEL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--record-benchmark") == 0) {
+      recordBenchmark = true;
+    } else if (strcmp(argv[i], "--headlight") == 0) {
+      lightingModel = LightingModel::Headlight;
+    } else if (i + 1 == argc) {
+      break;
+    } else if (strcmp(argv[i], "--objects") == 0) {
+      benchmarkObjectCount = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+    } else if (strcmp(argv[i], "--descriptor-updates") == 0) {
+      descriptorUpdateCount = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+    } else if (strcmp(argv[i], "--worker-tasks") == 0) {
+      workerTaskCount = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+    } else if (strcmp(argv[i], "--weld-corners") == 0) {
+      weldCornerCount = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+    } else if (strcmp(argv[i], "--mesh-cache") == 0) {
+      meshCachePath = argv[i + 1];
+    } else if (strcmp(argv[i], "--compare-obj") == 0) {
+      compareObjPath = argv[i + 1];
+    }
+  }
+
+  // needs no window or device
+  if (workerTaskCount > 0) {
+    CFirstApp::benchmarkWorkerPool(workerTaskCount);
+    return EXIT_SUCCESS;
+  }
+  if (weldCornerCount > 0) {
+    CFirstApp::benchmarkVertexWelding(weldCornerCount);
+    return EXIT_SUCCESS;
+  }
+  if (meshCachePath != nullptr) {
+    try {
+      CFirstApp::benchmarkMeshCache(meshCachePath);
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << '\n';
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+  if (compareObjPath != nullptr) {
+    try {
+      return CFirstApp::compareObjLoaders(compareObjPath) ? EXIT_SUCCESS : EXIT_FAILURE;
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+
+  CFirstApp app{benchmarkObjectCount, lightingModel};
 
   try {
-    app.run();
+    if (descriptorUpdateCount > 0) {
+      app.benchmarkDescriptorUpdates(descriptorUpdateCount);
+    } else if (recordBenchmark) {
+      app.benchmarkRecording();
+    } else {
+      app.run();
+    }
   } catch (const std::exception &e) {
     std::cerr << e.what() << '\n';
     return EXIT_FAILURE;
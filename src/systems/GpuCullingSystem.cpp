@@ -0,0 +1,556 @@
+#include "GpuCullingSystem.h"
+
+#include "SimpleSystem.h"
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+
+CGpuCullingRenderSystem::CGpuCullingRenderSystem (CDevice &device, CGeometryPool &geometryPool, CWorkerPool &workerPool, CPipelineRegistry &pipelineRegistry, CFrameAllocator &frameAllocator, uint32_t maxObjects, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, LightingModel lightingModel)
+		: Device {device}, GeometryPool {geometryPool}, WorkerPool {workerPool}, PipelineRegistry {pipelineRegistry}, FrameAllocator {frameAllocator}, maxObjects {maxObjects}
+{
+	createPipelines(renderPass, globalSetLayout, lightingModel);
+
+	VkSamplerCreateInfo samplerInfo {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxLod = static_cast<float>(MAX_PYRAMID_LEVELS);
+	if (vkCreateSampler(Device.GetDevice(), &samplerInfo, nullptr, &pyramidSampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create depth pyramid sampler!");
+	}
+
+	countBuffer = std::make_unique<CBuffer>(Device, sizeof(CountData), 1, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	for (auto &readbackBuffer: readbackBuffers)
+	{
+		readbackBuffer = std::make_unique<CBuffer>(Device, sizeof(CountData), 1, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		readbackBuffer->map();
+	}
+
+	// placeholders until the first frame, so every descriptor is valid from the start
+	createCommandBuffer(1024);
+	createPyramid({1, 1});
+	createCullDescriptorSets();
+}
+
+CGpuCullingRenderSystem::~CGpuCullingRenderSystem ()
+{
+	destroyPyramid();
+	vkDestroySampler(Device.GetDevice(), pyramidSampler, nullptr);
+}
+
+void CGpuCullingRenderSystem::createPipelines (VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, LightingModel lightingModel)
+{
+	pipelineLayout = PipelineRegistry.getPipelineLayout({globalSetLayout});
+
+	PipelineConfigInfo pipelineConfig {};
+	CPipeline::defaultPipelineConfigInfo(pipelineConfig);
+	pipelineConfig.renderPass = renderPass;
+	pipelineConfig.pipelineLayout = pipelineLayout;
+	Pipeline = PipelineRegistry.requestGraphicsVariant("shaders/simple_shader.vert.spv", "shaders/simple_shader.frag.spv", pipelineConfig, {{LIGHTING_MODEL_CONSTANT_ID, static_cast<uint32_t>(lightingModel)}});
+
+	pipelineConfig.bindingDescriptions = CModel::getBindingDescriptions(CModel::VertexLayout::Packed);
+	pipelineConfig.attributeDescriptions = CModel::getAttributeDescriptions(CModel::VertexLayout::Packed);
+	PackedPipeline = PipelineRegistry.requestGraphicsVariant("shaders/packed_shader.vert.spv", "shaders/simple_shader.frag.spv", pipelineConfig, {{LIGHTING_MODEL_CONSTANT_ID, static_cast<uint32_t>(lightingModel)}});
+
+	cullSetLayout = CDescriptorSetLayout::CBuilder(Device)
+		.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT)
+		.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_COMPUTE_BIT)
+		.addBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.addBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.addBinding(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.build();
+	cullPipelineLayout = PipelineRegistry.getPipelineLayout({cullSetLayout->getDescriptorSetLayout()});
+	CullPipeline = PipelineRegistry.requestComputePipeline("shaders/cull.comp.spv", cullPipelineLayout);
+
+	// every dispatch of the pyramid has its own images, they are pushed when the device can
+	pyramidSetLayout = CDescriptorSetLayout::CBuilder(Device)
+		.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)
+		.setFlags(CPushDescriptorTemplate::isSupported(Device) ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0)
+		.build();
+	pyramidPipelineLayout = PipelineRegistry.getPipelineLayout({pyramidSetLayout->getDescriptorSetLayout()});
+	PyramidPipeline = PipelineRegistry.requestComputePipeline("shaders/depth_pyramid.comp.spv", pyramidPipelineLayout);
+	if (CPushDescriptorTemplate::isSupported(Device))
+	{
+		pyramidPushTemplate = std::make_unique<CPushDescriptorTemplate>(Device, *pyramidSetLayout, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidPipelineLayout, 0);
+	}
+}
+
+void CGpuCullingRenderSystem::createCullDescriptorSets ()
+{
+	cullAllocator.resetPools();
+	for (int i = 0; i < CSwapChain::MAX_FRAMES_IN_FLIGHT; ++i)
+	{
+		CullDescriptors descriptors {};
+		descriptors.params = FrameAllocator.descriptorInfo(i, sizeof(CullParams));
+		descriptors.drawData = FrameAllocator.descriptorInfo(i, sizeof(DrawData) * maxObjects);
+		descriptors.commands = commandBuffer->descriptorInfo();
+		descriptors.counts = countBuffer->descriptorInfo();
+		descriptors.pyramid = {pyramidSampler, pyramidView, VK_IMAGE_LAYOUT_GENERAL};
+		if (!cullAllocator.allocateDescriptor(cullSetLayout->getDescriptorSetLayout(), cullSets[i]))
+		{
+			throw std::runtime_error("failed to allocate culling descriptor set!");
+		}
+		cullSetLayout->update(cullSets[i], &descriptors);
+	}
+}
+
+void CGpuCullingRenderSystem::createCommandBuffer (uint32_t capacity)
+{
+	commandBuffer = std::make_unique<CBuffer>(Device, sizeof(VkDrawIndexedIndirectCommand), capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	commandCapacity = capacity;
+}
+
+void CGpuCullingRenderSystem::createPyramid (VkExtent2D depthExtent)
+{
+	auto previousPowerOfTwo = [] (uint32_t value)
+	{
+		uint32_t result = 1;
+		while (result * 2 <= value)
+		{
+			result *= 2;
+		}
+		return result;
+	};
+
+	pyramidSourceExtent = depthExtent;
+	pyramidExtent = {previousPowerOfTwo(depthExtent.width), previousPowerOfTwo(depthExtent.height)};
+	uint32_t levelCount = 1;
+	while (levelCount < MAX_PYRAMID_LEVELS && (pyramidExtent.width >> levelCount) + (pyramidExtent.height >> levelCount) > 0)
+	{
+		++levelCount;
+	}
+
+	VkImageCreateInfo imageInfo {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent = {pyramidExtent.width, pyramidExtent.height, 1};
+	imageInfo.mipLevels = levelCount;
+	imageInfo.arrayLayers = 1;
+	imageInfo.format = VK_FORMAT_R32_SFLOAT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	Device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pyramid, pyramidMemory);
+
+	VkImageViewCreateInfo viewInfo {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = pyramid;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = VK_FORMAT_R32_SFLOAT;
+	viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1};
+	if (vkCreateImageView(Device.GetDevice(), &viewInfo, nullptr, &pyramidView) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create depth pyramid view!");
+	}
+
+	pyramidLevelViews.resize(levelCount);
+	for (uint32_t level = 0; level < levelCount; ++level)
+	{
+		viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+		if (vkCreateImageView(Device.GetDevice(), &viewInfo, nullptr, &pyramidLevelViews[level]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create depth pyramid view!");
+		}
+	}
+
+	pyramidAllocator.resetPools();
+	pyramidLevelSets.clear();
+	for (uint32_t level = 1; level < levelCount && pyramidPushTemplate == nullptr; ++level)
+	{
+		VkDescriptorSet set;
+		if (!pyramidAllocator.allocateDescriptor(pyramidSetLayout->getDescriptorSetLayout(), set))
+		{
+			throw std::runtime_error("failed to allocate depth pyramid descriptor set!");
+		}
+		const PyramidDescriptors descriptors = getPyramidDescriptors(level);
+		pyramidSetLayout->update(set, &descriptors);
+		pyramidLevelSets.push_back(set);
+	}
+
+	pyramidNeedsTransition = true;
+	pyramidBuilt = false;
+}
+
+void CGpuCullingRenderSystem::destroyPyramid ()
+{
+	for (VkImageView view: pyramidLevelViews)
+	{
+		vkDestroyImageView(Device.GetDevice(), view, nullptr);
+	}
+	pyramidLevelViews.clear();
+	vkDestroyImageView(Device.GetDevice(), pyramidView, nullptr);
+	vkDestroyImage(Device.GetDevice(), pyramid, nullptr);
+	Device.freeMemory(pyramidMemory);
+}
+
+uint32_t CGpuCullingRenderSystem::getDrawGroup (const CModel &model)
+{
+	return (model.getVertexLayout() == CModel::VertexLayout::Packed ? 2 : 0) + (model.getIndexType() == VK_INDEX_TYPE_UINT32 ? 1 : 0);
+}
+
+void CGpuCullingRenderSystem::cull (FrameInfo &frameInfo, VkExtent2D depthExtent)
+{
+	const int frameIndex = frameInfo.frameIndex;
+	VkCommandBuffer cmd = frameInfo.commandBuffer;
+
+	// the frame's fence has been waited on, so the counts it copied last time are complete
+	if (readbackPending[frameIndex])
+	{
+		CountData counts;
+		memcpy(&counts, readbackBuffers[frameIndex]->getMappedMemory(), sizeof(CountData));
+		cullStats.visible = 0;
+		for (uint32_t group = 0; group < DRAW_GROUP_COUNT; ++group)
+		{
+			cullStats.visible += counts.drawCounts[group];
+		}
+		cullStats.frustumCulled = counts.frustumCulled;
+		cullStats.occlusionCulled = counts.occlusionCulled;
+		cullStats.objects = cullStats.visible + counts.frustumCulled + counts.occlusionCulled;
+		readbackPending[frameIndex] = false;
+	}
+
+	// resources still used by frames in flight are only replaced once the device is idle, which resizing already implies
+	const bool resized = depthExtent.width != pyramidSourceExtent.width || depthExtent.height != pyramidSourceExtent.height;
+	if (resized)
+	{
+		vkDeviceWaitIdle(Device.GetDevice());
+		destroyPyramid();
+		createPyramid(depthExtent);
+	}
+
+	renderStats = {};
+	const uint32_t objectLimit = std::min(maxObjects, frameInfo.maxObjects);
+	size_t candidateCount = 0;
+	for (auto &kv: frameInfo.gameObjects)
+	{
+		candidateCount += kv.second.model != nullptr && kv.second.model->hasIndices() ? 1 : 0;
+	}
+
+	// with more objects than the object binding holds, the ones outside the frustum are culled here first so that
+	// only visible objects are dropped
+	const bool cullOnCpu = candidateCount > objectLimit;
+	glm::vec4 frustumPlanes[6];
+	frameInfo.camera.getFrustumPlanes(frustumPlanes);
+
+	objects.clear();
+	objectGroups.clear();
+	overflowObjects.clear();
+	for (auto &kv: frameInfo.gameObjects)
+	{
+		auto &obj = kv.second;
+		if (obj.model == nullptr || !obj.model->hasIndices())
+		{
+			continue;
+		}
+		if (cullOnCpu)
+		{
+			const float scale = glm::max(glm::abs(obj.transform.scale.x), glm::max(glm::abs(obj.transform.scale.y), glm::abs(obj.transform.scale.z)));
+			const glm::vec3 center = obj.transform.mat4() * glm::vec4 {obj.model->getBoundsCenter(), 1.f};
+			if (!CCamera::isSphereVisible(frustumPlanes, center, obj.model->getBoundsRadius() * scale))
+			{
+				continue;
+			}
+		}
+		if (objects.size() + overflowObjects.size() == objectLimit)
+		{
+			++renderStats.objectsDropped;
+			continue;
+		}
+		// the draw groups only bind the first pool block
+		if (obj.model->getVertexBlock() != 0 || obj.model->getIndexBlock() != 0)
+		{
+			overflowObjects.push_back(&obj);
+			continue;
+		}
+		objects.push_back(&obj);
+		objectGroups.push_back(getDrawGroup(*obj.model));
+	}
+
+	// each chunk gets a run of command slots per group, the slots are only used when draws are not compacted
+	const size_t objectCount = objects.size();
+	const size_t chunkCount = (objectCount + OBJECT_CHUNK_SIZE - 1) / OBJECT_CHUNK_SIZE;
+	chunkGroupSlots.assign(chunkCount * DRAW_GROUP_COUNT, 0);
+	for (size_t i = 0; i < objectCount; ++i)
+	{
+		++chunkGroupSlots[i / OBJECT_CHUNK_SIZE * DRAW_GROUP_COUNT + objectGroups[i]];
+	}
+	uint32_t slot = 0;
+	for (uint32_t group = 0; group < DRAW_GROUP_COUNT; ++group)
+	{
+		groupFirstCommand[group] = slot;
+		for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+		{
+			const uint32_t count = chunkGroupSlots[chunk * DRAW_GROUP_COUNT + group];
+			chunkGroupSlots[chunk * DRAW_GROUP_COUNT + group] = slot;
+			slot += count;
+		}
+		groupCapacity[group] = slot - groupFirstCommand[group];
+	}
+
+	bool rewriteSets = resized;
+	if (slot > commandCapacity)
+	{
+		if (!resized)
+		{
+			vkDeviceWaitIdle(Device.GetDevice());
+		}
+		createCommandBuffer(std::max(slot, commandCapacity * 2));
+		rewriteSets = true;
+	}
+	if (rewriteSets)
+	{
+		createCullDescriptorSets();
+	}
+
+	CFrameAllocator::Allocation objectAllocation = FrameAllocator.allocate(sizeof(ObjectData) * (objectCount + overflowObjects.size()));
+	CFrameAllocator::Allocation drawDataAllocation = FrameAllocator.allocate(sizeof(DrawData) * objectCount);
+	objectDataOffset = objectAllocation.offset;
+	auto *objectData = static_cast<ObjectData *>(objectAllocation.data);
+	auto *drawData = static_cast<DrawData *>(drawDataAllocation.data);
+
+	WorkerPool.parallelFor(objectCount, OBJECT_CHUNK_SIZE, [&] (size_t begin, size_t end)
+	{
+		uint32_t *slots = chunkGroupSlots.data() + begin / OBJECT_CHUNK_SIZE * DRAW_GROUP_COUNT;
+		for (size_t i = begin; i < end; ++i)
+		{
+			CGameObject &obj = *objects[i];
+			const CModel &model = *obj.model;
+
+			const glm::mat4 modelMatrix = obj.transform.mat4();
+			const float scale = glm::max(glm::abs(obj.transform.scale.x), glm::max(glm::abs(obj.transform.scale.y), glm::abs(obj.transform.scale.z)));
+			const glm::vec3 center = modelMatrix * glm::vec4 {model.getBoundsCenter(), 1.f};
+			const float radius = model.getBoundsRadius() * scale;
+			const uint32_t lod = CSimpleRenderSystem::selectLod(model, center, radius, scale, frameInfo.camera);
+			const VkDrawIndexedIndirectCommand command = model.getIndirectCommand(lod, 1, static_cast<uint32_t>(i));
+
+			objectData[i].modelMatrix = modelMatrix * model.getDequantization();
+			objectData[i].normalMatrix = obj.transform.normalMatrix();
+			objectData[i].color = glm::vec4 {obj.color, 1.f};
+
+			DrawData &draw = drawData[i];
+			draw.sphere = glm::vec4 {center, radius};
+			draw.indexCount = command.indexCount;
+			draw.firstIndex = command.firstIndex;
+			draw.vertexOffset = command.vertexOffset;
+			draw.group = objectGroups[i];
+			draw.commandIndex = slots[objectGroups[i]]++;
+		}
+	});
+
+	CFrameAllocator::Allocation paramsAllocation = FrameAllocator.allocate(sizeof(CullParams));
+	CullParams &params = *static_cast<CullParams *>(paramsAllocation.data);
+	frameInfo.camera.getFrustumPlanes(params.frustumPlanes);
+
+	// objects in chained pool blocks are few, they are frustum culled here and drawn directly after the groups
+	overflowDraws.clear();
+	for (size_t i = 0; i < overflowObjects.size(); ++i)
+	{
+		CGameObject &obj = *overflowObjects[i];
+		CModel &model = *obj.model;
+
+		const glm::mat4 modelMatrix = obj.transform.mat4();
+		const float scale = glm::max(glm::abs(obj.transform.scale.x), glm::max(glm::abs(obj.transform.scale.y), glm::abs(obj.transform.scale.z)));
+		const glm::vec3 center = modelMatrix * glm::vec4 {model.getBoundsCenter(), 1.f};
+		const float radius = model.getBoundsRadius() * scale;
+		if (!CCamera::isSphereVisible(frustumPlanes, center, radius))
+		{
+			continue;
+		}
+
+		const uint32_t slot = static_cast<uint32_t>(objectCount + overflowDraws.size());
+		objectData[slot].modelMatrix = modelMatrix * model.getDequantization();
+		objectData[slot].normalMatrix = obj.transform.normalMatrix();
+		objectData[slot].color = glm::vec4 {obj.color, 1.f};
+		overflowDraws.push_back({&model, CSimpleRenderSystem::selectLod(model, center, radius, scale, frameInfo.camera), slot});
+	}
+	params.occlusionView = occlusionView;
+	params.occlusionProjection = {occlusionProjection[0][0], occlusionProjection[1][1], occlusionProjection[2][2], occlusionProjection[3][2]};
+	params.pyramidSize = {static_cast<float>(pyramidExtent.width), static_cast<float>(pyramidExtent.height)};
+	// the camera's projection maps view depth z to P22 + P32 / z, so the near plane is where that is 0
+	params.occlusionNear = occlusionProjection[2][2] != 0.f ? -occlusionProjection[3][2] / occlusionProjection[2][2] : 0.f;
+	params.objectCount = static_cast<uint32_t>(objectCount);
+	params.groupFirstCommand = {groupFirstCommand[0], groupFirstCommand[1], groupFirstCommand[2], groupFirstCommand[3]};
+	params.occlusionEnabled = pyramidBuilt ? 1 : 0;
+	params.compact = Device.cmdDrawIndexedIndirectCount != nullptr ? 1 : 0;
+	pyramidBuilt = false;
+
+	// the previous frame's draws and copy are done with the commands and counts, and its pyramid is written
+	VkMemoryBarrier barrier {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	if (pyramidNeedsTransition)
+	{
+		VkImageMemoryBarrier imageBarrier {};
+		imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageBarrier.srcAccessMask = 0;
+		imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image = pyramid;
+		imageBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1};
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+		pyramidNeedsTransition = false;
+	}
+
+	vkCmdFillBuffer(cmd, countBuffer->getBuffer(), 0, VK_WHOLE_SIZE, 0);
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	CullPipeline->bind(cmd);
+	uint32_t dynamicOffsets[] = {paramsAllocation.offset, drawDataAllocation.offset};
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullSets[frameIndex], 2, dynamicOffsets);
+	vkCmdDispatch(cmd, static_cast<uint32_t>((objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE), 1, 1);
+
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	VkBufferCopy copy {0, 0, sizeof(CountData)};
+	vkCmdCopyBuffer(cmd, countBuffer->getBuffer(), readbackBuffers[frameIndex]->getBuffer(), 1, &copy);
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	readbackPending[frameIndex] = true;
+}
+
+void CGpuCullingRenderSystem::render (FrameInfo &frameInfo)
+{
+	Pipeline->bind(frameInfo.commandBuffer);
+	CModel::VertexLayout boundLayout = CModel::VertexLayout::Full;
+
+	uint32_t dynamicOffsets[] = {frameInfo.globalUboOffset, objectDataOffset};
+	vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &frameInfo.globalDescriptorSet, 2, dynamicOffsets);
+	GeometryPool.bindVertexBuffer(frameInfo.commandBuffer);
+
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	for (uint32_t group = 0; group < DRAW_GROUP_COUNT; ++group)
+	{
+		if (groupCapacity[group] == 0)
+		{
+			continue;
+		}
+
+		const CModel::VertexLayout layout = group >= 2 ? CModel::VertexLayout::Packed : CModel::VertexLayout::Full;
+		if (layout != boundLayout)
+		{
+			boundLayout = layout;
+			(boundLayout == CModel::VertexLayout::Packed ? PackedPipeline : Pipeline)->bind(frameInfo.commandBuffer);
+		}
+		GeometryPool.bindIndexBuffer(frameInfo.commandBuffer, group % 2 == 1 ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16);
+
+		const VkDeviceSize offset = static_cast<VkDeviceSize>(groupFirstCommand[group]) * stride;
+		if (Device.cmdDrawIndexedIndirectCount != nullptr)
+		{
+			Device.cmdDrawIndexedIndirectCount(frameInfo.commandBuffer, commandBuffer->getBuffer(), offset, countBuffer->getBuffer(), group * sizeof(uint32_t), groupCapacity[group], stride);
+			++renderStats.drawCalls;
+			continue;
+		}
+
+		// without a count the whole range is drawn, the culled commands have no instances
+		const uint32_t maxDrawCount = Device.properties.limits.maxDrawIndirectCount;
+		for (uint32_t first = 0; first < groupCapacity[group]; first += maxDrawCount)
+		{
+			vkCmdDrawIndexedIndirect(frameInfo.commandBuffer, commandBuffer->getBuffer(), offset + static_cast<VkDeviceSize>(first) * stride, std::min(maxDrawCount, groupCapacity[group] - first), stride);
+			++renderStats.drawCalls;
+		}
+	}
+
+	for (const OverflowDraw &draw: overflowDraws)
+	{
+		if (draw.model->getVertexLayout() != boundLayout)
+		{
+			boundLayout = draw.model->getVertexLayout();
+			(boundLayout == CModel::VertexLayout::Packed ? PackedPipeline : Pipeline)->bind(frameInfo.commandBuffer);
+		}
+		draw.model->bind(frameInfo.commandBuffer);
+		draw.model->draw(frameInfo.commandBuffer, draw.lod, 1, draw.firstInstance);
+		++renderStats.drawCalls;
+	}
+}
+
+void CGpuCullingRenderSystem::buildDepthPyramid (FrameInfo &frameInfo, VkImage depthImage, VkImageView depthImageView, VkFormat depthFormat)
+{
+	VkCommandBuffer cmd = frameInfo.commandBuffer;
+	const bool hasStencil = depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || depthFormat == VK_FORMAT_D24_UNORM_S8_UINT;
+
+	// the depth is read once its render pass is done, and the pyramid is rewritten once this frame's culling has read it
+	VkImageMemoryBarrier depthBarrier {};
+	depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.image = depthImage;
+	depthBarrier.subresourceRange = {static_cast<VkImageAspectFlags>(VK_IMAGE_ASPECT_DEPTH_BIT | (hasStencil ? VK_IMAGE_ASPECT_STENCIL_BIT : 0)), 0, 1, 0, 1};
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+
+	PyramidDescriptors sourceDescriptors {};
+	sourceDescriptors.source = {pyramidSampler, depthImageView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+	sourceDescriptors.level = {VK_NULL_HANDLE, pyramidLevelViews[0], VK_IMAGE_LAYOUT_GENERAL};
+	VkDescriptorSet sourceSet = VK_NULL_HANDLE;
+	if (pyramidPushTemplate == nullptr)
+	{
+		if (!frameInfo.descriptorAllocator.allocateDescriptor(pyramidSetLayout->getDescriptorSetLayout(), sourceSet))
+		{
+			throw std::runtime_error("failed to allocate depth pyramid descriptor set!");
+		}
+		pyramidSetLayout->update(sourceSet, &sourceDescriptors);
+	}
+
+	PyramidPipeline->bind(cmd);
+	VkMemoryBarrier levelBarrier {};
+	levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	for (uint32_t level = 0; level < pyramidLevelViews.size(); ++level)
+	{
+		if (pyramidPushTemplate != nullptr)
+		{
+			const PyramidDescriptors descriptors = level == 0 ? sourceDescriptors : getPyramidDescriptors(level);
+			pyramidPushTemplate->push(cmd, &descriptors);
+		}
+		else
+		{
+			VkDescriptorSet set = level == 0 ? sourceSet : pyramidLevelSets[level - 1];
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidPipelineLayout, 0, 1, &set, 0, nullptr);
+		}
+
+		const uint32_t width = std::max(pyramidExtent.width >> level, 1u);
+		const uint32_t height = std::max(pyramidExtent.height >> level, 1u);
+		vkCmdDispatch(cmd, (width + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, (height + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, 1);
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	// the depth attachment is cleared by a later render pass, which has to wait until it has been read
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+	occlusionView = frameInfo.camera.getView();
+	occlusionProjection = frameInfo.camera.getProjection();
+	pyramidBuilt = true;
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include "Buffer.h"
+#include "Camera.h"
+#include "Descriptors.h"
+#include "Device.h"
+#include "FrameAllocator.h"
+#include "FrameInfo.h"
+#include "GameObject.h"
+#include "GeometryPool.h"
+#include "Pipeline.h"
+#include "PipelineRegistry.h"
+#include "SwapChain.h"
+#include "WorkerPool.h"
+
+
+#include <array>
+#include <memory>
+#include <vector>
+
+
+// Renders the scene with visibility decided on the GPU. The CPU writes the object data and bounds of every
+// object, a compute pass tests them against the frustum and against a depth pyramid built from the previous
+// frame's depth, and appends a draw for each visible object to the command range of its draw group. The
+// groups are drawn with a draw count read from the GPU when VK_KHR_draw_indirect_count is available, and as
+// fixed ranges of commands whose culled draws have no instances otherwise. Objects whose geometry did not fit the
+// first geometry pool block are frustum culled on the CPU and drawn directly.
+// The counts of the culling pass are copied back and reported once the frame has completed.
+class CGpuCullingRenderSystem
+{
+public:
+	// draw groups are the combinations of vertex layout and index type, each is one pipeline and index buffer
+	static constexpr uint32_t DRAW_GROUP_COUNT = 4;
+	static constexpr size_t OBJECT_CHUNK_SIZE = 4096;
+	static constexpr uint32_t CULL_GROUP_SIZE = 64;
+	static constexpr uint32_t PYRAMID_GROUP_SIZE = 16;
+	static constexpr uint32_t MAX_PYRAMID_LEVELS = 16;
+
+	// per object input of the culling pass
+	struct DrawData
+	{
+		glm::vec4 sphere {};
+		uint32_t indexCount = 0;
+		uint32_t firstIndex = 0;
+		int32_t vertexOffset = 0;
+		uint32_t group = 0;
+		uint32_t commandIndex = 0;
+		uint32_t padding[3] {};
+	};
+
+	// counts of the last culling pass whose results have been read back
+	struct CullStats
+	{
+		uint32_t objects = 0;
+		uint32_t visible = 0;
+		uint32_t frustumCulled = 0;
+		uint32_t occlusionCulled = 0;
+	};
+
+	struct RenderStats
+	{
+		uint32_t drawCalls = 0;
+		// visible objects that did not fit the object binding, counted by cull
+		uint32_t objectsDropped = 0;
+	};
+
+	CGpuCullingRenderSystem (CDevice &device, CGeometryPool &geometryPool, CWorkerPool &workerPool, CPipelineRegistry &pipelineRegistry, CFrameAllocator &frameAllocator, uint32_t maxObjects, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, LightingModel lightingModel = SCENE_LIGHTING_MODEL);
+	~CGpuCullingRenderSystem ();
+
+	CGpuCullingRenderSystem (const CGpuCullingRenderSystem &) = delete;
+
+	CGpuCullingRenderSystem &operator= (const CGpuCullingRenderSystem &) = delete;
+
+	// draws are indexed with the commands' firstInstance, and are either counted or drawn as fixed ranges
+	static bool isSupported (CDevice &device)
+	{
+		return device.enabledFeatures.drawIndirectFirstInstance == VK_TRUE && (device.cmdDrawIndexedIndirectCount != nullptr || device.enabledFeatures.multiDrawIndirect == VK_TRUE);
+	}
+
+	// records the culling pass, outside of the render pass and before render
+	void cull (FrameInfo &frameInfo, VkExtent2D depthExtent);
+
+	// draws what the culling pass of this frame has kept, inside the render pass
+	void render (FrameInfo &frameInfo);
+
+	// reduces the frame's depth into the pyramid that the next frame's culling pass tests against, after the render pass
+	void buildDepthPyramid (FrameInfo &frameInfo, VkImage depthImage, VkImageView depthImageView, VkFormat depthFormat);
+
+	// lags a few frames behind, until the frame that culled them has completed
+	const CullStats &getCullStats () const
+	{
+		return cullStats;
+	}
+
+	const RenderStats &getRenderStats () const
+	{
+		return renderStats;
+	}
+
+private:
+	// std430 layout of the count buffer in cull.comp
+	struct CountData
+	{
+		uint32_t drawCounts[DRAW_GROUP_COUNT];
+		uint32_t frustumCulled;
+		uint32_t occlusionCulled;
+	};
+
+	// std140 layout of the uniform block in cull.comp
+	struct CullParams
+	{
+		glm::vec4 frustumPlanes[6];
+		glm::mat4 occlusionView;
+		glm::vec4 occlusionProjection;
+		glm::vec2 pyramidSize;
+		float occlusionNear;
+		uint32_t objectCount;
+		glm::uvec4 groupFirstCommand;
+		uint32_t occlusionEnabled;
+		uint32_t compact;
+		uint32_t padding[2];
+	};
+
+	// packed descriptor data of the culling set, in binding order
+	struct CullDescriptors
+	{
+		VkDescriptorBufferInfo params;
+		VkDescriptorBufferInfo drawData;
+		VkDescriptorBufferInfo commands;
+		VkDescriptorBufferInfo counts;
+		VkDescriptorImageInfo pyramid;
+	};
+
+	// packed descriptor data of one pyramid level, read from source and written to level
+	struct PyramidDescriptors
+	{
+		VkDescriptorImageInfo source;
+		VkDescriptorImageInfo level;
+	};
+
+	void createPipelines (VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, LightingModel lightingModel);
+
+	void createCullDescriptorSets ();
+
+	void createCommandBuffer (uint32_t capacity);
+
+	// the pyramid's first level is the largest power of two that fits into the depth buffer
+	void createPyramid (VkExtent2D depthExtent);
+
+	void destroyPyramid ();
+
+	// the descriptors of a level after the first, which reads the level before it
+	PyramidDescriptors getPyramidDescriptors (uint32_t level) const
+	{
+		return {{pyramidSampler, pyramidLevelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL}, {VK_NULL_HANDLE, pyramidLevelViews[level], VK_IMAGE_LAYOUT_GENERAL}};
+	}
+
+	static uint32_t getDrawGroup (const CModel &model);
+
+	// a visible object outside the first pool block, its object data follows the culled objects'
+	struct OverflowDraw
+	{
+		CModel *model;
+		uint32_t lod;
+		uint32_t firstInstance;
+	};
+
+	CDevice &Device;
+	CGeometryPool &GeometryPool;
+	CWorkerPool &WorkerPool;
+	CPipelineRegistry &PipelineRegistry;
+	CFrameAllocator &FrameAllocator;
+	uint32_t maxObjects;
+
+	VkPipelineLayout pipelineLayout;
+	std::shared_ptr<CPipelineVariant> Pipeline;
+	std::shared_ptr<CPipelineVariant> PackedPipeline;
+
+	std::shared_ptr<CDescriptorSetLayout> cullSetLayout;
+	VkPipelineLayout cullPipelineLayout;
+	std::shared_ptr<CPipeline> CullPipeline;
+	CDescriptorAllocator cullAllocator {Device};
+	std::array<VkDescriptorSet, CSwapChain::MAX_FRAMES_IN_FLIGHT> cullSets {};
+
+	std::shared_ptr<CDescriptorSetLayout> pyramidSetLayout;
+	VkPipelineLayout pyramidPipelineLayout;
+	std::shared_ptr<CPipeline> PyramidPipeline;
+	CDescriptorAllocator pyramidAllocator {Device};
+	// null without push descriptors, the levels then have sets
+	std::unique_ptr<CPushDescriptorTemplate> pyramidPushTemplate;
+
+	// draw commands written by the culling pass, and the counts it appends with
+	std::unique_ptr<CBuffer> commandBuffer;
+	uint32_t commandCapacity = 0;
+	std::unique_ptr<CBuffer> countBuffer;
+	std::array<std::unique_ptr<CBuffer>, CSwapChain::MAX_FRAMES_IN_FLIGHT> readbackBuffers;
+	std::array<bool, CSwapChain::MAX_FRAMES_IN_FLIGHT> readbackPending {};
+
+	// kept in GENERAL layout, written level by level and sampled by the culling pass
+	VkImage pyramid = VK_NULL_HANDLE;
+	CMemoryAllocator::Allocation pyramidMemory {};
+	VkImageView pyramidView = VK_NULL_HANDLE;
+	std::vector<VkImageView> pyramidLevelViews;
+	VkExtent2D pyramidExtent {};
+	VkExtent2D pyramidSourceExtent {};
+	VkSampler pyramidSampler;
+	bool pyramidNeedsTransition = false;
+	// the first level reads the depth of the current frame, its set comes from the frame's allocator
+	std::vector<VkDescriptorSet> pyramidLevelSets;
+
+	// camera of the frame the pyramid was built from, occlusion is only tested when it was the previous frame
+	bool pyramidBuilt = false;
+	glm::mat4 occlusionView {1.f};
+	glm::mat4 occlusionProjection {1.f};
+
+	// state of the frame between cull and render
+	uint32_t objectDataOffset = 0;
+	std::array<uint32_t, DRAW_GROUP_COUNT> groupFirstCommand {};
+	std::array<uint32_t, DRAW_GROUP_COUNT> groupCapacity {};
+
+	CullStats cullStats {};
+	RenderStats renderStats {};
+
+	// per frame scratch, kept between frames so it does not allocate once the scene has settled
+	std::vector<CGameObject *> objects;
+	std::vector<uint32_t> objectGroups;
+	std::vector<uint32_t> chunkGroupSlots;
+	std::vector<CGameObject *> overflowObjects;
+	std::vector<OverflowDraw> overflowDraws;
+};
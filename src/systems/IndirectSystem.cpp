@@ -0,0 +1,321 @@
+#include "IndirectSystem.h"
+
+#include "SimpleSystem.h"
+
+// libs
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+// std
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+
+namespace
+{
+	constexpr uint32_t INVALID_BUCKET = std::numeric_limits<uint32_t>::max();
+}
+
+CIndirectRenderSystem::CIndirectRenderSystem (CDevice &device, CGeometryPool &geometryPool, CWorkerPool &workerPool, CPipelineRegistry &pipelineRegistry, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, LightingModel lightingModel)
+		: Device {device}, GeometryPool {geometryPool}, WorkerPool {workerPool}, PipelineRegistry {pipelineRegistry}
+{
+	createPipelineLayout(globalSetLayout);
+	createPipeline(renderPass, lightingModel);
+}
+
+CIndirectRenderSystem::~CIndirectRenderSystem ()
+{
+}
+
+void CIndirectRenderSystem::createPipelineLayout (VkDescriptorSetLayout globalSetLayout)
+{
+	pipelineLayout = PipelineRegistry.getPipelineLayout({globalSetLayout});
+}
+
+void CIndirectRenderSystem::createPipeline (VkRenderPass renderPass, LightingModel lightingModel)
+{
+	assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
+
+	PipelineConfigInfo pipelineConfig {};
+	CPipeline::defaultPipelineConfigInfo(pipelineConfig);
+	pipelineConfig.renderPass = renderPass;
+	pipelineConfig.pipelineLayout = pipelineLayout;
+	Pipeline = PipelineRegistry.requestGraphicsVariant("shaders/simple_shader.vert.spv", "shaders/simple_shader.frag.spv", pipelineConfig, {{LIGHTING_MODEL_CONSTANT_ID, static_cast<uint32_t>(lightingModel)}});
+
+	pipelineConfig.bindingDescriptions = CModel::getBindingDescriptions(CModel::VertexLayout::Packed);
+	pipelineConfig.attributeDescriptions = CModel::getAttributeDescriptions(CModel::VertexLayout::Packed);
+	PackedPipeline = PipelineRegistry.requestGraphicsVariant("shaders/packed_shader.vert.spv", "shaders/simple_shader.frag.spv", pipelineConfig, {{LIGHTING_MODEL_CONSTANT_ID, static_cast<uint32_t>(lightingModel)}});
+}
+
+void CIndirectRenderSystem::renderGameObjects (FrameInfo &frameInfo)
+{
+	renderStats = {};
+
+	gatherObjects(frameInfo);
+	bucketObjects(frameInfo);
+
+	const uint32_t instanceCount = buckets.empty() ? 0 : buckets.back().firstInstance + buckets.back().instanceCount;
+	renderStats.instances = instanceCount;
+	renderStats.objectsCulled = static_cast<uint32_t>(objects.size()) - instanceCount - renderStats.objectsDropped;
+
+	// the object data of the whole frame is one allocation, bound once and indexed by the commands' first instance
+	CFrameAllocator::Allocation objectAllocation = frameInfo.frameAllocator.allocate(sizeof(ObjectData) * instanceCount);
+	writeObjectData(static_cast<ObjectData *>(objectAllocation.data));
+
+	Pipeline->bind(frameInfo.commandBuffer);
+
+	uint32_t dynamicOffsets[] = {frameInfo.globalUboOffset, objectAllocation.offset};
+	vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &frameInfo.globalDescriptorSet, 2, dynamicOffsets);
+
+	uint32_t commandCount = 0;
+	for (const Bucket &bucket: buckets)
+	{
+		commandCount += bucket.instanceCount > 0 && bucket.model->hasIndices() ? 1 : 0;
+	}
+	CFrameAllocator::Allocation commandAllocation = frameInfo.frameAllocator.allocate(sizeof(VkDrawIndexedIndirectCommand) * commandCount);
+	recordDraws(frameInfo, commandAllocation);
+}
+
+void CIndirectRenderSystem::gatherObjects (FrameInfo &frameInfo)
+{
+	objects.clear();
+	objectModels.clear();
+	models.clear();
+	modelIndices.clear();
+
+	// objects of the same model tend to be created together, which saves most of the lookups
+	CModel *lastModel = nullptr;
+	uint32_t lastModelIndex = 0;
+	for (auto &kv: frameInfo.gameObjects)
+	{
+		auto &obj = kv.second;
+		if (obj.model == nullptr)
+		{
+			continue;
+		}
+
+		if (obj.model.get() != lastModel)
+		{
+			lastModel = obj.model.get();
+			auto inserted = modelIndices.emplace(lastModel, static_cast<uint32_t>(models.size()));
+			if (inserted.second)
+			{
+				models.push_back(lastModel);
+			}
+			lastModelIndex = inserted.first->second;
+		}
+		objects.push_back(&obj);
+		objectModels.push_back(lastModelIndex);
+	}
+
+	// buckets are numbered in pipeline, pool block and index type order, so draws sharing their bindings end up next to each other
+	std::vector<uint32_t> order(models.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [this] (uint32_t a, uint32_t b)
+	{
+		const CModel &modelA = *models[a];
+		const CModel &modelB = *models[b];
+		if (modelA.getVertexLayout() != modelB.getVertexLayout())
+		{
+			return modelA.getVertexLayout() < modelB.getVertexLayout();
+		}
+		if (modelA.getVertexBlock() != modelB.getVertexBlock())
+		{
+			return modelA.getVertexBlock() < modelB.getVertexBlock();
+		}
+		if (modelA.hasIndices() != modelB.hasIndices())
+		{
+			return modelA.hasIndices() < modelB.hasIndices();
+		}
+		if (modelA.hasIndices() && modelA.getIndexType() != modelB.getIndexType())
+		{
+			return modelA.getIndexType() < modelB.getIndexType();
+		}
+		if (modelA.hasIndices() && modelA.getIndexBlock() != modelB.getIndexBlock())
+		{
+			return modelA.getIndexBlock() < modelB.getIndexBlock();
+		}
+		return std::less<CModel *> {}(models[a], models[b]);
+	});
+
+	buckets.clear();
+	modelFirstBuckets.resize(models.size());
+	for (uint32_t modelIndex: order)
+	{
+		modelFirstBuckets[modelIndex] = static_cast<uint32_t>(buckets.size());
+		for (uint32_t lod = 0; lod < models[modelIndex]->getLodCount(); ++lod)
+		{
+			buckets.push_back({models[modelIndex], lod, 0, 0});
+		}
+	}
+}
+
+void CIndirectRenderSystem::bucketObjects (FrameInfo &frameInfo)
+{
+	const size_t objectCount = objects.size();
+	const size_t chunkCount = (objectCount + OBJECT_CHUNK_SIZE - 1) / OBJECT_CHUNK_SIZE;
+	const size_t bucketCount = buckets.size();
+
+	glm::vec4 frustumPlanes[6];
+	frameInfo.camera.getFrustumPlanes(frustumPlanes);
+
+	objectBuckets.resize(objectCount);
+	objectMatrices.resize(objectCount);
+	chunkBucketSlots.assign(chunkCount * bucketCount, 0);
+
+	WorkerPool.parallelFor(objectCount, OBJECT_CHUNK_SIZE, [&] (size_t begin, size_t end)
+	{
+		uint32_t *counts = chunkBucketSlots.data() + begin / OBJECT_CHUNK_SIZE * bucketCount;
+		for (size_t i = begin; i < end; ++i)
+		{
+			TransformComponent &transform = objects[i]->transform;
+			const CModel &model = *models[objectModels[i]];
+
+			objectMatrices[i] = transform.mat4();
+			const float scale = glm::max(glm::abs(transform.scale.x), glm::max(glm::abs(transform.scale.y), glm::abs(transform.scale.z)));
+			const glm::vec3 center = objectMatrices[i] * glm::vec4 {model.getBoundsCenter(), 1.f};
+			const float radius = model.getBoundsRadius() * scale;
+			if (!CCamera::isSphereVisible(frustumPlanes, center, radius))
+			{
+				objectBuckets[i] = INVALID_BUCKET;
+				continue;
+			}
+
+			const uint32_t bucket = modelFirstBuckets[objectModels[i]] + CSimpleRenderSystem::selectLod(model, center, radius, scale, frameInfo.camera);
+			objectBuckets[i] = bucket;
+			++counts[bucket];
+		}
+	});
+
+	// the object binding holds frameInfo.maxObjects, the visible objects past it are dropped from the back
+	uint32_t visibleCount = std::accumulate(chunkBucketSlots.begin(), chunkBucketSlots.end(), 0u);
+	for (size_t i = objectCount; visibleCount > frameInfo.maxObjects && i-- > 0;)
+	{
+		if (objectBuckets[i] == INVALID_BUCKET)
+		{
+			continue;
+		}
+		--chunkBucketSlots[i / OBJECT_CHUNK_SIZE * bucketCount + objectBuckets[i]];
+		objectBuckets[i] = INVALID_BUCKET;
+		--visibleCount;
+		++renderStats.objectsDropped;
+	}
+
+	// every chunk gets its own run of slots in each bucket, so the object data is written without synchronization
+	uint32_t slot = 0;
+	for (size_t bucket = 0; bucket < bucketCount; ++bucket)
+	{
+		buckets[bucket].firstInstance = slot;
+		for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+		{
+			const uint32_t count = chunkBucketSlots[chunk * bucketCount + bucket];
+			chunkBucketSlots[chunk * bucketCount + bucket] = slot;
+			slot += count;
+		}
+		buckets[bucket].instanceCount = slot - buckets[bucket].firstInstance;
+	}
+}
+
+void CIndirectRenderSystem::writeObjectData (ObjectData *objectData)
+{
+	const size_t bucketCount = buckets.size();
+	WorkerPool.parallelFor(objects.size(), OBJECT_CHUNK_SIZE, [&] (size_t begin, size_t end)
+	{
+		uint32_t *slots = chunkBucketSlots.data() + begin / OBJECT_CHUNK_SIZE * bucketCount;
+		for (size_t i = begin; i < end; ++i)
+		{
+			const uint32_t bucket = objectBuckets[i];
+			if (bucket == INVALID_BUCKET)
+			{
+				continue;
+			}
+
+			CGameObject &obj = *objects[i];
+			ObjectData &data = objectData[slots[bucket]++];
+			data.modelMatrix = objectMatrices[i] * buckets[bucket].model->getDequantization();
+			data.normalMatrix = obj.transform.normalMatrix();
+			data.color = glm::vec4 {obj.color, 1.f};
+		}
+	});
+}
+
+void CIndirectRenderSystem::recordDraws (FrameInfo &frameInfo, const CFrameAllocator::Allocation &commandAllocation)
+{
+	auto *commands = static_cast<VkDrawIndexedIndirectCommand *>(commandAllocation.data);
+	const VkDeviceSize commandOffset = commandAllocation.offset;
+	const VkBuffer commandBuffer = frameInfo.frameAllocator.getBuffer();
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	const uint32_t maxDrawCount = Device.enabledFeatures.multiDrawIndirect ? Device.properties.limits.maxDrawIndirectCount : 1;
+
+	// commands that can be drawn by one call, they share the pipeline, the pool blocks and the index type
+	uint32_t runStart = 0;
+	uint32_t runCount = 0;
+	auto drawRun = [&] ()
+	{
+		for (uint32_t first = runStart; first < runStart + runCount; first += maxDrawCount)
+		{
+			const uint32_t drawCount = std::min(maxDrawCount, runStart + runCount - first);
+			vkCmdDrawIndexedIndirect(frameInfo.commandBuffer, commandBuffer, commandOffset + first * stride, drawCount, stride);
+			++renderStats.drawCalls;
+		}
+		runStart += runCount;
+		runCount = 0;
+	};
+
+	CModel::VertexLayout boundLayout = CModel::VertexLayout::Full;
+	uint32_t boundVertexBlock = 0;
+	GeometryPool.bindVertexBuffer(frameInfo.commandBuffer, boundVertexBlock);
+	bool indexBufferBound = false;
+	VkIndexType boundIndexType = VK_INDEX_TYPE_UINT32;
+	uint32_t boundIndexBlock = 0;
+	for (const Bucket &bucket: buckets)
+	{
+		if (bucket.instanceCount == 0)
+		{
+			continue;
+		}
+
+		if (bucket.model->getVertexLayout() != boundLayout)
+		{
+			drawRun();
+			boundLayout = bucket.model->getVertexLayout();
+			(boundLayout == CModel::VertexLayout::Packed ? PackedPipeline : Pipeline)->bind(frameInfo.commandBuffer);
+		}
+
+		if (bucket.model->getVertexBlock() != boundVertexBlock)
+		{
+			drawRun();
+			boundVertexBlock = bucket.model->getVertexBlock();
+			GeometryPool.bindVertexBuffer(frameInfo.commandBuffer, boundVertexBlock);
+		}
+
+		// models without indices are rare enough to be drawn directly
+		if (!bucket.model->hasIndices())
+		{
+			bucket.model->draw(frameInfo.commandBuffer, bucket.lod, bucket.instanceCount, bucket.firstInstance);
+			++renderStats.drawCalls;
+			continue;
+		}
+
+		if (!indexBufferBound || bucket.model->getIndexType() != boundIndexType || bucket.model->getIndexBlock() != boundIndexBlock)
+		{
+			drawRun();
+			boundIndexType = bucket.model->getIndexType();
+			boundIndexBlock = bucket.model->getIndexBlock();
+			indexBufferBound = true;
+			GeometryPool.bindIndexBuffer(frameInfo.commandBuffer, boundIndexType, boundIndexBlock);
+		}
+
+		commands[runStart + runCount] = bucket.model->getIndirectCommand(bucket.lod, bucket.instanceCount, bucket.firstInstance);
+		++runCount;
+		++renderStats.indirectCommands;
+	}
+	drawRun();
+}
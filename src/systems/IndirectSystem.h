@@ -0,0 +1,107 @@
+#pragma once
+
+#include "Camera.h"
+#include "Device.h"
+#include "FrameInfo.h"
+#include "GameObject.h"
+#include "GeometryPool.h"
+#include "Pipeline.h"
+#include "PipelineRegistry.h"
+#include "WorkerPool.h"
+
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+
+// Renders the same objects as CSimpleRenderSystem, but the object data and one indexed indirect command per
+// model and lod are built on the worker threads each frame. Recording then takes one vkCmdDrawIndexedIndirect
+// per pipeline, pool block and index type when multiDrawIndirect is supported. Objects are culled as a whole, there is
+// no meshlet culling in this mode.
+class CIndirectRenderSystem
+{
+public:
+	// objects handed to one worker at a time
+	static constexpr size_t OBJECT_CHUNK_SIZE = 4096;
+
+	struct RenderStats
+	{
+		uint32_t drawCalls = 0;
+		uint32_t indirectCommands = 0;
+		uint32_t instances = 0;
+		uint32_t objectsCulled = 0;
+		// visible objects that did not fit the object binding
+		uint32_t objectsDropped = 0;
+	};
+
+	CIndirectRenderSystem (CDevice &device, CGeometryPool &geometryPool, CWorkerPool &workerPool, CPipelineRegistry &pipelineRegistry, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, LightingModel lightingModel = SCENE_LIGHTING_MODEL);
+	~CIndirectRenderSystem ();
+
+	CIndirectRenderSystem (const CIndirectRenderSystem &) = delete;
+
+	CIndirectRenderSystem &operator= (const CIndirectRenderSystem &) = delete;
+
+	// the object data is indexed with the commands' firstInstance, which needs drawIndirectFirstInstance
+	static bool isSupported (CDevice &device)
+	{
+		return device.enabledFeatures.drawIndirectFirstInstance == VK_TRUE;
+	}
+
+	void renderGameObjects (FrameInfo &frameInfo);
+
+	const RenderStats &getRenderStats () const
+	{
+		return renderStats;
+	}
+
+private:
+	// a model and lod, the buckets of a model are consecutive and ordered by lod
+	struct Bucket
+	{
+		CModel *model;
+		uint32_t lod;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+	};
+
+	void createPipelineLayout (VkDescriptorSetLayout globalSetLayout);
+
+	void createPipeline (VkRenderPass renderPass, LightingModel lightingModel);
+
+	// collects the objects with a model and numbers the buckets so that they are sorted by pipeline and index type
+	void gatherObjects (FrameInfo &frameInfo);
+
+	// culls and selects the lod of every object, then sorts the visible ones that fit the object binding into their buckets
+	void bucketObjects (FrameInfo &frameInfo);
+
+	void writeObjectData (ObjectData *objectData);
+
+	// writes the indirect commands into commandAllocation while recording the calls that draw them
+	void recordDraws (FrameInfo &frameInfo, const CFrameAllocator::Allocation &commandAllocation);
+
+	CDevice &Device;
+	CGeometryPool &GeometryPool;
+	CWorkerPool &WorkerPool;
+	CPipelineRegistry &PipelineRegistry;
+
+	std::shared_ptr<CPipelineVariant> Pipeline;
+	std::shared_ptr<CPipelineVariant> PackedPipeline;
+	VkPipelineLayout pipelineLayout;
+
+	RenderStats renderStats {};
+
+	// per frame scratch, kept between frames so it does not allocate once the scene has settled
+	std::vector<CGameObject *> objects;
+	std::vector<uint32_t> objectModels;
+	// bucket of each object, INVALID_BUCKET when it was culled
+	std::vector<uint32_t> objectBuckets;
+	// transform matrices computed while culling, reused when writing the object data
+	std::vector<glm::mat4> objectMatrices;
+	std::vector<CModel *> models;
+	std::unordered_map<CModel *, uint32_t> modelIndices;
+	std::vector<uint32_t> modelFirstBuckets;
+	std::vector<Bucket> buckets;
+	// instances per chunk and bucket, turned into the first slot of each chunk's instances in the bucket
+	std::vector<uint32_t> chunkBucketSlots;
+};
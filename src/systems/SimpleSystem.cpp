@@ -8,51 +8,30 @@
 #include <glm/gtc/constants.hpp>
 
 // std
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <functional>
 #include <stdexcept>
 
 
-struct SimplePushConstantData
-{
-	glm::mat4 modelMatrix {1.f};
-	glm::mat4 normalMatrix {1.f};
-};
-
-CSimpleRenderSystem::CSimpleRenderSystem (CDevice &device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout)
-		: Device {device}
+CSimpleRenderSystem::CSimpleRenderSystem (CDevice &device, CGeometryPool &geometryPool, CPipelineRegistry &pipelineRegistry, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, LightingModel lightingModel)
+		: Device {device}, GeometryPool {geometryPool}, PipelineRegistry {pipelineRegistry}
 {
 	createPipelineLayout(globalSetLayout);
-	createPipeline(renderPass);
+	createPipeline(renderPass, lightingModel);
 }
 
 CSimpleRenderSystem::~CSimpleRenderSystem ()
 {
-	vkDestroyPipelineLayout(Device.GetDevice(), pipelineLayout, nullptr);
 }
 
 void CSimpleRenderSystem::createPipelineLayout (VkDescriptorSetLayout globalSetLayout)
 {
-	VkPushConstantRange pushConstantRange {};
-	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-	pushConstantRange.offset = 0;
-	pushConstantRange.size = sizeof(SimplePushConstantData);
-
-	std::vector<VkDescriptorSetLayout> descriptorSetLayouts {globalSetLayout};
-
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo {};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-	pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-	pipelineLayoutInfo.pushConstantRangeCount = 1;
-	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-	if (vkCreatePipelineLayout(Device.GetDevice(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to create pipeline layout!");
-	}
+	pipelineLayout = PipelineRegistry.getPipelineLayout({globalSetLayout});
 }
 
-void CSimpleRenderSystem::createPipeline (VkRenderPass renderPass)
+void CSimpleRenderSystem::createPipeline (VkRenderPass renderPass, LightingModel lightingModel)
 {
 	assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
 
@@ -60,15 +39,44 @@ void CSimpleRenderSystem::createPipeline (VkRenderPass renderPass)
 	CPipeline::defaultPipelineConfigInfo(pipelineConfig);
 	pipelineConfig.renderPass = renderPass;
 	pipelineConfig.pipelineLayout = pipelineLayout;
- 	Pipeline = std::make_unique<CPipeline>(Device, "shaders/simple_shader.vert.spv", "shaders/simple_shader.frag.spv", pipelineConfig);
+	Pipeline = PipelineRegistry.requestGraphicsVariant("shaders/simple_shader.vert.spv", "shaders/simple_shader.frag.spv", pipelineConfig, {{LIGHTING_MODEL_CONSTANT_ID, static_cast<uint32_t>(lightingModel)}});
+	coneCulling = pipelineConfig.rasterizationInfo.cullMode == VK_CULL_MODE_BACK_BIT;
+
+	pipelineConfig.bindingDescriptions = CModel::getBindingDescriptions(CModel::VertexLayout::Packed);
+	pipelineConfig.attributeDescriptions = CModel::getAttributeDescriptions(CModel::VertexLayout::Packed);
+	PackedPipeline = PipelineRegistry.requestGraphicsVariant("shaders/packed_shader.vert.spv", "shaders/simple_shader.frag.spv", pipelineConfig, {{LIGHTING_MODEL_CONSTANT_ID, static_cast<uint32_t>(lightingModel)}});
 }
 
 void CSimpleRenderSystem::renderGameObjects (FrameInfo &frameInfo)
 {
- 	Pipeline->bind(frameInfo.commandBuffer);
+	const uint32_t objectOffset = prepareDraws(frameInfo);
+	recordDrawGroups(frameInfo, frameInfo.commandBuffer, objectOffset, 0, drawGroups.size(), renderStats);
+}
 
-	vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &frameInfo.globalDescriptorSet, 0, nullptr);
+void CSimpleRenderSystem::renderGameObjects (FrameInfo &frameInfo, CParallelCommandRecorder &recorder, const CParallelCommandRecorder::Inheritance &inheritance)
+{
+	const uint32_t objectOffset = prepareDraws(frameInfo);
+
+	sliceStats.assign(recorder.getSliceCount(), {});
+	recorder.record(frameInfo.commandBuffer, inheritance, drawGroups.size(), [&] (VkCommandBuffer commandBuffer, uint32_t slice, size_t begin, size_t end)
+	{
+		recordDrawGroups(frameInfo, commandBuffer, objectOffset, begin, end, sliceStats[slice]);
+	});
+
+	for (const RenderStats &stats: sliceStats)
+	{
+		renderStats.drawCalls += stats.drawCalls;
+		renderStats.clustersTested += stats.clustersTested;
+		renderStats.clustersCulled += stats.clustersCulled;
+	}
+}
 
+uint32_t CSimpleRenderSystem::prepareDraws (FrameInfo &frameInfo)
+{
+	frameInfo.camera.getFrustumPlanes(frustumPlanes);
+	renderStats = {};
+
+	instances.clear();
 	for (auto &kv: frameInfo.gameObjects)
 	{
 		auto &obj = kv.second;
@@ -76,14 +84,221 @@ void CSimpleRenderSystem::renderGameObjects (FrameInfo &frameInfo)
 		{
 			continue;
 		}
-		SimplePushConstantData push {};
-		push.modelMatrix = obj.transform.mat4();
-		push.normalMatrix = obj.transform.normalMatrix();
 
-		vkCmdPushConstants(frameInfo.commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SimplePushConstantData), &push);
-		obj.model->bind(frameInfo.commandBuffer);
-		obj.model->draw(frameInfo.commandBuffer);
+		const float scale = glm::max(glm::abs(obj.transform.scale.x), glm::max(glm::abs(obj.transform.scale.y), glm::abs(obj.transform.scale.z)));
+		const glm::vec3 center = obj.transform.mat4() * glm::vec4 {obj.model->getBoundsCenter(), 1.f};
+		const float radius = obj.model->getBoundsRadius() * scale;
+		if (!CCamera::isSphereVisible(frustumPlanes, center, radius))
+		{
+			++renderStats.objectsCulled;
+			continue;
+		}
+		// the object binding holds frameInfo.maxObjects, the visible objects past it are not drawn
+		if (instances.size() == frameInfo.maxObjects)
+		{
+			++renderStats.objectsDropped;
+			continue;
+		}
+
+		instances.push_back({obj.model.get(), selectLod(*obj.model, center, radius, scale, frameInfo.camera), &obj});
+	}
+
+	// grouped by pipeline, pool block and index type first so they are bound as rarely as possible
+	std::sort(instances.begin(), instances.end(), [] (const Instance &a, const Instance &b)
+	{
+		if (a.model->getVertexLayout() != b.model->getVertexLayout())
+		{
+			return a.model->getVertexLayout() < b.model->getVertexLayout();
+		}
+		if (a.model->getVertexBlock() != b.model->getVertexBlock())
+		{
+			return a.model->getVertexBlock() < b.model->getVertexBlock();
+		}
+		if (a.model->hasIndices() != b.model->hasIndices())
+		{
+			return a.model->hasIndices() < b.model->hasIndices();
+		}
+		if (a.model->hasIndices() && a.model->getIndexType() != b.model->getIndexType())
+		{
+			return a.model->getIndexType() < b.model->getIndexType();
+		}
+		if (a.model->hasIndices() && a.model->getIndexBlock() != b.model->getIndexBlock())
+		{
+			return a.model->getIndexBlock() < b.model->getIndexBlock();
+		}
+		if (a.model != b.model)
+		{
+			return std::less<CModel *> {}(a.model, b.model);
+		}
+		return a.lod < b.lod;
+	});
+
+	// the object data of the whole frame is one allocation, bound once and indexed by the draws' first instance
+	const uint32_t instanceCount = static_cast<uint32_t>(instances.size());
+	CFrameAllocator::Allocation objectAllocation = frameInfo.frameAllocator.allocate(sizeof(ObjectData) * instanceCount);
+	auto *objectData = static_cast<ObjectData *>(objectAllocation.data);
+	for (uint32_t i = 0; i < instanceCount; ++i)
+	{
+		CGameObject &obj = *instances[i].object;
+		objectData[i].modelMatrix = obj.transform.mat4() * instances[i].model->getDequantization();
+		objectData[i].normalMatrix = obj.transform.normalMatrix();
+		objectData[i].color = glm::vec4 {obj.color, 1.f};
+	}
+	renderStats.instances = instanceCount;
+
+	drawGroups.clear();
+	for (uint32_t first = 0; first < instanceCount;)
+	{
+		uint32_t count = 1;
+		while (first + count < instanceCount && instances[first + count].model == instances[first].model && instances[first + count].lod == instances[first].lod)
+		{
+			++count;
+		}
+		drawGroups.push_back({first, count});
+		first += count;
+	}
+	return objectAllocation.offset;
+}
+
+void CSimpleRenderSystem::recordDrawGroups (const FrameInfo &frameInfo, VkCommandBuffer commandBuffer, uint32_t objectOffset, size_t begin, size_t end, RenderStats &stats)
+{
+	Pipeline->bind(commandBuffer);
+	CModel::VertexLayout boundLayout = CModel::VertexLayout::Full;
+
+	uint32_t dynamicOffsets[] = {frameInfo.globalUboOffset, objectOffset};
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &frameInfo.globalDescriptorSet, 2, dynamicOffsets);
+
+	// every model lives in the geometry pool, so the buffers only change with the pool block and the index type
+	uint32_t boundVertexBlock = 0;
+	GeometryPool.bindVertexBuffer(commandBuffer, boundVertexBlock);
+	bool indexBufferBound = false;
+	VkIndexType boundIndexType = VK_INDEX_TYPE_UINT32;
+	uint32_t boundIndexBlock = 0;
+
+	for (size_t i = begin; i < end; ++i)
+	{
+		const uint32_t first = drawGroups[i].first;
+		const uint32_t count = drawGroups[i].count;
+		CModel &model = *instances[first].model;
+		const uint32_t lod = instances[first].lod;
+
+		if (model.getVertexLayout() != boundLayout)
+		{
+			boundLayout = model.getVertexLayout();
+			(boundLayout == CModel::VertexLayout::Packed ? PackedPipeline : Pipeline)->bind(commandBuffer);
+		}
+
+		if (model.getVertexBlock() != boundVertexBlock)
+		{
+			boundVertexBlock = model.getVertexBlock();
+			GeometryPool.bindVertexBuffer(commandBuffer, boundVertexBlock);
+		}
+
+		if (model.hasIndices() && (!indexBufferBound || model.getIndexType() != boundIndexType || model.getIndexBlock() != boundIndexBlock))
+		{
+			boundIndexType = model.getIndexType();
+			boundIndexBlock = model.getIndexBlock();
+			indexBufferBound = true;
+			GeometryPool.bindIndexBuffer(commandBuffer, boundIndexType, boundIndexBlock);
+		}
+
+		// meshlet culling depends on the transform, so only objects drawn alone use it
+		if (count == 1)
+		{
+			drawVisibleMeshlets(frameInfo, commandBuffer, model, lod, instances[first].object->transform, first, stats);
+		}
+		else
+		{
+			model.draw(commandBuffer, lod, count, first);
+			++stats.drawCalls;
+		}
+	}
+}
+
+void CSimpleRenderSystem::drawVisibleMeshlets (const FrameInfo &frameInfo, VkCommandBuffer commandBuffer, CModel &model, uint32_t lod, TransformComponent &transform, uint32_t objectIndex, RenderStats &stats)
+{
+	const CModel::Lod &lodRange = model.getLod(lod);
+	if (lodRange.meshletCount == 0)
+	{
+		model.draw(commandBuffer, lod, 1, objectIndex);
+		++stats.drawCalls;
+		return;
+	}
+
+	const glm::mat4 modelMatrix = transform.mat4();
+	const glm::mat3 normalMatrix = transform.normalMatrix();
+	const glm::vec3 absScale = glm::abs(transform.scale);
+	const float maxScale = glm::max(absScale.x, glm::max(absScale.y, absScale.z));
+	const float minScale = glm::min(absScale.x, glm::min(absScale.y, absScale.z));
+	// normal cones only stay valid under uniform scale
+	const bool testCones = coneCulling && maxScale - minScale <= 1e-4f * maxScale;
+	const glm::vec3 cameraPosition = frameInfo.camera.getPosition();
+
+	// neighbouring visible meshlets are merged into a single draw
+	uint32_t runStart = 0;
+	uint32_t runCount = 0;
+	const CModel::Meshlet *meshlets = model.getMeshlets(lod);
+	for (uint32_t i = 0; i < lodRange.meshletCount; ++i)
+	{
+		const CModel::Meshlet &meshlet = meshlets[i];
+		const glm::vec3 center = modelMatrix * glm::vec4 {meshlet.center, 1.f};
+		const float radius = meshlet.radius * maxScale;
+
+		bool visible = CCamera::isSphereVisible(frustumPlanes, center, radius);
+		if (visible && testCones && meshlet.coneCutoff < 1.f)
+		{
+			CModel::Meshlet worldMeshlet = meshlet;
+			worldMeshlet.center = center;
+			worldMeshlet.radius = radius;
+			worldMeshlet.coneAxis = glm::normalize(normalMatrix * meshlet.coneAxis);
+			visible = !worldMeshlet.isBackFacing(cameraPosition);
+		}
+
+		++stats.clustersTested;
+		if (!visible)
+		{
+			++stats.clustersCulled;
+			continue;
+		}
+
+		if (runCount > 0 && runStart + runCount == meshlet.firstIndex)
+		{
+			runCount += meshlet.indexCount;
+			continue;
+		}
+
+		if (runCount > 0)
+		{
+			model.drawIndexRange(commandBuffer, runStart, runCount, 1, objectIndex);
+			++stats.drawCalls;
+		}
+		runStart = meshlet.firstIndex;
+		runCount = meshlet.indexCount;
+	}
+
+	if (runCount > 0)
+	{
+		model.drawIndexRange(commandBuffer, runStart, runCount, 1, objectIndex);
+		++stats.drawCalls;
 	}
 }
 
+uint32_t CSimpleRenderSystem::selectLod (const CModel &model, const glm::vec3 &center, float radius, float scale, const CCamera &camera)
+{
+	const float distance = glm::length(center - camera.getPosition());
+
+	if (distance <= radius)
+	{
+		return 0;
+	}
+
+	// projection[1][1] is cot(fovy / 2), so this maps a world space length at the sphere's distance to viewport heights
+	const float projectedScale = camera.getProjection()[1][1] * 0.5f / (distance - radius);
 
+	uint32_t lod = 0;
+	while (lod + 1 < model.getLodCount() && model.getLod(lod + 1).error * scale * projectedScale <= LOD_ERROR_THRESHOLD)
+	{
+		++lod;
+	}
+	return lod;
+}
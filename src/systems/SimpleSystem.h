@@ -4,7 +4,10 @@
 #include "Device.h"
 #include "FrameInfo.h"
 #include "GameObject.h"
+#include "GeometryPool.h"
+#include "ParallelCommandRecorder.h"
 #include "Pipeline.h"
+#include "PipelineRegistry.h"
 
 
 #include <memory>
@@ -14,19 +17,83 @@
 class CSimpleRenderSystem
 {
 public:
-	CSimpleRenderSystem (CDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
+	// largest simplification error allowed on screen, as a fraction of the viewport height
+	static constexpr float LOD_ERROR_THRESHOLD = 0.001f;
+
+	struct RenderStats
+	{
+		uint32_t drawCalls = 0;
+		uint32_t instances = 0;
+		uint32_t objectsCulled = 0;
+		// visible objects that did not fit the object binding
+		uint32_t objectsDropped = 0;
+		uint32_t clustersTested = 0;
+		uint32_t clustersCulled = 0;
+	};
+
+	CSimpleRenderSystem (CDevice& device, CGeometryPool &geometryPool, CPipelineRegistry &pipelineRegistry, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, LightingModel lightingModel = SCENE_LIGHTING_MODEL);
 	~CSimpleRenderSystem ();
 
 	void renderGameObjects (FrameInfo &frameInfo);
 
+	// records the draws into secondary command buffers on the worker threads of recorder, the render pass of
+	// frameInfo.commandBuffer must have been begun with secondary contents
+	void renderGameObjects (FrameInfo &frameInfo, CParallelCommandRecorder &recorder, const CParallelCommandRecorder::Inheritance &inheritance);
+
+	// coarsest lod whose projected error stays under LOD_ERROR_THRESHOLD for a model with the given world space bounds
+	// and scale, lod 0 when the camera is inside the bounds
+	static uint32_t selectLod (const CModel &model, const glm::vec3 &center, float radius, float scale, const CCamera &camera);
+
+	// draw and culling counters of the last renderGameObjects call
+	const RenderStats &getRenderStats () const
+	{
+		return renderStats;
+	}
+
 private:
+	// a visible object, instances of the same model and lod end up next to each other once sorted
+	struct Instance
+	{
+		CModel *model;
+		uint32_t lod;
+		CGameObject *object;
+	};
+
 	void createPipelineLayout (VkDescriptorSetLayout globalSetLayout);
 
-	void createPipeline (VkRenderPass renderPass);
+	void createPipeline (VkRenderPass renderPass, LightingModel lightingModel);
+
+	// instances of the same model and lod, drawn together unless it is a single object
+	struct DrawGroup
+	{
+		uint32_t first;
+		uint32_t count;
+	};
+
+	// culls and sorts the instances, writes their object data and groups them, returns the object data offset
+	uint32_t prepareDraws (FrameInfo &frameInfo);
+
+	// records draw groups [begin, end) with every binding they need, so slices can be recorded independently
+	void recordDrawGroups (const FrameInfo &frameInfo, VkCommandBuffer commandBuffer, uint32_t objectOffset, size_t begin, size_t end, RenderStats &stats);
+
+	void drawVisibleMeshlets (const FrameInfo &frameInfo, VkCommandBuffer commandBuffer, CModel &model, uint32_t lod, TransformComponent &transform, uint32_t objectIndex, RenderStats &stats);
 
 	CDevice& Device;
+	CGeometryPool &GeometryPool;
+	CPipelineRegistry &PipelineRegistry;
 
-	std::unique_ptr<CPipeline> Pipeline;
+	std::shared_ptr<CPipelineVariant> Pipeline;
+	std::shared_ptr<CPipelineVariant> PackedPipeline;
 	VkPipelineLayout pipelineLayout;
+
+	// back facing clusters can only be skipped when the pipeline culls back faces
+	bool coneCulling = false;
+	RenderStats renderStats {};
+	// kept between frames so gathering the instances does not allocate
+	std::vector<Instance> instances;
+	std::vector<DrawGroup> drawGroups;
+	// counters of each slice of a parallel recording, summed into renderStats
+	std::vector<RenderStats> sliceStats;
+	glm::vec4 frustumPlanes[6];
 };
 